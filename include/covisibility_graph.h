@@ -0,0 +1,46 @@
+#ifndef COVISIBILITY_GRAPH_H_
+#define COVISIBILITY_GRAPH_H_
+
+#include <vector>
+#include <utility>
+
+#include "observation_list.h"
+#include "slot_map.h"
+
+// Keyframe covisibility keyed by frame id. The weight of an edge is the number of mappoints observed by
+// both keyframes, and is changed by the map every time an observation is added or removed. Ordered
+// neighbor lists are cached per keyframe and rebuilt only after its edges changed.
+class CovisibilityGraph{
+public:
+  CovisibilityGraph(int min_weight);
+
+  void ChangeWeight(int frame_id0, int frame_id1, int delta);
+  int GetWeight(int frame_id0, int frame_id1);
+  void RemoveFrame(int frame_id);
+
+  // all neighbors as (frame_id, weight) sorted by frame id
+  const ObservationList& GetNeighbors(int frame_id);
+
+  // (weight, frame_id) of neighbors with weight > min_weight, strongest first. If there is none, the
+  // strongest neighbor alone.
+  const std::vector<std::pair<int, int>>& GetOrderedNeighbors(int frame_id);
+
+private:
+  struct Node{
+    ObservationList weights;
+    std::vector<std::pair<int, int>> ordered;
+    bool ordered_valid;
+
+    Node(): ordered_valid(false) {}
+  };
+
+  void AddToWeight(int frame_id, int neighbor_id, int delta);
+
+private:
+  int _min_weight;
+  SlotMap<Node> _nodes;
+  const ObservationList _empty_neighbors;
+  const std::vector<std::pair<int, int>> _empty_ordered;
+};
+
+#endif  // COVISIBILITY_GRAPH_H_
@@ -27,6 +27,8 @@ public:
   bool PoseFixed();
   void SetPose(const Eigen::Matrix4d& pose);
   Eigen::Matrix4d& GetPose();
+  void SetTrackedByKlt(bool tracked_by_klt);
+  bool TrackedByKlt();
 
   // point features
   bool FindGrid(double& x, double& y, int& grid_x, int& grid_y);
@@ -34,6 +36,8 @@ public:
       Eigen::Matrix<double, 259, Eigen::Dynamic>& features_right, std::vector<Eigen::Vector4d>& lines_left, 
       std::vector<Eigen::Vector4d>& lines_right, std::vector<cv::DMatch>& stereo_matches);
   void AddLeftFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features_left, std::vector<Eigen::Vector4d>& lines_left);
+  void AddLeftFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features_left, std::vector<Eigen::Vector4d>& lines_left, 
+      std::vector<std::map<int, double>>& points_on_lines);
   int AddRightFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features_right, std::vector<Eigen::Vector4d>& lines_right, std::vector<cv::DMatch>& stereo_matches);
 
   Eigen::Matrix<double, 259, Eigen::Dynamic>& GetAllFeatures();
@@ -85,23 +89,17 @@ public:
   std::map<int, double> GetPointsOnLine(size_t idx);
   const std::vector<std::map<int, double>>& GetPointsOnLines();
   bool TriangulateStereoLine(size_t idx, Vector6d& endpoints);
-  void RemoveMapline(MaplinePtr mapline);
+  void RemoveMapline(const MaplinePtr& mapline);
   void RemoveMapline(int idx);
 
-  // covisibility graph
-  void AddConnection(std::shared_ptr<Frame> frame, int weight);
-  void AddConnection(std::set<std::pair<int, std::shared_ptr<Frame>>> connections);
+  // spanning tree, covisibility weights are kept by the map
   void SetParent(std::shared_ptr<Frame> parent);
   std::shared_ptr<Frame> GetParent();
   void SetChild(std::shared_ptr<Frame> child);
   std::shared_ptr<Frame> GetChild();
 
-  void RemoveConnection(std::shared_ptr<Frame> frame);
-  void RemoveMappoint(MappointPtr mappoint);
+  void RemoveMappoint(const MappointPtr& mappoint);
   void RemoveMappoint(int idx);
-  void DecreaseWeight(std::shared_ptr<Frame> frame, int weight);
-
-  std::vector<std::pair<int, std::shared_ptr<Frame>>> GetOrderedConnections(int number);
 
   void SetPreviousFrame(const std::shared_ptr<Frame> previous_frame);
   std::shared_ptr<Frame> PreviousFrame();
@@ -110,6 +108,7 @@ public:
   int tracking_frame_id;
   int local_map_optimization_frame_id;
   int local_map_optimization_fix_frame_id;
+  int local_map_optimization_index;     // index of the pose in the local map problem
 
   // debug
   std::vector<int> line_left_to_right_match;
@@ -120,6 +119,7 @@ private:
   int _frame_id;
   double _timestamp;
   bool _pose_fixed;
+  bool _tracked_by_klt;
   Eigen::Matrix4d _pose;
 
   // point features
@@ -143,9 +143,7 @@ private:
 
   CameraPtr _camera;
 
-  // covisibility graph
-  std::map<std::shared_ptr<Frame>, int> _connections;
-  std::set<std::pair<int, std::shared_ptr<Frame>>> _ordered_connections;
+  // spanning tree
   std::shared_ptr<Frame> _parent;
   std::shared_ptr<Frame> _child;
   std::shared_ptr<Frame> _previous_frame;
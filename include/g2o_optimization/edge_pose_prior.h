@@ -0,0 +1,35 @@
+#ifndef EDGE_POSE_PRIOR_H_
+#define EDGE_POSE_PRIOR_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <g2o/core/base_multi_edge.h>
+#include <g2o/types/sba/vertex_se3_expmap.h>
+
+// Dense Gaussian prior on several poses, left by marginalizing states out of a sliding window.
+// With the update dx_i = log(Tcw_i * Tcw0_i^-1) the error is J * dx + r0, so that 0.5 * |error|^2
+// is the marginalized cost 0.5 * dx^T * H * dx + g^T * dx up to a constant. The jacobian is fixed
+// at the linearization point.
+class EdgePosePrior : public g2o::BaseMultiEdge<-1, Eigen::VectorXd> {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  EdgePosePrior();
+
+  // H and g are the hessian and gradient w.r.t. the 6-dof updates of the vertices at their current
+  // estimates, returns false if H carries no information
+  bool SetPrior(const std::vector<g2o::VertexSE3Expmap*>& vertices, const Eigen::MatrixXd& H, const Eigen::VectorXd& g);
+
+  bool read(std::istream &is);
+  bool write(std::ostream &os) const;
+  void computeError();
+  virtual void linearizeOplus();
+
+  // 6 * vertex number columns
+  Eigen::MatrixXd J;
+  Eigen::VectorXd r0;
+  std::vector<g2o::SE3Quat, Eigen::aligned_allocator<g2o::SE3Quat>> linearization_points;
+};
+
+#endif  // EDGE_POSE_PRIOR_H_
@@ -12,7 +12,10 @@
 
 #include "utils.h"
 #include "g2o_optimization/vertex_line3d.h"
+#include "g2o_optimization/line_jacobians.h"
 
+// computeError and linearizeOplus only read the vertices and write the edge's own error and jacobians,
+// without heap allocation, so different edges can be evaluated concurrently
 class EdgeStereoSE3ProjectLine
     : public g2o::BaseBinaryEdge<4, Vector8d, VertexLine3D, g2o::VertexSE3Expmap> {
  public:
@@ -23,8 +26,11 @@ class EdgeStereoSE3ProjectLine
   bool read(std::istream &is);
   bool write(std::ostream &os) const;
   void computeError();
+  virtual void linearizeOplus();
 
   Eigen::Vector3d cam_project(const g2o::Line3D &line) const;
+  // image line of the camera frame moment w
+  Eigen::Vector3d cam_project(const Eigen::Vector3d &w) const;
 
   double fx, fy, b;
   Eigen::Vector3d Kv; // [-cx*fy, -fx*cy, fx*fy]
@@ -0,0 +1,14 @@
+#ifndef LINE_JACOBIANS_H_
+#define LINE_JACOBIANS_H_
+
+#include <Eigen/Core> 
+
+// image line [fy * w0, fx * w1, Kv . w] of the camera frame moment w, Kv = [-cx*fy, -fx*cy, fx*fy]
+Eigen::Vector3d ProjectLineMoment(const Eigen::Vector3d& w, double fx, double fy, const Eigen::Vector3d& Kv);
+
+// derivative of the two normalized distances of the endpoints obs = [u0, v0, u1, v1] to the image line
+// of the camera frame moment w, w.r.t. w. shared by the mono and stereo line edges
+Eigen::Matrix<double, 2, 3> LineErrorJacobian(const Eigen::Vector4d& obs, const Eigen::Vector3d& w, 
+    double fx, double fy, const Eigen::Vector3d& Kv);
+
+#endif  // LINE_JACOBIANS_H_
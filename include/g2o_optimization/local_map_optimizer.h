@@ -0,0 +1,110 @@
+#ifndef LOCAL_MAP_OPTIMIZER_H_
+#define LOCAL_MAP_OPTIMIZER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include <g2o/core/sparse_optimizer.h>
+
+#include "read_configs.h"
+#include "camera.h"
+#include "g2o_optimization/types.h"
+#include "g2o_optimization/parallel_solver.h"
+
+class SwitchableHuberKernel;
+class EdgePosePrior;
+class OptimizationMonitor;
+
+// Local bundle adjustment on a g2o graph that lives as long as the map. Every call diffs the new
+// window against the graph: only keyframes, landmarks and observations that entered or left the
+// window are added or removed, the others keep their vertices, edges and robust kernels and start
+// from the values the map holds, which are the results of the previous call.
+class LocalMapOptimizer{
+public:
+  LocalMapOptimizer();
+  ~LocalMapOptimizer();
+
+  // poses, points and lines of the problem are refined in place and the inlier flags of the constraints are set.
+  // returns false if the abort flag or the time budget stopped it before the first iteration, the problem
+  // is left untouched then
+  bool Optimize(LocalMapProblem& problem, std::vector<CameraPtr>& camera_list, const OptimizationConfig& cfg);
+
+  // sliding window mode, called before the next Optimize with the poses of the last window that stay
+  // in the new one and those that leave. the leaving poses and the landmarks they observe are eliminated
+  // with the Schur complement into a dense prior on the kept poses, which replaces the previous prior.
+  // the ids of the eliminated landmarks are returned, they have to be fixed and their observations by
+  // the kept poses left out from then on, as that information is in the prior
+  void Marginalize(const std::vector<int>& kept_frame_ids, const std::vector<int>& marginalized_frame_ids,
+      std::vector<int>& mappoint_ids, std::vector<int>& mapline_ids);
+
+  // once the flag is raised, the running optimization stops after the current iteration and the
+  // second pass is skipped, the results so far are still written back if an iteration ran
+  void SetAbortFlag(const std::atomic<bool>* abort_flag);
+
+  // workers for linearizing the edges and computing the errors, everything runs on the calling
+  // thread without a pool
+  void SetThreadPool(const ThreadPoolPtr& thread_pool);
+
+  // whether the last call was stopped by the time budget or the abort flag
+  bool Interrupted(){ return _interrupted; }
+
+  // number of vertices and edges added and removed by the last call
+  int AddedNum(){ return _added_num; }
+  int RemovedNum(){ return _removed_num; }
+
+private:
+  enum EdgeType{
+    MonoPointEdge = 0,
+    StereoPointEdge = 1,
+    MonoLineEdge = 2,
+    StereoLineEdge = 3
+  };
+
+  struct EdgeRecord{
+    g2o::OptimizableGraph::Edge* edge;
+    SwitchableHuberKernel* kernel;      // owned by edge
+    int type;
+    int stamp;
+  };
+
+  // poses, points and lines share the id space of the optimizer
+  static int PoseVertexId(int frame_id){ return 3 * frame_id; }
+  static int PointVertexId(int mappoint_id){ return 3 * mappoint_id + 1; }
+  static int LineVertexId(int mapline_id){ return 3 * mapline_id + 2; }
+  static int64_t EdgeKey(int landmark_vertex_id, int frame_id){
+    return (static_cast<int64_t>(landmark_vertex_id) << 32) | static_cast<uint32_t>(frame_id);
+  }
+
+  // returns nullptr if the edge is not in the graph, an edge of another type is removed
+  EdgeRecord* FindEdge(int64_t key, int type);
+  EdgeRecord* AddEdge(int64_t key, int type, g2o::OptimizableGraph::Edge* edge, double delta);
+
+  // drops everything that was not part of the current window
+  void RemoveStale();
+
+private:
+  // windows without lines use fixed 6x3 blocks, the others dynamic blocks for 3-dof points and 4-dof lines.
+  // the block solvers are owned by the algorithms
+  std::unique_ptr<ParallelLevenberg> _point_algorithm;
+  std::unique_ptr<ParallelLevenberg> _mixed_algorithm;
+  ParallelBlockSolver<g2o::BlockSolverTraits<6, 3> >* _point_block_solver;
+  ParallelBlockSolver<g2o::BlockSolverTraits<-1, -1> >* _mixed_block_solver;
+
+  ThreadPoolPtr _thread_pool;
+  g2o::SparseOptimizer _optimizer;
+  EdgePosePrior* _prior_edge;         // owned by _optimizer
+  std::unique_ptr<OptimizationMonitor> _monitor;
+  bool _interrupted;
+  int _stamp;
+  int _added_num;
+  int _removed_num;
+  std::unordered_map<int, int> _vertex_stamps;
+  std::unordered_map<int64_t, EdgeRecord> _edges;
+};
+
+typedef std::shared_ptr<LocalMapOptimizer> LocalMapOptimizerPtr;
+
+#endif  // LOCAL_MAP_OPTIMIZER_H_
@@ -0,0 +1,125 @@
+#ifndef PARALLEL_SOLVER_H_
+#define PARALLEL_SOLVER_H_
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <g2o/core/block_solver.h>
+#include <g2o/core/jacobian_workspace.h>
+#include <g2o/core/optimization_algorithm_with_hessian.h>
+#include <g2o/core/sparse_optimizer.h>
+
+#include "thread_pool.h"
+
+// Block solver that linearizes the edges on several threads. Every edge gets its own jacobian
+// workspace, so all edges are linearized first and their quadratic forms are then added to the
+// system in edge order on the calling thread, which gives the same system as g2o::BlockSolver.
+// The edges have to be safe to linearize concurrently.
+template<typename Traits>
+class ParallelBlockSolver : public g2o::BlockSolver<Traits>{
+public:
+  typedef typename g2o::BlockSolver<Traits>::LinearSolverType LinearSolverType;
+
+  ParallelBlockSolver(std::unique_ptr<LinearSolverType> linear_solver):
+      g2o::BlockSolver<Traits>(std::move(linear_solver)), _thread_pool(nullptr) {}
+
+  // the pool is not owned, without one the edges are linearized on the calling thread
+  void SetThreadPool(ThreadPool* thread_pool){ _thread_pool = thread_pool; }
+
+  virtual bool buildSystem(){
+    if(!_thread_pool || _thread_pool->ThreadNum() <= 1) return g2o::BlockSolver<Traits>::buildSystem();
+
+    g2o::SparseOptimizer* optimizer = this->_optimizer;
+    const g2o::SparseOptimizer::VertexContainer& vertices = optimizer->indexMapping();
+    const g2o::SparseOptimizer::EdgeContainer& edges = optimizer->activeEdges();
+    for(g2o::OptimizableGraph::Vertex* v : vertices){
+      v->clearQuadraticForm();
+    }
+    this->_Hpp->clear();
+    if(this->_doSchur){
+      this->_Hll->clear();
+      this->_Hpl->clear();
+    }
+
+    // workspaces only grow, so they are allocated while the window grows and reused afterwards. a
+    // slot can be taken by a multi edge with more vertices, so both sizes are tracked
+    if(_workspaces.size() < edges.size()){
+      _workspaces.resize(edges.size());
+      _workspace_sizes.resize(edges.size(), 0);
+      _workspace_vertex_nums.resize(edges.size(), 0);
+    }
+    for(size_t k = 0; k < edges.size(); k++){
+      g2o::OptimizableGraph::Edge* e = edges[k];
+      int size = 0;
+      for(g2o::HyperGraph::Vertex* v : e->vertices()){
+        size = std::max(size, e->dimension() * static_cast<g2o::OptimizableGraph::Vertex*>(v)->dimension());
+      }
+      int vertex_num = e->vertices().size();
+      if(size > _workspace_sizes[k] || vertex_num > _workspace_vertex_nums[k]){
+        _workspaces[k].updateSize(e);
+        _workspaces[k].allocate();
+        _workspace_sizes[k] = std::max(size, _workspace_sizes[k]);
+        _workspace_vertex_nums[k] = std::max(vertex_num, _workspace_vertex_nums[k]);
+      }
+    }
+
+    size_t range_num = _thread_pool->RangeNum(edges.size(), 256);
+    _thread_pool->ParallelFor(edges.size(), range_num, [&](size_t t, size_t begin, size_t end){
+      for(size_t k = begin; k < end; k++){
+        edges[k]->linearizeOplus(_workspaces[k]);
+      }
+    });
+
+    // vertices are shared by edges, so their blocks are summed up on one thread
+    for(g2o::OptimizableGraph::Edge* e : edges){
+      e->constructQuadraticForm();
+    }
+
+    for(g2o::OptimizableGraph::Vertex* v : vertices){
+      int base = v->colInHessian();
+      if(v->marginalized()) base += this->_sizePoses;
+      v->copyB(this->_b + base);
+    }
+    return true;
+  }
+
+private:
+  ThreadPool* _thread_pool;
+  std::vector<g2o::JacobianWorkspace> _workspaces;
+  std::vector<int> _workspace_sizes;
+  std::vector<int> _workspace_vertex_nums;
+};
+
+// Levenberg-Marquardt with the damping schedule of g2o::OptimizationAlgorithmLevenberg that computes
+// the errors of the edges on several threads. Chi2 is summed in edge order, so the steps do not depend
+// on the thread number.
+class ParallelLevenberg : public g2o::OptimizationAlgorithmWithHessian{
+public:
+  ParallelLevenberg(std::unique_ptr<g2o::Solver> solver);
+
+  // the pool is not owned, without one the errors are computed on the calling thread
+  void SetThreadPool(ThreadPool* thread_pool){ _thread_pool = thread_pool; }
+
+  virtual SolverResult solve(int iteration, bool online = false);
+  virtual void printVerbose(std::ostream& os) const;
+
+private:
+  // computes the errors of the active edges, returns the robust chi2
+  double ComputeActiveErrors();
+  double ComputeLambdaInit() const;
+  double ComputeScale() const;
+
+private:
+  std::unique_ptr<g2o::Solver> _owned_solver;
+  ThreadPool* _thread_pool;
+  int _max_trials;
+  double _tau;
+  double _good_step_lower_scale;
+  double _good_step_upper_scale;
+  double _current_lambda;
+  double _ni;
+  int _levenberg_iterations;
+};
+
+#endif  // PARALLEL_SOLVER_H_
@@ -16,160 +16,114 @@
 #include "utils.h"
 
 struct Pose3d {
+  int id;
   bool fixed;
   Eigen::Vector3d p;
   Eigen::Quaterniond q;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  Pose3d() {}
-  Pose3d& operator =(Pose3d& other){
-		fixed = other.fixed;
-		p = other.p;
-		q = other.q;
-		return *this;
-	}
 };
-typedef std::map<int, Pose3d, std::less<int>, Eigen::aligned_allocator<std::pair<const int, Pose3d>>> MapOfPoses;
+typedef std::vector<Pose3d, Eigen::aligned_allocator<Pose3d>> VectorOfPoses;
 
 
 struct Position3d{
+  int id;
   bool fixed;
   Eigen::Vector3d p;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+typedef std::vector<Position3d, Eigen::aligned_allocator<Position3d>> VectorOfPoints3d;
+
 
-  Position3d() {}
-  Position3d& operator =(Position3d& other){
-		fixed = other.fixed;
-		p = other.p;
-		return *this;
-	}
+struct Line3d{
+  int id;
+  bool fixed;
+  g2o::Line3D line_3d;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
-typedef std::map<int, Position3d, std::less<int>, Eigen::aligned_allocator<std::pair<const int, Position3d>>> MapOfPoints3d;
+typedef std::vector<Line3d, Eigen::aligned_allocator<Line3d>> VectorOfLine3d;
 
 
+// constraints refer to vertices by their index in the vertex vectors
 struct MonoPointConstraint {
-  int id_pose;
-  int id_point;
-  int id_camera;
+  int pose_index;
+  int point_index;
+  int camera_index;
   bool inlier;
 
   // x_left, y_left
   Eigen::Vector2d keypoint;  
-  double pixel_sigma;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  MonoPointConstraint() {}
-  MonoPointConstraint& operator =(MonoPointConstraint& other){
-		id_pose = other.id_pose;
-		id_point = other.id_point;
-		id_camera = other.id_camera;
-		inlier = other.inlier;
-		keypoint = other.keypoint;
-		pixel_sigma = other.pixel_sigma;
-		return *this;
-	}
 };
-typedef std::shared_ptr<MonoPointConstraint> MonoPointConstraintPtr;
-typedef std::vector<MonoPointConstraintPtr> VectorOfMonoPointConstraints;
+typedef std::vector<MonoPointConstraint, Eigen::aligned_allocator<MonoPointConstraint>> VectorOfMonoPointConstraints;
 
 
 struct StereoPointConstraint {
-  int id_pose;
-  int id_point;
-  int id_camera;
+  int pose_index;
+  int point_index;
+  int camera_index;
   bool inlier;
 
   // x_left, y_left, x_right
   Eigen::Vector3d keypoint;  
-  double pixel_sigma;
-
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  StereoPointConstraint() {}
-  StereoPointConstraint& operator =(StereoPointConstraint& other){
-		id_pose = other.id_pose;
-		id_point = other.id_point;
-		id_camera = other.id_camera;
-		inlier = other.inlier;
-		keypoint = other.keypoint;
-		pixel_sigma = other.pixel_sigma;
-		return *this;
-	}
-};
-typedef std::shared_ptr<StereoPointConstraint> StereoPointConstraintPtr;
-typedef std::vector<StereoPointConstraintPtr> VectorOfStereoPointConstraints;
-
-
-struct Line3d{
-  bool fixed;
-  g2o::Line3D line_3d;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  Line3d() {}
-  Line3d& operator =(Line3d& other){
-		fixed = other.fixed;
-		line_3d = other.line_3d;
-		return *this;
-	}
 };
-typedef std::map<int, Line3d, std::less<int>, Eigen::aligned_allocator<std::pair<const int, Line3d>>> MapOfLine3d;
+typedef std::vector<StereoPointConstraint, Eigen::aligned_allocator<StereoPointConstraint>> VectorOfStereoPointConstraints;
 
 
 struct MonoLineConstraint {
-  int id_pose;
-  int id_line;
-  int id_camera;
+  int pose_index;
+  int line_index;
+  int camera_index;
   bool inlier;
 
   // x_left, y_left
   Eigen::Vector4d line_2d;  
-  double pixel_sigma;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  MonoLineConstraint() {}
-  MonoLineConstraint& operator =(MonoLineConstraint& other){
-		id_pose = other.id_pose;
-		id_line = other.id_line;
-		id_camera = other.id_camera;
-		inlier = other.inlier;
-		line_2d = other.line_2d;
-		pixel_sigma = other.pixel_sigma;
-		return *this;
-	}
 };
-typedef std::shared_ptr<MonoLineConstraint> MonoLineConstraintPtr;
-typedef std::vector<MonoLineConstraintPtr> VectorOfMonoLineConstraints;
+typedef std::vector<MonoLineConstraint, Eigen::aligned_allocator<MonoLineConstraint>> VectorOfMonoLineConstraints;
 
 
 struct StereoLineConstraint {
-  int id_pose;
-  int id_line;
-  int id_camera;
+  int pose_index;
+  int line_index;
+  int camera_index;
   bool inlier;
 
   Vector8d line_2d;  
-  double pixel_sigma;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  StereoLineConstraint() {}
-  StereoLineConstraint& operator =(StereoLineConstraint& other){
-		id_pose = other.id_pose;
-		id_line = other.id_line;
-		id_camera = other.id_camera;
-		inlier = other.inlier;
-		line_2d = other.line_2d;
-		pixel_sigma = other.pixel_sigma;
-		return *this;
-	}
 };
-typedef std::shared_ptr<StereoLineConstraint> StereoLineConstraintPtr;
-typedef std::vector<StereoLineConstraintPtr> VectorOfStereoLineConstraints;
+typedef std::vector<StereoLineConstraint, Eigen::aligned_allocator<StereoLineConstraint>> VectorOfStereoLineConstraints;
+
+
+// Input and output of the local map optimization. Records are flat and vertices are indexed densely.
+// The problem is owned by its builder and cleared instead of freed, so once the vectors have grown
+// to the size of a typical window, building a problem does not allocate.
+struct LocalMapProblem{
+  VectorOfPoses poses;
+  VectorOfPoints3d points;
+  VectorOfLine3d lines;
+  VectorOfMonoPointConstraints mono_point_constraints;
+  VectorOfStereoPointConstraints stereo_point_constraints;
+  VectorOfMonoLineConstraints mono_line_constraints;
+  VectorOfStereoLineConstraints stereo_line_constraints;
+
+  void Clear(){
+    poses.clear();
+    points.clear();
+    lines.clear();
+    mono_point_constraints.clear();
+    stereo_point_constraints.clear();
+    mono_line_constraints.clear();
+    stereo_line_constraints.clear();
+  }
+};
 
 
 #endif  // OPTIMIZATION_3D_TYPES_H_
@@ -39,6 +39,10 @@ class VertexLine3D : public g2o::BaseVertex<4, g2o::Line3D> {
 
   virtual int estimateDimension() const { return 6; }
 
+  // derivative of the Plucker coordinates [w; d] w.r.t. the 4-dof update of oplusImpl at zero. It is
+  // scaled to the current estimate, which is exact for errors invariant to the scale of the line.
+  Eigen::Matrix<double, 6, 4> oplusJacobian() const;
+
   Eigen::Vector3d color;
 };
 
@@ -0,0 +1,54 @@
+#ifndef KLT_TRACKER_H_
+#define KLT_TRACKER_H_
+
+#include <vector>
+#include <map>
+#include <Eigen/Core>
+#include <opencv2/opencv.hpp>
+
+#include "read_configs.h"
+#include "frame.h"
+
+// Tracks the keypoints and line endpoints of a reference keyframe into new images with pyramidal
+// Lucas-Kanade, so non-keyframes can skip feature extraction and matching.
+class KltTracker{
+public:
+  KltTracker(const KltConfig& klt_config);
+
+  // remember a frame with fully extracted features; matches are from ref_keyframe (query) to frame (train)
+  void AddDetectedFrame(FramePtr frame, const cv::Mat& image, FramePtr ref_keyframe,
+      const std::vector<cv::DMatch>& matches);
+
+  // make sure the tracked features belong to ref_keyframe, false if they can't
+  bool SetReference(FramePtr ref_keyframe);
+
+  // build features of a new frame from tracking, matches are from the reference keyframe to the new features
+  int Track(const cv::Mat& image, Eigen::Matrix<double, 259, Eigen::Dynamic>& features,
+      std::vector<Eigen::Vector4d>& lines, std::vector<std::map<int, double>>& points_on_lines,
+      std::vector<cv::DMatch>& matches);
+
+  FramePtr GetReference();
+  void Invalidate();
+
+private:
+  void ResetFromKeyframe();
+
+private:
+  KltConfig _klt_config;
+
+  // last frame with extracted features
+  FramePtr _detected_frame;
+  cv::Mat _detected_image;
+
+  // reference keyframe features located in _image
+  FramePtr _ref_keyframe;
+  cv::Mat _image;
+  std::vector<cv::Point2f> _points;
+  std::vector<int> _point_ids;
+  std::vector<cv::Point2f> _line_endpoints;
+  std::vector<int> _line_ids;
+};
+
+typedef std::shared_ptr<KltTracker> KltTrackerPtr;
+
+#endif  // KLT_TRACKER_H_
@@ -0,0 +1,62 @@
+#ifndef LANDMARK_STORE_H_
+#define LANDMARK_STORE_H_
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <Eigen/Core>
+
+// Columnar storage of mappoint data. Positions, descriptors (float), types and observer numbers of all
+// mappoints live in separate contiguous arrays, and a Mappoint only keeps the slot it owns. Slots are
+// grouped in fixed-size chunks that are never reallocated, so references into a slot stay valid.
+class LandmarkStore{
+public:
+  static const size_t ChunkSize = 4096;
+  static const size_t MaxChunkNum = 4096;   // chunk table is reserved once and never reallocated
+  static const int DescriptorDim = 256;
+
+  struct Chunk{
+    std::vector<Eigen::Vector3d> positions;
+    std::vector<float> descriptors;      // DescriptorDim floats per slot
+    std::vector<uint8_t> types;
+    std::vector<int> obverser_nums;
+
+    Chunk();
+  };
+
+  // shared by all mappoints, like their ids
+  static LandmarkStore& Instance();
+
+  size_t Allocate();
+  void Release(size_t slot);
+
+  Eigen::Vector3d& Position(size_t slot){
+    return _chunks[slot / ChunkSize]->positions[slot % ChunkSize];
+  }
+
+  float* Descriptor(size_t slot){
+    return _chunks[slot / ChunkSize]->descriptors.data() + (slot % ChunkSize) * DescriptorDim;
+  }
+
+  uint8_t& Type(size_t slot){
+    return _chunks[slot / ChunkSize]->types[slot % ChunkSize];
+  }
+
+  int& ObverserNum(size_t slot){
+    return _chunks[slot / ChunkSize]->obverser_nums[slot % ChunkSize];
+  }
+
+  // number of allocated slots, including released ones
+  size_t Capacity();
+
+private:
+  LandmarkStore();
+
+  std::mutex _mutex;
+  std::vector<std::unique_ptr<Chunk>> _chunks;
+  std::vector<size_t> _free_slots;
+  size_t _slot_num;
+};
+
+#endif  // LANDMARK_STORE_H_
@@ -0,0 +1,44 @@
+#ifndef LINE_DISTANCE_H_
+#define LINE_DISTANCE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <Eigen/Core>
+
+// structure-of-arrays point blocks consumed by the distance kernels
+struct PointBlock2f{
+  std::vector<float> x;
+  std::vector<float> y;
+
+  size_t size() const { return x.size(); }
+  void resize(size_t n){ x.resize(n); y.resize(n); }
+  void clear(){ x.clear(); y.clear(); }
+  void push_back(float px, float py){ x.push_back(px); y.push_back(py); }
+};
+
+struct PointBlock3f{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  size_t size() const { return x.size(); }
+  void resize(size_t n){ x.resize(n); y.resize(n); z.resize(n); }
+  void clear(){ x.clear(); y.clear(); z.clear(); }
+  void push_back(float px, float py, float pz){ x.push_back(px); y.push_back(py); z.push_back(pz); }
+};
+
+// line = [x1, y1, x2, y2]. For every point, dist is the distance to the infinite line and inside is 1
+// if the point lies in the bounding box of the segment grown by margin and either projects between
+// the two endpoints or is closer than margin to one of them.
+void PointSegmentDistance2D(const Eigen::Vector4f& line, const float* x, const float* y, size_t n,
+    float margin, float* dist, uint8_t* inside);
+
+// line passes through point with unit direction. dist is the point-line distance and inlier is 1 if
+// dist < thr. Returns the number of inliers.
+size_t PointLineDistance3D(const Eigen::Vector3f& point, const Eigen::Vector3f& direction,
+    const float* x, const float* y, const float* z, size_t n, float thr, float* dist, uint8_t* inlier);
+
+// whether the AVX2 kernels are used on this host
+bool LineDistanceUseAVX2();
+
+#endif  // LINE_DISTANCE_H_
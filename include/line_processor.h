@@ -50,12 +50,14 @@ class LineDetector{
 public:
 	LineDetector(const LineDetectorConfig &line_detector_config);
 	void LineExtractor(const cv::Mat& image, std::vector<Eigen::Vector4d>& lines);
+  void TiledDetect(const cv::Mat& image, std::vector<Eigen::Vector4f>& lines);
   void MergeLines(std::vector<Eigen::Vector4f>& source_lines, std::vector<Eigen::Vector4f>& dst_lines,
       float angle_threshold, float distance_threshold, float endpoint_threshold);
 
 private:
 	LineDetectorConfig _line_detector_config;
 	std::shared_ptr<cv::ximgproc::FastLineDetector> fld;
+  std::vector<std::shared_ptr<cv::ximgproc::FastLineDetector>> tile_flds;
 };
 typedef std::shared_ptr<LineDetector> LineDetectorPtr;
 
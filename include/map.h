@@ -1,6 +1,8 @@
 #ifndef MAP_H_
 #define MAP_H_
 
+#include <atomic>
+#include <set>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "read_configs.h"
@@ -8,45 +10,129 @@
 #include "mappoint.h"
 #include "mapline.h"
 #include "frame.h"
+#include "slot_map.h"
+#include "voxel_index.h"
+#include "covisibility_graph.h"
+#include "thread_pool.h"
 #include "g2o_optimization/types.h"
+#include "g2o_optimization/local_map_optimizer.h"
 #include "ros_publisher.h"
 
 class Map{
 public:
   Map(OptimizationConfig& backend_optimization_config, CameraPtr camera, RosPublisherPtr ros_publisher);
   void InsertKeyframe(FramePtr frame);
-  void InsertMappoint(MappointPtr mappoint);
-  void InsertMapline(MaplinePtr mapline);
-  bool UppdateMapline(MaplinePtr mapline);
-  void UpdateMaplineEndpoints(MaplinePtr mapline);
+  void InsertMappoint(const MappointPtr& mappoint);
+  void InsertMapline(const MaplinePtr& mapline);
+  bool UppdateMapline(const MaplinePtr& mapline);
+  void UpdateMaplineEndpoints(const MaplinePtr& mapline);
 
   FramePtr GetFramePtr(int frame_id);
   MappointPtr GetMappointPtr(int mappoint_id);
   MaplinePtr GetMaplinePtr(int mapline_id);
 
-  bool TriangulateMappoint(MappointPtr mappoint);
-  bool TriangulateMaplineByMappoints(MaplinePtr mapline);
-  bool UpdateMappointDescriptor(MappointPtr mappoint);
+  bool TriangulateMappoint(const MappointPtr& mappoint);
+  bool TriangulateMaplineByMappoints(const MaplinePtr& mapline);
+  bool UpdateMappointDescriptor(const MappointPtr& mappoint);
   void SearchNeighborFrames(FramePtr frame, std::vector<FramePtr>& neighbor_frames);
-  void AddFrameVertex(FramePtr frame, MapOfPoses& poses, bool fix_this_frame);
+
+  // the last sliding_window_size keyframes with frame, keyframes that leave the window are marginalized
+  void SelectSlidingWindow(FramePtr frame, std::vector<FramePtr>& window_frames);
+  void AddFrameVertex(const FramePtr& frame, LocalMapProblem& problem, bool fix_this_frame);
   void LocalMapOptimization(FramePtr new_frame);
+
+  // local BA gives up early while the flag is raised
+  void SetLocalMapOptimizationAbortFlag(const std::atomic<bool>* abort_flag);
   void SaveMap(const std::string& map_root);
-  std::pair<FramePtr, FramePtr> MakeFramePair(FramePtr frame0, FramePtr frame1);
   void RemoveOutliers(const std::vector<std::pair<FramePtr, MappointPtr>>& outliers);
   void RemoveLineOutliers(const std::vector<std::pair<FramePtr, MaplinePtr>>& line_outliers);
-  void UpdateFrameConnection(FramePtr frame);
+
+  // merge mappoints of frame and of its covisible keyframes that are the same physical point,
+  // returns the number of merged mappoints
+  int FuseMappoints(const FramePtr& frame);
+  int FuseByProjection(Frame* frame, const std::vector<MappointPtr>& mappoints);
+  void MergeMappoints(const MappointPtr& kept, const MappointPtr& merged);
+
+  // covisible keyframes of frame whose mappoints are mostly seen by enough other keyframes, the first
+  // keyframe, frame itself, the latest keyframe, pinned keyframes and keyframes in the sliding window
+  // are never redundant. only reads the map
+  void FindRedundantKeyframes(const FramePtr& frame, const KeyframeCullingConfig& config, 
+      const std::set<int>& pinned_keyframe_ids, std::vector<int>& redundant_keyframe_ids);
+
+  // remove the keyframes of keyframe_ids that are still redundant
+  void CullKeyframes(const std::vector<int>& keyframe_ids, const KeyframeCullingConfig& config, 
+      const std::set<int>& pinned_keyframe_ids, std::vector<int>& culled_keyframe_ids);
+  void RemoveKeyframe(const FramePtr& frame);
   void PrintConnection();
+
+  // observation changes go through the map so that covisibility weights stay exact
+  void AddMappointObverser(const MappointPtr& mappoint, int frame_id, int keypoint_index);
+  void RemoveMappointObverser(const MappointPtr& mappoint, int frame_id);
+  void SetMappointBad(const MappointPtr& mappoint);
+  void SetMaplineBad(const MaplinePtr& mapline);
+
+  // erase landmarks that went bad in an earlier epoch (keyframe insertion) from the map and the slots
+  // of their keyframes, returns the number of reclaimed mappoints and maplines
+  int CollectGarbage();
+
+  // (weight, keyframe) of the strongest covisible keyframes, strongest first
+  void GetCovisibleKeyframes(int frame_id, std::vector<std::pair<int, FramePtr>>& covisible_keyframes);
+  int GetCovisibilityWeight(int frame_id0, int frame_id1);
   void SearchByProjection(FramePtr frame, std::vector<MappointPtr>& mappoints, 
       int thr, std::vector<std::pair<int, MappointPtr>>& good_projections);
+
+  // spatial queries over valid mappoints, results are sorted by id
+  void GetMappointsInRadius(const Eigen::Vector3d& center, double radius, std::vector<MappointPtr>& mappoints);
+  void GetMappointsInFrustum(const Eigen::Matrix4d& Twc, double max_depth, std::vector<MappointPtr>& mappoints);
   void SaveKeyframeTrajectory(std::string save_root);
 
+private:
+  template<typename LandmarkPtr>
+  struct RetiredLandmark{
+    int epoch;
+    LandmarkPtr landmark;
+    ObservationList obversers;   // keyframe slots that may still hold the landmark
+
+    RetiredLandmark(int epoch_, const LandmarkPtr& landmark_, const ObservationList& obversers_): 
+        epoch(epoch_), landmark(landmark_), obversers(obversers_) {}
+  };
+
+  // borrowed pointer for hot loops, the keyframe is kept alive by _keyframes
+  Frame* FindKeyframe(int frame_id);
+
+  bool IsRedundantKeyframe(const FramePtr& kf, const KeyframeCullingConfig& config, 
+      const std::set<int>& pinned_keyframe_ids);
+
+  // add the landmarks in [begin, end) and their observations by the frames of the local map optimization
+  // of frame_id to problem, a landmark needs a stereo or two mono observations. the vertices are indexed
+  // within problem, the poses by Frame::local_map_optimization_index. safe to run on disjoint ranges in parallel
+  void AddPointConstraints(const std::vector<Mappoint*>& mappoints, size_t begin, size_t end, 
+      int frame_id, LocalMapProblem& problem);
+  void AddLineConstraints(const std::vector<Mapline*>& maplines, size_t begin, size_t end, 
+      int frame_id, LocalMapProblem& problem);
+
+  // keep _mappoint_index in sync after the position or type of a mappoint changed
+  void UpdateMappointIndex(const MappointPtr& mappoint);
+
 private:
   OptimizationConfig _backend_optimization_config;
   CameraPtr _camera;
-  std::map<int, MappointPtr> _mappoints;
-  std::map<int, MaplinePtr> _maplines;
-  std::map<int, FramePtr> _keyframes;
+  SlotMap<MappointPtr> _mappoints;
+  SlotMap<MaplinePtr> _maplines;
+  SlotMap<FramePtr> _keyframes;
+  VoxelIndex _mappoint_index;
+  CovisibilityGraph _covisibility_graph;
+  int _epoch;
+  std::vector<RetiredLandmark<MappointPtr>> _retired_mappoints;
+  std::vector<RetiredLandmark<MaplinePtr>> _retired_maplines;
   std::vector<int> _keyframe_ids;
+  LocalMapProblem _local_map_problem;
+  std::vector<LocalMapProblem> _local_map_problem_buffers;    // per thread, appended to _local_map_problem
+  std::vector<Mappoint*> _local_map_mappoints;
+  std::vector<Mapline*> _local_map_maplines;
+  std::vector<int> _sliding_window_frame_ids;                 // oldest first
+  LocalMapOptimizerPtr _local_map_optimizer;
+  ThreadPoolPtr _thread_pool;                                 // backend thread_num workers
   RosPublisherPtr _ros_publisher;
 };
 
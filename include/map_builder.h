@@ -3,6 +3,8 @@
 
 #include <iostream>
 #include <chrono>
+#include <atomic>
+#include <map>
 #include <opencv2/opencv.hpp>
 #include <Eigen/Core>
 
@@ -14,6 +16,9 @@
 #include "frame.h"
 #include "point_matching.h"
 #include "line_processor.h"
+#include "klt_tracker.h"
+#include "pose_solver.h"
+#include "pnp_solver.h"
 #include "map.h"
 #include "ros_publisher.h"
 #include "g2o_optimization/types.h"
@@ -41,11 +46,24 @@ public:
   void AddInput(InputDataPtr data);
   void ExtractFeatureThread();
   void TrackingThread();
+  void KeyframeCullingThread();
+
+  // unpins the reference keyframe of a frame the tracking thread is done with
+  void ReleaseTrackingData(const TrackingDataPtr& tracking_data);
+
+  // pinned keyframes are not culled, _culling_mutex has to be held
+  void PinKeyframe(int frame_id);
+  void UnpinKeyframe(int frame_id);
 
   void ExtractFeatrue(const cv::Mat& image, Eigen::Matrix<double, 259, Eigen::Dynamic>& points, std::vector<Eigen::Vector4d>& lines);
   void ExtractFeatureAndMatch(const cv::Mat& image, const Eigen::Matrix<double, 259, Eigen::Dynamic>& points0, 
       Eigen::Matrix<double, 259, Eigen::Dynamic>& points1, std::vector<Eigen::Vector4d>& lines, std::vector<cv::DMatch>& matches);
   bool Init(FramePtr frame, cv::Mat& image_left, cv::Mat& image_right);
+  bool TrackByKlt(FramePtr ref_keyframe, const cv::Mat& image, FramePtr frame, std::vector<cv::DMatch>& matches);
+
+  // the same frame with extracted features, tracked against the last keyframe, for a frame tracked by
+  // optical flow that has to become a keyframe. nullptr if it does not track well
+  FramePtr DetectKltFrame(FramePtr frame, const cv::Mat& image);
   int TrackFrame(FramePtr frame0, FramePtr frame1, std::vector<cv::DMatch>& matches);
 
   // pose_init = 0 : opencv pnp, pose_init = 1 : last frame pose, pose_init = 2 : original pose
@@ -80,15 +98,34 @@ private:
   std::queue<TrackingDataPtr> _tracking_data_buffer;
   std::thread _tracking_thread;
 
+  // keyframe culling thread, _culling_mutex also guards the pins and _last_keyframe
+  std::mutex _culling_mutex;
+  std::queue<FramePtr> _culling_buffer;
+  std::thread _culling_thread;
+  std::map<int, int> _pinned_keyframes;         // frame id -> pin count
+  std::vector<int> _redundant_keyframe_ids;     // found by the culling thread, removed by the tracking thread
+  FramePtr _klt_reference_keyframe;             // keyframe the feature thread tracks from
+
+  // the tracking thread is the only one that changes the map, and holds this while it does. the keyframe
+  // culling thread holds it while reading the map
+  std::mutex _map_mutex;
+
   // gpu mutex
   std::mutex _gpu_mutex;
 
+  // set by tracking thread when the next frame needs full feature extraction
+  std::atomic<bool> _klt_detection_request;
+
+  // set by feature thread while the tracking queue is full, local BA stops early to catch up
+  std::atomic<bool> _abort_local_map_optimization;
+
   bool _shutdown;
 
   // tmp 
   bool _init;
   int _track_id;
   int _line_track_id;
+  int _reclaimed_landmark_num;
   FramePtr _last_frame;
   FramePtr _last_keyframe;
   int _num_since_last_keyframe;
@@ -101,17 +138,23 @@ private:
   Pose3d _last_pose; 
 
   // for tracking local map
-  bool _to_update_local_map;
+  std::atomic<bool> _to_update_local_map;
   FramePtr _ref_keyframe;
   std::vector<MappointPtr> _local_mappoints;
   std::vector<FramePtr> _local_keyframes;
 
+  // observation index -> mappoint index of the last pose optimization
+  std::vector<size_t> _pose_observation_indexes;
+
   // class
   Configs _configs;
   CameraPtr _camera;
   SuperPointPtr _superpoint;
   PointMatchingPtr _point_matching;
   LineDetectorPtr _line_detector;
+  KltTrackerPtr _klt_tracker;
+  PoseSolverPtr _pose_solver;
+  PnpSolverPtr _pnp_solver;
   RosPublisherPtr _ros_publisher;
   MapPtr _map;
 };
@@ -14,6 +14,7 @@
 #include <g2o/types/slam3d_addons/types_slam3d_addons.h>
 
 #include "utils.h"
+#include "observation_list.h"
 
 
 class Mapline{
@@ -49,15 +50,16 @@ public:
   void AddObverser(const int& frame_id, const int& line_index);
   void RemoveObverser(const int& frame_id);
   int ObverserNum();
-  const std::map<int, int>& GetAllObversers();
+  const ObservationList& GetAllObversers();
   int GetLineIdx(int frame_id);
 
   void SetObverserEndpointStatus(int frame_id, int status = 1);
   int GetObverserEndpointStatus(int frame_id);
-  const std::map<int, int>& GetAllObverserEndpointStatus();
+  const ObservationList& GetAllObverserEndpointStatus();
 
 public:
   int local_map_optimization_frame_id;
+  int local_map_marginalization_frame_id;    // observations up to this keyframe are in the sliding window prior
 
 private:
   int _id;
@@ -66,8 +68,8 @@ private:
   bool _endpoints_valid;
   Vector6d _endpoints;
   Line3DPtr _line_3d;
-  std::map<int, int> _obversers;  // frame_id - line_index 
-  std::map<int, int> _included_endpoints;
+  ObservationList _obversers;  // frame_id - line_index 
+  ObservationList _included_endpoints;
 };
 
 typedef std::shared_ptr<Mapline> MaplinePtr;
@@ -10,7 +10,10 @@
 #include <Eigen/Dense>
 #include <Eigen/SparseCore>
 
+#include "observation_list.h"
+#include "landmark_store.h"
 
+// position, descriptor, type and observer number are kept in LandmarkStore
 class Mappoint{
 public:
   enum Type {
@@ -23,6 +26,9 @@ public:
   Mappoint(int& mappoint_id);
   Mappoint(int& mappoint_id, Eigen::Vector3d& p);
   Mappoint(int& mappoint_id, Eigen::Vector3d& p, Eigen::Matrix<double, 256, 1>& d);
+  ~Mappoint();
+  Mappoint(const Mappoint&) = delete;
+  Mappoint& operator=(const Mappoint&) = delete;
   void SetId(int id);
   int GetId();
   void SetType(Type& type);
@@ -35,25 +41,26 @@ public:
   void SetPosition(Eigen::Vector3d& p);
   Eigen::Vector3d& GetPosition();
   void SetDescriptor(const Eigen::Matrix<double, 256, 1>& descriptor);
-  Eigen::Matrix<double, 256, 1>& GetDescriptor(); 
+  const float* GetDescriptor(); 
 
   void AddObverser(const int& frame_id, const int& keypoint_index);
   void RemoveObverser(const int& frame_id);
   int ObverserNum();
-  std::map<int, int>& GetAllObversers();
+  const ObservationList& GetAllObversers();
   int GetKeypointIdx(int frame_id);
+  size_t GetStoreSlot();
 
 public:
   int tracking_frame_id;
   int last_frame_seen;
   int local_map_optimization_frame_id;
+  int local_map_marginalization_frame_id;    // observations up to this keyframe are in the sliding window prior
+  int fuse_frame_id;
 
 private:
   int _id;
-  Type _type;
-  Eigen::Vector3d _position;
-  Eigen::Matrix<double, 256, 1> _descriptor;
-  std::map<int, int> _obversers;  // frame_id - keypoint_index 
+  size_t _slot;
+  ObservationList _obversers;  // frame_id - keypoint_index 
 };
 
 typedef std::shared_ptr<Mappoint> MappointPtr;
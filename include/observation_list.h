@@ -0,0 +1,106 @@
+#ifndef OBSERVATION_LIST_H_
+#define OBSERVATION_LIST_H_
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+// frame_id -> index pairs kept sorted by frame id. Landmarks are usually seen by only a few keyframes,
+// so the first InlineCapacity entries live inside the object and no node is allocated per observation.
+// Iteration yields std::pair<int, int> with first = frame_id and second = index, like std::map.
+class ObservationList{
+public:
+  typedef std::pair<int, int> value_type;
+  typedef const value_type* const_iterator;
+  static const size_t InlineCapacity = 8;
+
+  ObservationList(): _size(0) {}
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + _size; }
+  const value_type& front() const { return data()[0]; }
+
+  size_t count(int frame_id) const {
+    return Find(frame_id) ? 1 : 0;
+  }
+
+  // returns default_value if frame_id is not in the list
+  int get(int frame_id, int default_value = -1) const {
+    const value_type* it = Find(frame_id);
+    return it ? it->second : default_value;
+  }
+
+  // throws std::out_of_range if frame_id is not in the list
+  int at(int frame_id) const {
+    const value_type* it = Find(frame_id);
+    if(!it) throw std::out_of_range("ObservationList::at");
+    return it->second;
+  }
+
+  void set(int frame_id, int value){
+    value_type* first = data();
+    value_type* it = LowerBound(frame_id);
+    if(it != first + _size && it->first == frame_id){
+      it->second = value;
+      return;
+    }
+
+    size_t pos = it - first;
+    if(_size < InlineCapacity && _heap.empty()){
+      std::copy_backward(_inline + pos, _inline + _size, _inline + _size + 1);
+      _inline[pos] = value_type(frame_id, value);
+    }else{
+      if(_heap.empty()){
+        _heap.reserve(2 * InlineCapacity);
+        _heap.assign(_inline, _inline + _size);
+      }
+      _heap.insert(_heap.begin() + pos, value_type(frame_id, value));
+    }
+    _size++;
+  }
+
+  bool erase(int frame_id){
+    value_type* first = data();
+    value_type* it = LowerBound(frame_id);
+    if(it == first + _size || it->first != frame_id) return false;
+
+    if(_heap.empty()){
+      std::copy(it + 1, first + _size, it);
+    }else{
+      _heap.erase(_heap.begin() + (it - first));
+    }
+    _size--;
+    return true;
+  }
+
+  void clear(){
+    _size = 0;
+    std::vector<value_type>().swap(_heap);
+  }
+
+private:
+  value_type* data(){ return _heap.empty() ? _inline : _heap.data(); }
+  const value_type* data() const { return _heap.empty() ? _inline : _heap.data(); }
+
+  value_type* LowerBound(int frame_id){
+    return std::lower_bound(data(), data() + _size, frame_id,
+        [](const value_type& kv, int id){ return kv.first < id; });
+  }
+
+  const value_type* Find(int frame_id) const {
+    const value_type* last = data() + _size;
+    const value_type* it = std::lower_bound(data(), last, frame_id,
+        [](const value_type& kv, int id){ return kv.first < id; });
+    return (it != last && it->first == frame_id) ? it : nullptr;
+  }
+
+private:
+  value_type _inline[InlineCapacity];
+  std::vector<value_type> _heap;
+  size_t _size;
+};
+
+#endif  // OBSERVATION_LIST_H_
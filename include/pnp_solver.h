@@ -0,0 +1,67 @@
+#ifndef PNP_SOLVER_H_
+#define PNP_SOLVER_H_
+
+#include <stdint.h>
+#include <memory>
+#include <random>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+#include "camera.h"
+#include "frame.h"
+#include "mappoint.h"
+
+// RANSAC pose initialization for frame tracking. Hypotheses come from P3P on three bearings or, for
+// keypoints with stereo depth, from aligning three triangulated points to their mappoints. The
+// motion prior is scored first, the number of iterations adapts to the best inlier ratio, and a
+// hypothesis is dropped as soon as it can no longer beat the best one. Like cv::solvePnPRansac, the
+// best hypothesis is refined on its inliers. Buffers are reused between frames.
+class PnpSolver{
+public:
+  PnpSolver();
+
+  void SetCamera(const CameraPtr& camera);
+
+  // keypoint i of frame is matched to mappoints[i]. Twc is the motion prior on input and the refined
+  // best hypothesis on output, inliers[i] is the id of mappoints[i] or -1. returns the number of inliers
+  int Solve(const FramePtr& frame, const std::vector<MappointPtr>& mappoints,
+      Eigen::Matrix4d& Twc, std::vector<int>& inliers);
+
+private:
+  // up to 4 Tcw from P3P on correspondences i0, i1, i2, returns the number of solutions
+  int SolveP3P(int i0, int i1, int i2, Eigen::Matrix4d* solutions);
+
+  // Tcw from the stereo points of correspondences i0, i1, i2
+  bool SolveStereo(int i0, int i1, int i2, Eigen::Matrix4d& solution);
+
+  // a few Gauss-Newton steps on the reprojection error of the inliers in _best_inlier
+  void Refine(Eigen::Matrix4d& Tcw);
+
+  // counts the inliers of Tcw in _order, gives up once best_num can not be beaten anymore.
+  // the inlier flags are written to _inlier
+  int Score(const Eigen::Matrix4d& Tcw, int best_num);
+
+private:
+  double _fx, _fy, _cx, _cy, _bf;
+  double _reprojection_thr;
+  double _confidence;
+  int _max_iterations;
+  std::mt19937 _random_engine;
+
+  // correspondences
+  std::vector<int> _indexes;                     // index into mappoints
+  std::vector<Eigen::Vector3d> _points;          // world frame
+  std::vector<Eigen::Vector3d> _bearings;        // unit bearing in camera frame
+  std::vector<Eigen::Vector3d> _stereo_points;   // camera frame, only valid for stereo keypoints
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d>> _keypoints;
+  std::vector<int> _stereo_indexes;              // correspondences with stereo depth
+  std::vector<int> _order;                       // shuffled correspondences for scoring
+  std::vector<uint8_t> _inlier;
+  std::vector<uint8_t> _best_inlier;
+};
+
+typedef std::shared_ptr<PnpSolver> PnpSolverPtr;
+
+#endif  // PNP_SOLVER_H_
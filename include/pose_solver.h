@@ -0,0 +1,65 @@
+#ifndef POSE_SOLVER_H_
+#define POSE_SOLVER_H_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "read_configs.h"
+#include "camera.h"
+
+// Pose-only optimization for frame tracking. Mono and stereo point observations are kept in
+// structure-of-arrays buffers that are reused between frames, so solving a frame does not allocate
+// once the buffers have grown. It runs the same scheme as the g2o frame optimization: four rounds of
+// Levenberg-Marquardt from the initial pose, Huber kernels in the first three rounds, and chi2 outlier
+// rejection after each round.
+class PoseSolver{
+public:
+  PoseSolver();
+
+  void Clear();
+  void SetCamera(const CameraPtr& camera);
+
+  // point is in world frame, keypoint is (u, v) or (u, v, u_right)
+  void AddMonoObservation(const Eigen::Vector3d& point, const Eigen::Vector2d& keypoint);
+  void AddStereoObservation(const Eigen::Vector3d& point, const Eigen::Vector3d& keypoint);
+
+  // Twc is refined in place, returns the number of inliers
+  int Solve(Eigen::Matrix4d& Twc, const OptimizationConfig& cfg);
+
+  // observation index in the order of Add*Observation
+  bool IsInlier(size_t i) const { return _inlier[i]; }
+  size_t Size() const { return _x.size(); }
+
+private:
+  // fills the residual and jacobian rows at Tcw = (q, t), returns the (robust) chi2 of the inliers
+  double Linearize(const Eigen::Quaterniond& q, const Eigen::Vector3d& t, bool robust);
+
+  // fills _chi2 of all observations at Tcw = (q, t), returns the (robust) chi2 of the inliers
+  double ComputeChi2(const Eigen::Quaterniond& q, const Eigen::Vector3d& t, bool robust);
+
+  void BuildSystem(Eigen::Matrix<double, 6, 6>& H, Eigen::Matrix<double, 6, 1>& b);
+  void Optimize(Eigen::Quaterniond& q, Eigen::Vector3d& t, int iterations, bool robust);
+
+private:
+  double _fx, _fy, _cx, _cy, _bf;
+
+  // observations
+  std::vector<double> _x, _y, _z;
+  std::vector<double> _u, _v, _ur;
+  std::vector<double> _stereo;      // 1 for stereo observations, 0 for mono
+  std::vector<double> _chi2_thr;
+  std::vector<uint8_t> _inlier;
+
+  // per round scratch, residual rows are laid out as [u rows | v rows | ur rows]
+  std::vector<double> _chi2;
+  std::vector<double> _residual;
+  std::vector<double> _weight;
+  std::vector<double> _jacobian[6];
+};
+
+typedef std::shared_ptr<PoseSolver> PoseSolverPtr;
+
+#endif  // POSE_SOLVER_H_
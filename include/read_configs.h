@@ -37,6 +37,22 @@ struct LineDetectorConfig{
   float angle_thr;
   float distance_thr;
   float ep_thr;
+  int tile_num;
+  int tile_overlap;
+};
+
+struct KltConfig {
+  int enable;
+  int min_tracked_points;
+  int window_size;
+  int pyramid_levels;
+  float fb_threshold;
+};
+
+struct KeyframeCullingConfig {
+  int enable;
+  double redundant_ratio;
+  int min_obverser_num;
 };
 
 struct KeyframeConfig {
@@ -53,6 +69,19 @@ struct OptimizationConfig{
   double mono_line;
   double stereo_line;
   double rate;
+
+  // backend only, local BA stops after max_time ms or when an iteration lowers chi2 by less than
+  // min_chi2_decrease (relative), 0 disables either
+  double max_time = 0;
+  double min_chi2_decrease = 0;
+
+  // backend only, threads that build and solve local BA, the calling thread is one of them
+  int thread_num = 1;
+
+  // backend only, keyframes kept in a fixed-lag smoother whose older keyframes are marginalized,
+  // 0 optimizes the covisible keyframes instead. a landmark is fixed once its first observer has
+  // been marginalized, newer observations only refine the poses, as an approximation
+  int sliding_window_size = 0;
 };
 
 struct RosPublisherConfig{
@@ -79,7 +108,9 @@ struct Configs{
   SuperPointConfig superpoint_config;
   SuperGlueConfig superglue_config;
   LineDetectorConfig line_detector_config;
+  KltConfig klt_config;
   KeyframeConfig keyframe_config;
+  KeyframeCullingConfig keyframe_culling_config;
   OptimizationConfig tracking_optimization_config;
   OptimizationConfig backend_optimization_config;
   RosPublisherConfig ros_publisher_config;
@@ -141,6 +172,15 @@ struct Configs{
     line_detector_config.angle_thr = line_detector_node["angle_thr"].as<float>();
     line_detector_config.distance_thr = line_detector_node["distance_thr"].as<float>();
     line_detector_config.ep_thr = line_detector_node["ep_thr"].as<float>();
+    line_detector_config.tile_num = line_detector_node["tile_num"].as<int>();
+    line_detector_config.tile_overlap = line_detector_node["tile_overlap"].as<int>();
+
+    YAML::Node klt_node = file_node["klt"];
+    klt_config.enable = klt_node["enable"].as<int>();
+    klt_config.min_tracked_points = klt_node["min_tracked_points"].as<int>();
+    klt_config.window_size = klt_node["window_size"].as<int>();
+    klt_config.pyramid_levels = klt_node["pyramid_levels"].as<int>();
+    klt_config.fb_threshold = klt_node["fb_threshold"].as<float>();
 
     YAML::Node keyframe_node = file_node["keyframe"];
     keyframe_config.min_num_match = keyframe_node["min_num_match"].as<int>();
@@ -149,6 +189,11 @@ struct Configs{
     keyframe_config.max_angle = keyframe_node["max_angle"].as<double>();
     keyframe_config.max_num_passed_frame = keyframe_node["max_num_passed_frame"].as<int>();
 
+    YAML::Node keyframe_culling_node = file_node["keyframe_culling"];
+    keyframe_culling_config.enable = keyframe_culling_node["enable"].as<int>();
+    keyframe_culling_config.redundant_ratio = keyframe_culling_node["redundant_ratio"].as<double>();
+    keyframe_culling_config.min_obverser_num = keyframe_culling_node["min_obverser_num"].as<int>();
+
     YAML::Node tracking_optimization_node = file_node["optimization"]["tracking"];
     tracking_optimization_config.mono_point = tracking_optimization_node["mono_point"].as<double>();
     tracking_optimization_config.stereo_point = tracking_optimization_node["stereo_point"].as<double>();
@@ -162,6 +207,10 @@ struct Configs{
     backend_optimization_config.mono_line = backend_optimization_node["mono_line"].as<double>();
     backend_optimization_config.stereo_line = backend_optimization_node["stereo_line"].as<double>();
     backend_optimization_config.rate = backend_optimization_node["rate"].as<double>();
+    backend_optimization_config.max_time = backend_optimization_node["max_time"].as<double>();
+    backend_optimization_config.min_chi2_decrease = backend_optimization_node["min_chi2_decrease"].as<double>();
+    backend_optimization_config.thread_num = backend_optimization_node["thread_num"].as<int>();
+    backend_optimization_config.sliding_window_size = backend_optimization_node["sliding_window_size"].as<int>();
 
     YAML::Node ros_publisher_node = file_node["ros_publisher"];
     ros_publisher_config.feature = ros_publisher_node["feature"].as<int>();
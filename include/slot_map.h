@@ -0,0 +1,127 @@
+#ifndef SLOT_MAP_H_
+#define SLOT_MAP_H_
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+
+// Container for map elements whose ids are handed out monotonically (frame index, track id, line
+// track id). Elements live in a vector indexed by id, so lookups are O(1) and iteration visits ids
+// in increasing order like std::map. Every erase bumps the generation of the slot, which lets
+// holders of an (id, generation) pair detect that the element has been removed.
+template<typename T>
+class SlotMap{
+public:
+  typedef std::pair<int, T> value_type;
+
+  struct Slot{
+    value_type entry;
+    uint32_t generation;
+    bool occupied;
+
+    Slot(): entry(-1, T()), generation(0), occupied(false) {}
+  };
+
+  template<typename SlotIterator, typename Value>
+  class Iterator{
+  public:
+    Iterator(SlotIterator it, SlotIterator end): _it(it), _end(end){
+      SkipEmpty();
+    }
+
+    Value& operator*() const { return _it->entry; }
+    Value* operator->() const { return &(_it->entry); }
+    Iterator& operator++(){
+      ++_it;
+      SkipEmpty();
+      return *this;
+    }
+    bool operator==(const Iterator& other) const { return _it == other._it; }
+    bool operator!=(const Iterator& other) const { return _it != other._it; }
+
+  private:
+    void SkipEmpty(){
+      while(_it != _end && !_it->occupied) ++_it;
+    }
+
+    SlotIterator _it;
+    SlotIterator _end;
+  };
+
+  typedef Iterator<typename std::vector<Slot>::iterator, value_type> iterator;
+  typedef Iterator<typename std::vector<Slot>::const_iterator, const value_type> const_iterator;
+
+  SlotMap(): _size(0) {}
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  size_t count(int id) const {
+    return (id >= 0 && id < (int)_slots.size() && _slots[id].occupied) ? 1 : 0;
+  }
+
+  // returns T() if id is not in the container
+  T get(int id) const {
+    return count(id) ? _slots[id].entry.second : T();
+  }
+
+  // returns nullptr if id is not in the container
+  T* find(int id){
+    return count(id) ? &(_slots[id].entry.second) : nullptr;
+  }
+
+  const T* find(int id) const {
+    return count(id) ? &(_slots[id].entry.second) : nullptr;
+  }
+
+  // inserts a default value if id is not in the container, id must be non-negative
+  T& operator[](int id){
+    if(id >= (int)_slots.size()){
+      size_t new_size = _slots.size() < 16 ? 16 : _slots.size();
+      while((int)new_size <= id) new_size *= 2;
+      _slots.resize(new_size);
+    }
+    Slot& slot = _slots[id];
+    if(!slot.occupied){
+      slot.occupied = true;
+      slot.entry.first = id;
+      _size++;
+    }
+    return slot.entry.second;
+  }
+
+  void insert(int id, const T& value){
+    (*this)[id] = value;
+  }
+
+  bool erase(int id){
+    if(!count(id)) return false;
+    Slot& slot = _slots[id];
+    slot.occupied = false;
+    slot.entry.second = T();
+    slot.generation++;
+    _size--;
+    return true;
+  }
+
+  // number of times id has been erased
+  uint32_t generation(int id) const {
+    return (id >= 0 && id < (int)_slots.size()) ? _slots[id].generation : 0;
+  }
+
+  void clear(){
+    _slots.clear();
+    _size = 0;
+  }
+
+  iterator begin(){ return iterator(_slots.begin(), _slots.end()); }
+  iterator end(){ return iterator(_slots.end(), _slots.end()); }
+  const_iterator begin() const { return const_iterator(_slots.begin(), _slots.end()); }
+  const_iterator end() const { return const_iterator(_slots.end(), _slots.end()); }
+
+private:
+  std::vector<Slot> _slots;
+  size_t _size;
+};
+
+#endif  // SLOT_MAP_H_
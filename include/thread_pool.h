@@ -0,0 +1,78 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent workers for data parallel loops of the backend. ParallelFor splits [0, size) into
+// contiguous ranges and runs them on the workers and the calling thread, results that are merged by
+// range index do not depend on the thread number. One loop runs at a time, a loop started while
+// another one runs (from another thread or from inside a range) runs on the calling thread.
+class ThreadPool{
+public:
+  // thread_num includes the calling thread, 1 runs everything on the calling thread
+  explicit ThreadPool(int thread_num);
+  ~ThreadPool();
+
+  int ThreadNum() const { return _thread_num; }
+
+  // ranges for size items, ranges smaller than min_size_per_range are not worth a thread
+  size_t RangeNum(size_t size, size_t min_size_per_range) const {
+    return std::max((size_t)1, std::min((size_t)_thread_num, size / std::max(min_size_per_range, (size_t)1)));
+  }
+
+  // calls function(range_index, begin, end) for range_num contiguous ranges of [0, size) and returns
+  // once all of them are done
+  template<typename Function>
+  void ParallelFor(size_t size, size_t range_num, Function function){
+    range_num = std::max(range_num, (size_t)1);
+    if(range_num == 1){
+      function((size_t)0, (size_t)0, size);
+      return;
+    }
+
+    size_t range = (size + range_num - 1) / range_num;
+    Run(range_num, [&](size_t t){
+      size_t begin = std::min(t * range, size);
+      size_t end = std::min(begin + range, size);
+      function(t, begin, end);
+    });
+  }
+
+private:
+  struct Job{
+    std::function<void(size_t)> task;
+    size_t range_num;
+    std::atomic<size_t> next_range;
+    std::atomic<size_t> done_num;
+  };
+
+  void Run(size_t range_num, const std::function<void(size_t)>& task);
+
+  // runs ranges of job until none is left, returns true if this call finished the last one
+  bool Work(Job& job);
+  void WorkerLoop();
+
+private:
+  int _thread_num;
+  std::vector<std::thread> _workers;
+
+  std::mutex _run_mutex;          // held by the running loop
+  std::mutex _mutex;
+  std::condition_variable _job_cond;
+  std::condition_variable _done_cond;
+  std::shared_ptr<Job> _job;
+  size_t _job_generation;
+  bool _stop;
+};
+
+typedef std::shared_ptr<ThreadPool> ThreadPoolPtr;
+
+#endif  // THREAD_POOL_H_
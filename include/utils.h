@@ -75,6 +75,7 @@ using AlignedUnorderedSet =
 
 void ConvertVectorToRt(Eigen::Matrix<double, 7, 1>& m, Eigen::Matrix3d& R, Eigen::Vector3d& t);
 double DescriptorDistance(const Eigen::Matrix<double, 256, 1>& f1, const Eigen::Matrix<double, 256, 1>& f2);
+double DescriptorDistance(const float* f1, const double* f2);
 cv::Scalar GenerateColor(int id);
 void GenerateColor(int id, Eigen::Vector3d color);
 cv::Mat DrawFeatures(const cv::Mat& image, const std::vector<cv::KeyPoint>& keypoints, 
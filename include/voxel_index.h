@@ -0,0 +1,54 @@
+#ifndef VOXEL_INDEX_H_
+#define VOXEL_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <Eigen/Core>
+
+#include "camera.h"
+#include "slot_map.h"
+
+// Spatial hash of mappoint positions. The world is split into cubic voxels of voxel_size meters and every
+// voxel keeps the ids of the points inside it, so queries only visit voxels overlapping the query volume.
+class VoxelIndex{
+public:
+  VoxelIndex(double voxel_size);
+
+  // insert a new point or move an existing one
+  void Update(int id, const Eigen::Vector3d& position);
+  void Remove(int id);
+  void Clear();
+  size_t Size();
+
+  // ids of points closer than radius to center
+  void RadiusQuery(const Eigen::Vector3d& center, double radius, std::vector<int>& ids);
+
+  // ids of points in front of the camera at pose Twc, with depth in [min_depth, max_depth] and
+  // projecting inside the image
+  void FrustumQuery(const Eigen::Matrix4d& Twc, CameraPtr camera, double min_depth, double max_depth, 
+      std::vector<int>& ids);
+
+private:
+  struct Entry{
+    int64_t key;
+    Eigen::Vector3d position;
+
+    Entry(): key(0), position(Eigen::Vector3d::Zero()) {}
+  };
+
+  Eigen::Vector3i VoxelCoordinate(const Eigen::Vector3d& p);
+  int64_t VoxelKey(const Eigen::Vector3i& v);
+
+  // calls visit(ids) for every occupied voxel overlapping the box [min_corner, max_corner]
+  template<typename Function>
+  void VisitBox(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner, Function visit);
+
+private:
+  double _voxel_size;
+  double _voxel_size_inv;
+  std::unordered_map<int64_t, std::vector<int>> _voxels;
+  SlotMap<Entry> _entries;
+};
+
+#endif  // VOXEL_INDEX_H_
@@ -0,0 +1,66 @@
+#include "covisibility_graph.h"
+
+#include <algorithm>
+#include <functional>
+
+CovisibilityGraph::CovisibilityGraph(int min_weight): _min_weight(min_weight){
+}
+
+void CovisibilityGraph::AddToWeight(int frame_id, int neighbor_id, int delta){
+  Node& node = _nodes[frame_id];
+  int weight = node.weights.get(neighbor_id, 0) + delta;
+  if(weight > 0){
+    node.weights.set(neighbor_id, weight);
+  }else{
+    node.weights.erase(neighbor_id);
+  }
+  node.ordered_valid = false;
+}
+
+void CovisibilityGraph::ChangeWeight(int frame_id0, int frame_id1, int delta){
+  if(frame_id0 == frame_id1 || delta == 0) return;
+  AddToWeight(frame_id0, frame_id1, delta);
+  AddToWeight(frame_id1, frame_id0, delta);
+}
+
+int CovisibilityGraph::GetWeight(int frame_id0, int frame_id1){
+  const Node* node = _nodes.find(frame_id0);
+  return node ? node->weights.get(frame_id1, 0) : 0;
+}
+
+void CovisibilityGraph::RemoveFrame(int frame_id){
+  Node* node = _nodes.find(frame_id);
+  if(!node) return;
+  for(auto& kv : node->weights){
+    Node* neighbor = _nodes.find(kv.first);
+    if(!neighbor) continue;
+    neighbor->weights.erase(frame_id);
+    neighbor->ordered_valid = false;
+  }
+  _nodes.erase(frame_id);
+}
+
+const ObservationList& CovisibilityGraph::GetNeighbors(int frame_id){
+  const Node* node = _nodes.find(frame_id);
+  return node ? node->weights : _empty_neighbors;
+}
+
+const std::vector<std::pair<int, int>>& CovisibilityGraph::GetOrderedNeighbors(int frame_id){
+  Node* node = _nodes.find(frame_id);
+  if(!node) return _empty_ordered;
+  if(node->ordered_valid) return node->ordered;
+
+  node->ordered.clear();
+  std::pair<int, int> best(-1, -1);
+  for(auto& kv : node->weights){
+    std::pair<int, int> weight_id(kv.second, kv.first);
+    if(kv.second > _min_weight) node->ordered.push_back(weight_id);
+    if(weight_id > best) best = weight_id;
+  }
+  if(node->ordered.empty() && best.second >= 0){
+    node->ordered.push_back(best);
+  }
+  std::sort(node->ordered.begin(), node->ordered.end(), std::greater<std::pair<int, int>>());
+  node->ordered_valid = true;
+  return node->ordered;
+}
@@ -8,7 +8,7 @@ Frame::Frame(){
 
 Frame::Frame(int frame_id, bool pose_fixed, CameraPtr camera, double timestamp):
     tracking_frame_id(-1), local_map_optimization_frame_id(-1), local_map_optimization_fix_frame_id(-1),
-    _frame_id(frame_id), _pose_fixed(pose_fixed), _camera(camera), _timestamp(timestamp){
+    local_map_optimization_index(-1), _frame_id(frame_id), _pose_fixed(pose_fixed), _tracked_by_klt(false), _camera(camera), _timestamp(timestamp){
   _grid_width_inv = static_cast<double>(FRAME_GRID_COLS)/static_cast<double>(_camera->ImageWidth());
   _grid_height_inv = static_cast<double>(FRAME_GRID_ROWS)/static_cast<double>(_camera->ImageHeight());
 }
@@ -17,9 +17,11 @@ Frame& Frame::operator=(const Frame& other){
   tracking_frame_id = other.tracking_frame_id;
   local_map_optimization_frame_id = other.local_map_optimization_frame_id;
   local_map_optimization_fix_frame_id = other.local_map_optimization_fix_frame_id;
+  local_map_optimization_index = other.local_map_optimization_index;
   _frame_id = other._frame_id;
   _timestamp = other._timestamp;
   _pose_fixed = other._pose_fixed;
+  _tracked_by_klt = other._tracked_by_klt;
   _pose = other._pose;
 
   _features = other._features;
@@ -67,6 +69,14 @@ Eigen::Matrix4d& Frame::GetPose(){
   return _pose;
 }
 
+void Frame::SetTrackedByKlt(bool tracked_by_klt){
+  _tracked_by_klt = tracked_by_klt;
+}
+
+bool Frame::TrackedByKlt(){
+  return _tracked_by_klt;
+}
+
 bool Frame::FindGrid(double& x, double& y, int& grid_x, int& grid_y){
   grid_x = std::round(x * _grid_width_inv);
   grid_y = std::round(y * _grid_height_inv);
@@ -86,6 +96,14 @@ void Frame::AddFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features_lef
 
 void Frame::AddLeftFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features_left, 
     std::vector<Eigen::Vector4d>& lines_left){
+  // assign points to lines
+  std::vector<std::map<int, double>> points_on_line_left;
+  AssignPointsToLines(lines_left, features_left, points_on_line_left);
+  AddLeftFeatures(features_left, lines_left, points_on_line_left);
+}
+
+void Frame::AddLeftFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features_left, 
+    std::vector<Eigen::Vector4d>& lines_left, std::vector<std::map<int, double>>& points_on_lines){
   _features = features_left;
 
   // fill in keypoints and assign features to grids
@@ -112,12 +130,9 @@ void Frame::AddLeftFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features
   std::vector<MappointPtr> mappoints(features_left_size, nullptr);
   _mappoints = mappoints;
 
-  // assign points to lines
+  // points on lines
   _lines = lines_left;
-  std::vector<std::map<int, double>> points_on_line_left;
-  std::vector<int> line_matches;
-  AssignPointsToLines(lines_left, features_left, points_on_line_left);
-  _points_on_lines = points_on_line_left;
+  _points_on_lines = points_on_lines;
 
   // initialize line track ids and maplines
   size_t line_num = lines_left.size();
@@ -127,7 +142,7 @@ void Frame::AddLeftFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features
   _maplines = maplines;
 
   // for debug
-  relation_left = points_on_line_left;
+  relation_left = points_on_lines;
 }
 
 int Frame::AddRightFeatures(Eigen::Matrix<double, 259, Eigen::Dynamic>& features_right, 
@@ -409,7 +424,7 @@ bool Frame::TriangulateStereoLine(size_t idx, Vector6d& endpoints){
   return TriangulateByStereo(_lines[idx], _lines_right[idx], _pose, _camera, endpoints);
 }
 
-void Frame::RemoveMapline(MaplinePtr mapline){
+void Frame::RemoveMapline(const MaplinePtr& mapline){
   RemoveMapline(mapline->GetLineIdx(_frame_id));
 }
 
@@ -419,27 +434,6 @@ void Frame::RemoveMapline(int idx){
   }
 }
 
-void Frame::AddConnection(std::shared_ptr<Frame> frame, int weight){
-  std::map<std::shared_ptr<Frame>, int>::iterator it = _connections.find(frame);
-  bool add_connection = (it == _connections.end());
-  bool change_connection = (!add_connection && _connections[frame] != weight);
-  if(add_connection || change_connection){
-    if(change_connection){
-      _ordered_connections.erase(std::pair<int, std::shared_ptr<Frame>>(it->second, frame));
-    }
-    _connections[frame] = weight;
-    _ordered_connections.insert(std::pair<int, std::shared_ptr<Frame>>(weight, frame));
-  }
-}
-
-void Frame::AddConnection(std::set<std::pair<int, std::shared_ptr<Frame>>> connections){
-  _ordered_connections = connections;
-  _connections.clear();
-  for(auto& kv : connections){
-    _connections[kv.second] = kv.first;
-  }
-}
-
 void Frame::SetParent(std::shared_ptr<Frame> parent){
   _parent = parent;
 }
@@ -456,15 +450,7 @@ std::shared_ptr<Frame> Frame::GetChild(){
   return _child;
 }
 
-void Frame::RemoveConnection(std::shared_ptr<Frame> frame){
-  std::map<std::shared_ptr<Frame>, int>::iterator it = _connections.find(frame);
-  if(it != _connections.end()){
-    _ordered_connections.erase(std::pair<int, std::shared_ptr<Frame>>(it->second, it->first));
-    _connections.erase(it);
-  }
-}
-
-void Frame::RemoveMappoint(MappointPtr mappoint){
+void Frame::RemoveMappoint(const MappointPtr& mappoint){
   RemoveMappoint(mappoint->GetKeypointIdx(_frame_id));
 }
 
@@ -474,26 +460,6 @@ void Frame::RemoveMappoint(int idx){
   }
 }
 
-void Frame::DecreaseWeight(std::shared_ptr<Frame> frame, int weight){
-  std::map<std::shared_ptr<Frame>, int>::iterator it = _connections.find(frame);
-  if(it != _connections.end()){
-    _ordered_connections.erase(std::pair<int, std::shared_ptr<Frame>>(it->second, it->first));
-    int original_weight = it->second;
-    bool to_remove = (original_weight < (weight+5) && _connections.size() >= 2) || (original_weight <= weight);
-    if(to_remove){
-      _connections.erase(it);
-    }else{
-      it->second = original_weight - weight;
-      _ordered_connections.insert(std::pair<int, std::shared_ptr<Frame>>(it->second, it->first));
-    }
-  }
-}
-
-std::vector<std::pair<int, std::shared_ptr<Frame>>> Frame::GetOrderedConnections(int number){
-  int n = (number > 0 && number < _ordered_connections.size()) ? number : _ordered_connections.size();
-  return std::vector<std::pair<int, std::shared_ptr<Frame>>>(_ordered_connections.begin(), std::next(_ordered_connections.begin(), n));
-}
-
 void Frame::SetPreviousFrame(std::shared_ptr<Frame> previous_frame){
   _previous_frame = previous_frame;
 }
@@ -0,0 +1,62 @@
+#include <Eigen/Eigenvalues>
+
+#include "g2o_optimization/edge_pose_prior.h"
+
+EdgePosePrior::EdgePosePrior() : g2o::BaseMultiEdge<-1, Eigen::VectorXd>() {}
+
+bool EdgePosePrior::SetPrior(const std::vector<g2o::VertexSE3Expmap*>& vertices,
+    const Eigen::MatrixXd& H, const Eigen::VectorXd& g) {
+  // H = V * S * V^T, J = S^(1/2) * V^T and r0 = S^(-1/2) * V^T * g on the informative directions
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(0.5 * (H + H.transpose()));
+  const Eigen::VectorXd& S = solver.eigenvalues();
+  const Eigen::MatrixXd& V = solver.eigenvectors();
+  double eps = 1e-8 * std::max(S.maxCoeff(), 0.0);
+  int rank = 0;
+  for(int i = 0; i < S.size(); i++){
+    if(S(i) > eps) rank++;
+  }
+  if(rank == 0) return false;
+
+  J.resize(rank, H.cols());
+  r0.resize(rank);
+  for(int i = S.size() - rank, row = 0; i < S.size(); i++, row++){
+    double sqrt_s = std::sqrt(S(i));
+    J.row(row) = sqrt_s * V.col(i).transpose();
+    r0(row) = V.col(i).dot(g) / sqrt_s;
+  }
+
+  setDimension(rank);
+  setInformation(Eigen::MatrixXd::Identity(rank, rank));
+  setMeasurement(Eigen::VectorXd::Zero(rank));
+  resize(vertices.size());
+  linearization_points.clear();
+  for(size_t i = 0; i < vertices.size(); i++){
+    setVertex(i, vertices[i]);
+    linearization_points.push_back(vertices[i]->estimate());
+  }
+  return true;
+}
+
+bool EdgePosePrior::read(std::istream &is) {
+  return false;
+}
+
+bool EdgePosePrior::write(std::ostream &os) const {
+  return false;
+}
+
+void EdgePosePrior::computeError() {
+  _error = r0;
+  for(size_t i = 0; i < _vertices.size(); i++){
+    const g2o::VertexSE3Expmap *v = static_cast<const g2o::VertexSE3Expmap *>(_vertices[i]);
+    const g2o::Vector6 dx = (v->estimate() * linearization_points[i].inverse()).log();
+    _error.noalias() += J.middleCols<6>(6 * i) * dx;
+  }
+}
+
+void EdgePosePrior::linearizeOplus() {
+  // the jacobian of the log is taken as identity, the prior is only valid near its linearization point anyway
+  for(size_t i = 0; i < _vertices.size(); i++){
+    _jacobianOplus[i] = J.middleCols<6>(6 * i);
+  }
+}
@@ -22,21 +22,47 @@ void EdgeSE3ProjectLine::computeError() {
   const g2o::VertexSE3Expmap *v1 =
       static_cast<const g2o::VertexSE3Expmap *>(_vertices[1]);
   const VertexLine3D *v2 = static_cast<const VertexLine3D *>(_vertices[0]);
-  Eigen::Vector4d obs(_measurement);
-  Eigen::Vector3d line_2d = cam_project(g2o::internal::fromSE3Quat(v1->estimate()) * v2->estimate());
-
-  double line_2d_norm = line_2d.head(2).norm();
-  Eigen::Vector2d error;
-  error(0) = obs(0) * line_2d(0) + obs(1) * line_2d(1) + line_2d(2);
-  error(1) = obs(2) * line_2d(0) + obs(3) * line_2d(1) + line_2d(2);
-  _error = error / line_2d_norm;
+  const g2o::SE3Quat& Tcw = v1->estimate();
+  const Eigen::Matrix3d R = Tcw.rotation().toRotationMatrix();
+  const Eigen::Vector3d w_c = R * v2->estimate().w() + Tcw.translation().cross(R * v2->estimate().d());
+  const Eigen::Vector3d line_2d = cam_project(w_c);
+
+  const Eigen::Vector4d& obs = _measurement;
+  double inv_norm = 1.0 / line_2d.head(2).norm();
+  _error(0) = (obs(0) * line_2d(0) + obs(1) * line_2d(1) + line_2d(2)) * inv_norm;
+  _error(1) = (obs(2) * line_2d(0) + obs(3) * line_2d(1) + line_2d(2)) * inv_norm;
 }
 
 Eigen::Vector3d EdgeSE3ProjectLine::cam_project(const g2o::Line3D& line) const {
-  Eigen::Vector3d w = line.w();
-  Eigen::Vector3d line_2d;
-  line_2d(0) = fy * w(0);
-  line_2d(1) = fx * w(1);
-  line_2d(2) = Kv.transpose() * w;
-  return line_2d;
-}
\ No newline at end of file
+  return cam_project(Eigen::Vector3d(line.w()));
+}
+
+Eigen::Vector3d EdgeSE3ProjectLine::cam_project(const Eigen::Vector3d& w) const {
+  return ProjectLineMoment(w, fx, fy, Kv);
+}
+
+void EdgeSE3ProjectLine::linearizeOplus() {
+  const g2o::VertexSE3Expmap *v1 =
+      static_cast<const g2o::VertexSE3Expmap *>(_vertices[1]);
+  const VertexLine3D *v2 = static_cast<const VertexLine3D *>(_vertices[0]);
+  const g2o::SE3Quat& Tcw = v1->estimate();
+  const Eigen::Matrix3d R = Tcw.rotation().toRotationMatrix();
+  const Eigen::Vector3d& t = Tcw.translation();
+  const Eigen::Vector3d w = v2->estimate().w();
+  const Eigen::Vector3d d = v2->estimate().d();
+
+  // camera frame line, w_c = R * w + t x (R * d), d_c = R * d
+  const Eigen::Vector3d Rd = R * d;
+  const Eigen::Vector3d w_c = R * w + t.cross(Rd);
+  const Eigen::Matrix<double, 2, 3> de_dw = LineErrorJacobian(_measurement, w_c, fx, fy, Kv);
+
+  // line, through the world frame Plucker coordinates
+  Eigen::Matrix<double, 3, 6> dw_dline;
+  dw_dline.leftCols<3>() = R;
+  dw_dline.rightCols<3>() = g2o::skew(t) * R;
+  _jacobianOplusXi = de_dw * dw_dline * v2->oplusJacobian();
+
+  // pose, the update [omega, upsilon] is applied on the left of the estimate
+  _jacobianOplusXj.leftCols<3>() = -de_dw * g2o::skew(w_c);
+  _jacobianOplusXj.rightCols<3>() = -de_dw * g2o::skew(Rd);
+}
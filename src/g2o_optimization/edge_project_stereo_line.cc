@@ -23,29 +23,64 @@ void EdgeStereoSE3ProjectLine::computeError() {
   const g2o::VertexSE3Expmap *v1 =
       static_cast<const g2o::VertexSE3Expmap *>(_vertices[1]);
   const VertexLine3D *v2 = static_cast<const VertexLine3D *>(_vertices[0]);
-  Vector8d obs(_measurement);
-  Eigen::Vector4d error;
-  g2o::Isometry3 T_left = g2o::internal::fromSE3Quat(v1->estimate());
-  Eigen::Vector3d line_2d_left = cam_project(T_left * v2->estimate());
-  double line_2d_norm_left = line_2d_left.head(2).norm();
-  error(0) = (obs(0) * line_2d_left(0) + obs(1) * line_2d_left(1) + line_2d_left(2)) / line_2d_norm_left;
-  error(1) = (obs(2) * line_2d_left(0) + obs(3) * line_2d_left(1) + line_2d_left(2)) / line_2d_norm_left;
-
-  g2o::Isometry3 T_right(T_left);
-  T_right(0, 3) -= b;
-
-  Eigen::Vector3d line_2d_right = cam_project(T_right * v2->estimate());
-  double line_2d_norm_right = line_2d_right.head(2).norm();
-  error(2) = (obs(4) * line_2d_right(0) + obs(5) * line_2d_right(1) + line_2d_right(2)) / line_2d_norm_right;
-  error(3) = (obs(6) * line_2d_right(0) + obs(7) * line_2d_right(1) + line_2d_right(2)) / line_2d_norm_right;
-  _error = error;
+  const g2o::SE3Quat& Tcw = v1->estimate();
+  const Eigen::Matrix3d R = Tcw.rotation().toRotationMatrix();
+  const Eigen::Vector3d Rd = R * v2->estimate().d();
+  const Eigen::Vector3d Rw = R * v2->estimate().w();
+
+  // the right camera only differs in translation, t_right = t_left - (b, 0, 0)
+  const Eigen::Vector3d t_left = Tcw.translation();
+  const Eigen::Vector3d t_right(t_left(0) - b, t_left(1), t_left(2));
+  const Eigen::Vector3d line_2d_left = cam_project(Eigen::Vector3d(Rw + t_left.cross(Rd)));
+  const Eigen::Vector3d line_2d_right = cam_project(Eigen::Vector3d(Rw + t_right.cross(Rd)));
+
+  const Vector8d& obs = _measurement;
+  double inv_norm_left = 1.0 / line_2d_left.head(2).norm();
+  _error(0) = (obs(0) * line_2d_left(0) + obs(1) * line_2d_left(1) + line_2d_left(2)) * inv_norm_left;
+  _error(1) = (obs(2) * line_2d_left(0) + obs(3) * line_2d_left(1) + line_2d_left(2)) * inv_norm_left;
+  double inv_norm_right = 1.0 / line_2d_right.head(2).norm();
+  _error(2) = (obs(4) * line_2d_right(0) + obs(5) * line_2d_right(1) + line_2d_right(2)) * inv_norm_right;
+  _error(3) = (obs(6) * line_2d_right(0) + obs(7) * line_2d_right(1) + line_2d_right(2)) * inv_norm_right;
 }
 
 Eigen::Vector3d EdgeStereoSE3ProjectLine::cam_project(const g2o::Line3D& line) const {
-  Eigen::Vector3d w = line.w();
-  Eigen::Vector3d line_2d;
-  line_2d(0) = fy * w(0);
-  line_2d(1) = fx * w(1);
-  line_2d(2) = Kv.transpose() * w;
-  return line_2d;
-}
\ No newline at end of file
+  return cam_project(Eigen::Vector3d(line.w()));
+}
+
+Eigen::Vector3d EdgeStereoSE3ProjectLine::cam_project(const Eigen::Vector3d& w) const {
+  return ProjectLineMoment(w, fx, fy, Kv);
+}
+
+void EdgeStereoSE3ProjectLine::linearizeOplus() {
+  const g2o::VertexSE3Expmap *v1 =
+      static_cast<const g2o::VertexSE3Expmap *>(_vertices[1]);
+  const VertexLine3D *v2 = static_cast<const VertexLine3D *>(_vertices[0]);
+  const g2o::SE3Quat& Tcw = v1->estimate();
+  const Eigen::Matrix3d R = Tcw.rotation().toRotationMatrix();
+  const Eigen::Vector3d& t_left = Tcw.translation();
+  const Eigen::Vector3d t_right = t_left - Eigen::Vector3d(b, 0, 0);
+  const Eigen::Vector3d w = v2->estimate().w();
+  const Eigen::Vector3d d = v2->estimate().d();
+  const Eigen::Matrix<double, 6, 4> dline_dupdate = v2->oplusJacobian();
+  const Eigen::Matrix3d skew_b = g2o::skew(Eigen::Vector3d(-b, 0, 0));
+
+  // left and right camera frame lines, the right camera only differs in translation
+  const Eigen::Vector3d Rd = R * d;
+  const Eigen::Vector3d w_left = R * w + t_left.cross(Rd);
+  const Eigen::Vector3d w_right = R * w + t_right.cross(Rd);
+  const Eigen::Matrix<double, 2, 3> de_dw_left = LineErrorJacobian(_measurement.head<4>(), w_left, fx, fy, Kv);
+  const Eigen::Matrix<double, 2, 3> de_dw_right = LineErrorJacobian(_measurement.tail<4>(), w_right, fx, fy, Kv);
+
+  Eigen::Matrix<double, 3, 6> dw_dline;
+  dw_dline.leftCols<3>() = R;
+  dw_dline.rightCols<3>() = g2o::skew(t_left) * R;
+  _jacobianOplusXi.topRows<2>() = de_dw_left * dw_dline * dline_dupdate;
+  dw_dline.rightCols<3>() = g2o::skew(t_right) * R;
+  _jacobianOplusXi.bottomRows<2>() = de_dw_right * dw_dline * dline_dupdate;
+
+  // pose, the update is applied to the left camera, w_right = w_left + (-b, 0, 0) x d_c
+  _jacobianOplusXj.block<2, 3>(0, 0) = -de_dw_left * g2o::skew(w_left);
+  _jacobianOplusXj.block<2, 3>(0, 3) = -de_dw_left * g2o::skew(Rd);
+  _jacobianOplusXj.block<2, 3>(2, 0) = -de_dw_right * (g2o::skew(w_left) + skew_b * g2o::skew(Rd));
+  _jacobianOplusXj.block<2, 3>(2, 3) = -de_dw_right * g2o::skew(Rd);
+}
@@ -0,0 +1,31 @@
+#include "g2o_optimization/line_jacobians.h"
+
+Eigen::Vector3d ProjectLineMoment(const Eigen::Vector3d& w, double fx, double fy, const Eigen::Vector3d& Kv){
+  Eigen::Vector3d line_2d;
+  line_2d(0) = fy * w(0);
+  line_2d(1) = fx * w(1);
+  line_2d(2) = Kv.transpose() * w;
+  return line_2d;
+}
+
+Eigen::Matrix<double, 2, 3> LineErrorJacobian(const Eigen::Vector4d& obs, const Eigen::Vector3d& w, 
+    double fx, double fy, const Eigen::Vector3d& Kv){
+  const Eigen::Vector3d line_2d = ProjectLineMoment(w, fx, fy, Kv);
+  double inv_norm = 1.0 / line_2d.head(2).norm();
+  double inv_norm3 = inv_norm * inv_norm * inv_norm;
+
+  // e_i = (o_i . l) / |l_xy| with o_i = [u_i, v_i, 1]
+  Eigen::Matrix<double, 2, 3> de_dl;
+  for(int i = 0; i < 2; i++){
+    double dist = obs(2*i) * line_2d(0) + obs(2*i+1) * line_2d(1) + line_2d(2);
+    de_dl(i, 0) = obs(2*i) * inv_norm - dist * line_2d(0) * inv_norm3;
+    de_dl(i, 1) = obs(2*i+1) * inv_norm - dist * line_2d(1) * inv_norm3;
+    de_dl(i, 2) = inv_norm;
+  }
+
+  Eigen::Matrix3d dl_dw;
+  dl_dw << fy, 0, 0,
+           0, fx, 0,
+           Kv.transpose();
+  return de_dl * dl_dw;
+}
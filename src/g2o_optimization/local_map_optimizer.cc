@@ -0,0 +1,692 @@
+#include "g2o_optimization/local_map_optimizer.h"
+
+#include <chrono>
+#include <unordered_set>
+#include <Eigen/Eigenvalues>
+
+#include <g2o/core/block_solver.h>
+#include <g2o/solvers/eigen/linear_solver_eigen.h>
+#include <g2o/types/sba/types_six_dof_expmap.h>
+#include <g2o/core/robust_kernel_impl.h>
+#include <g2o/core/hyper_graph_action.h>
+
+#include "g2o_optimization/vertex_line3d.h"
+#include "g2o_optimization/edge_project_line.h"
+#include "g2o_optimization/edge_project_stereo_line.h"
+#include "g2o_optimization/edge_pose_prior.h"
+
+// Huber kernel that can be switched off without detaching it, g2o deletes a kernel once it is replaced
+class SwitchableHuberKernel : public g2o::RobustKernelHuber{
+public:
+  SwitchableHuberKernel(): _enabled(true) {}
+
+  void SetEnabled(bool enabled){ _enabled = enabled; }
+
+  virtual void robustify(double e2, g2o::Vector3& rho) const {
+    if(_enabled){
+      g2o::RobustKernelHuber::robustify(e2, rho);
+    }else{
+      rho[0] = e2;
+      rho[1] = 1.0;
+      rho[2] = 0.0;
+    }
+  }
+
+private:
+  bool _enabled;
+};
+
+// Run by g2o after every iteration. It raises the force stop flag of the optimizer when the time
+// budget is spent, the abort flag is set or the last iteration barely lowered chi2.
+class OptimizationMonitor : public g2o::HyperGraphAction{
+public:
+  OptimizationMonitor(g2o::SparseOptimizer* optimizer): abort_flag(nullptr), max_time(0), min_chi2_decrease(0),
+      stop(false), interrupted(false), _optimizer(optimizer), _last_chi2(0) {}
+
+  void Start(const OptimizationConfig& cfg){
+    max_time = cfg.max_time;
+    min_chi2_decrease = cfg.min_chi2_decrease;
+    interrupted = false;
+    _start_time = std::chrono::steady_clock::now();
+  }
+
+  // called after initializeOptimization, returns false if the pass should not run at all
+  bool StartPass(){
+    _optimizer->computeActiveErrors();
+    _last_chi2 = _optimizer->activeRobustChi2();
+    stop = CheckInterrupted();
+    return !stop;
+  }
+
+  virtual g2o::HyperGraphAction* operator()(const g2o::HyperGraph* graph, Parameters* parameters){
+    if(CheckInterrupted()){
+      stop = true;
+      return this;
+    }
+
+    if(min_chi2_decrease > 0){
+      _optimizer->computeActiveErrors();
+      double chi2 = _optimizer->activeRobustChi2();
+      stop = (_last_chi2 - chi2) < min_chi2_decrease * _last_chi2;
+      _last_chi2 = chi2;
+    }
+    return this;
+  }
+
+  bool CheckInterrupted(){
+    if(interrupted) return true;
+    bool aborted = abort_flag && abort_flag->load();
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start_time).count();
+    interrupted = aborted || (max_time > 0 && elapsed > max_time);
+    return interrupted;
+  }
+
+  const std::atomic<bool>* abort_flag;
+  double max_time;
+  double min_chi2_decrease;
+  bool stop;            // force stop flag of the optimizer
+  bool interrupted;     // stopped by time or abort flag, no further pass runs
+
+private:
+  g2o::SparseOptimizer* _optimizer;
+  double _last_chi2;
+  std::chrono::steady_clock::time_point _start_time;
+};
+
+namespace {
+
+template<typename VertexType>
+VertexType* GetOrAddVertex(g2o::SparseOptimizer& optimizer, int id, int& added_num){
+  VertexType* vertex = static_cast<VertexType*>(optimizer.vertex(id));
+  if(!vertex){
+    vertex = new VertexType();
+    vertex->setId(id);
+    optimizer.addVertex(vertex);
+    added_num++;
+  }
+  return vertex;
+}
+
+template<typename EdgeType>
+void CopyLinearization(EdgeType* e, Eigen::MatrixXd& J_landmark, Eigen::MatrixXd& J_pose,
+    Eigen::VectorXd& error, Eigen::MatrixXd& information){
+  J_landmark = e->jacobianOplusXi();
+  J_pose = e->jacobianOplusXj();
+  error = e->error();
+  information = e->information();
+}
+
+// jacobians w.r.t. the landmark and the pose, error and robust weighted information of a landmark
+// edge at the current estimates
+bool LinearizeLandmarkEdge(g2o::OptimizableGraph::Edge* edge, g2o::JacobianWorkspace& workspace,
+    Eigen::MatrixXd& J_landmark, Eigen::MatrixXd& J_pose, Eigen::VectorXd& error, Eigen::MatrixXd& information){
+  edge->computeError();
+  edge->linearizeOplus(workspace);
+  if(g2o::EdgeSE3ProjectXYZ* e = dynamic_cast<g2o::EdgeSE3ProjectXYZ*>(edge)){
+    CopyLinearization(e, J_landmark, J_pose, error, information);
+  }else if(g2o::EdgeStereoSE3ProjectXYZ* e = dynamic_cast<g2o::EdgeStereoSE3ProjectXYZ*>(edge)){
+    CopyLinearization(e, J_landmark, J_pose, error, information);
+  }else if(EdgeSE3ProjectLine* e = dynamic_cast<EdgeSE3ProjectLine*>(edge)){
+    CopyLinearization(e, J_landmark, J_pose, error, information);
+  }else if(EdgeStereoSE3ProjectLine* e = dynamic_cast<EdgeStereoSE3ProjectLine*>(edge)){
+    CopyLinearization(e, J_landmark, J_pose, error, information);
+  }else{
+    return false;
+  }
+
+  if(edge->robustKernel()){
+    g2o::Vector3 rho;
+    edge->robustKernel()->robustify(edge->chi2(), rho);
+    information *= rho[1];
+  }
+  return true;
+}
+
+// inverse on the informative directions, landmarks seen from one direction are not fully constrained
+Eigen::MatrixXd PseudoInverse(const Eigen::MatrixXd& A){
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(0.5 * (A + A.transpose()));
+  const Eigen::VectorXd& S = solver.eigenvalues();
+  double eps = 1e-8 * std::max(S.maxCoeff(), 0.0);
+  Eigen::VectorXd S_inv = Eigen::VectorXd::Zero(S.size());
+  for(int i = 0; i < S.size(); i++){
+    if(S(i) > eps) S_inv(i) = 1.0 / S(i);
+  }
+  return solver.eigenvectors() * S_inv.asDiagonal() * solver.eigenvectors().transpose();
+}
+
+}  // namespace
+
+LocalMapOptimizer::LocalMapOptimizer(): _prior_edge(nullptr), _interrupted(false), _stamp(0), _added_num(0), _removed_num(0){
+  typedef ParallelBlockSolver<g2o::BlockSolverTraits<6, 3> > PointBlockSolver;
+  typedef g2o::LinearSolverEigen<PointBlockSolver::PoseMatrixType> PointLinearSolver;
+  typedef ParallelBlockSolver<g2o::BlockSolverTraits<-1, -1> > SlamBlockSolver;
+  typedef g2o::LinearSolverEigen<SlamBlockSolver::PoseMatrixType> SlamLinearSolver;
+
+  auto point_linear_solver = g2o::make_unique<PointLinearSolver>();
+  point_linear_solver->setBlockOrdering(false);
+  auto point_block_solver = g2o::make_unique<PointBlockSolver>(std::move(point_linear_solver));
+  _point_block_solver = point_block_solver.get();
+  _point_algorithm.reset(new ParallelLevenberg(std::move(point_block_solver)));
+
+  auto linear_solver = g2o::make_unique<SlamLinearSolver>();
+  linear_solver->setBlockOrdering(false);
+  auto block_solver = g2o::make_unique<SlamBlockSolver>(std::move(linear_solver));
+  _mixed_block_solver = block_solver.get();
+  _mixed_algorithm.reset(new ParallelLevenberg(std::move(block_solver)));
+
+  _optimizer.setAlgorithm(_mixed_algorithm.get());
+  _optimizer.setVerbose(false);
+
+  _monitor.reset(new OptimizationMonitor(&_optimizer));
+  _optimizer.addPostIterationAction(_monitor.get());
+  _optimizer.setForceStopFlag(&(_monitor->stop));
+}
+
+LocalMapOptimizer::~LocalMapOptimizer(){
+  // the optimizer deletes its algorithm, both are owned here
+  _optimizer.setAlgorithm(nullptr);
+  _optimizer.removePostIterationAction(_monitor.get());
+  _optimizer.setForceStopFlag(nullptr);
+}
+
+void LocalMapOptimizer::SetAbortFlag(const std::atomic<bool>* abort_flag){
+  _monitor->abort_flag = abort_flag;
+}
+
+void LocalMapOptimizer::SetThreadPool(const ThreadPoolPtr& thread_pool){
+  _thread_pool = thread_pool;
+  _point_algorithm->SetThreadPool(thread_pool.get());
+  _mixed_algorithm->SetThreadPool(thread_pool.get());
+  _point_block_solver->SetThreadPool(thread_pool.get());
+  _mixed_block_solver->SetThreadPool(thread_pool.get());
+}
+
+void LocalMapOptimizer::Marginalize(const std::vector<int>& kept_frame_ids, const std::vector<int>& marginalized_frame_ids,
+    std::vector<int>& mappoint_ids, std::vector<int>& mapline_ids){
+  mappoint_ids.clear();
+  mapline_ids.clear();
+
+  // pose blocks, the kept poses first. fixed poses are constants
+  std::vector<g2o::VertexSE3Expmap*> poses;
+  std::unordered_map<g2o::HyperGraph::Vertex*, int> pose_indexes;
+  auto add_pose = [&](int frame_id){
+    g2o::VertexSE3Expmap* v = static_cast<g2o::VertexSE3Expmap*>(_optimizer.vertex(PoseVertexId(frame_id)));
+    if(!v || v->fixed() || pose_indexes.count(v)) return;
+    pose_indexes[v] = poses.size();
+    poses.push_back(v);
+  };
+  for(int frame_id : kept_frame_ids){
+    add_pose(frame_id);
+  }
+  int kept_num = poses.size();
+  for(int frame_id : marginalized_frame_ids){
+    add_pose(frame_id);
+  }
+
+  // the landmarks seen by the leaving poses leave with them, landmarks that left before are constants
+  std::vector<g2o::OptimizableGraph::Vertex*> landmarks;
+  std::unordered_set<g2o::HyperGraph::Vertex*> landmark_set;
+  std::vector<g2o::OptimizableGraph::Edge*> pose_only_edges;
+  for(int frame_id : marginalized_frame_ids){
+    g2o::OptimizableGraph::Vertex* v = _optimizer.vertex(PoseVertexId(frame_id));
+    if(!v) continue;
+    for(g2o::HyperGraph::Edge* he : v->edges()){
+      g2o::OptimizableGraph::Edge* e = static_cast<g2o::OptimizableGraph::Edge*>(he);
+      if(e == _prior_edge || e->level() != 0) continue;
+      g2o::OptimizableGraph::Vertex* landmark = static_cast<g2o::OptimizableGraph::Vertex*>(e->vertex(0));
+      if(landmark->fixed()){
+        pose_only_edges.push_back(e);
+      }else if(landmark_set.insert(landmark).second){
+        landmarks.push_back(landmark);
+      }
+    }
+  }
+
+  int dim = 6 * poses.size();
+  Eigen::MatrixXd H = Eigen::MatrixXd::Zero(dim, dim);
+  Eigen::VectorXd g = Eigen::VectorXd::Zero(dim);
+
+  // the previous prior
+  if(_prior_edge){
+    _prior_edge->computeError();
+    const Eigen::VectorXd& error = _prior_edge->error();
+    for(size_t i = 0; i < _prior_edge->vertices().size(); i++){
+      auto it_i = pose_indexes.find(_prior_edge->vertex(i));
+      if(it_i == pose_indexes.end()) continue;
+      int a = 6 * it_i->second;
+      g.segment<6>(a) += _prior_edge->J.middleCols<6>(6 * i).transpose() * error;
+      for(size_t j = 0; j < _prior_edge->vertices().size(); j++){
+        auto it_j = pose_indexes.find(_prior_edge->vertex(j));
+        if(it_j == pose_indexes.end()) continue;
+        H.block<6, 6>(a, 6 * it_j->second) += 
+            _prior_edge->J.middleCols<6>(6 * i).transpose() * _prior_edge->J.middleCols<6>(6 * j);
+      }
+    }
+  }
+
+  g2o::JacobianWorkspace workspace;
+  for(g2o::HyperGraph::Edge* he : _optimizer.edges()){
+    workspace.updateSize(he);
+  }
+  workspace.allocate();
+  Eigen::MatrixXd J_landmark, J_pose, information;
+  Eigen::VectorXd error;
+
+  // observations of constant landmarks only constrain the leaving pose
+  for(g2o::OptimizableGraph::Edge* e : pose_only_edges){
+    auto it = pose_indexes.find(e->vertex(1));
+    if(it == pose_indexes.end()) continue;
+    if(!LinearizeLandmarkEdge(e, workspace, J_landmark, J_pose, error, information)) continue;
+    int a = 6 * it->second;
+    H.block<6, 6>(a, a) += J_pose.transpose() * information * J_pose;
+    g.segment<6>(a) += J_pose.transpose() * information * error;
+  }
+
+  // landmarks, their blocks are eliminated right away
+  std::vector<int> observer_indexes;
+  std::vector<Eigen::MatrixXd> H_pl;
+  for(g2o::OptimizableGraph::Vertex* landmark : landmarks){
+    int landmark_dim = landmark->dimension();
+    Eigen::MatrixXd H_ll = Eigen::MatrixXd::Zero(landmark_dim, landmark_dim);
+    Eigen::VectorXd g_l = Eigen::VectorXd::Zero(landmark_dim);
+    observer_indexes.clear();
+    H_pl.clear();
+
+    for(g2o::HyperGraph::Edge* he : landmark->edges()){
+      g2o::OptimizableGraph::Edge* e = static_cast<g2o::OptimizableGraph::Edge*>(he);
+      if(e->level() != 0) continue;
+      if(!LinearizeLandmarkEdge(e, workspace, J_landmark, J_pose, error, information)) continue;
+      H_ll += J_landmark.transpose() * information * J_landmark;
+      g_l += J_landmark.transpose() * information * error;
+
+      auto it = pose_indexes.find(e->vertex(1));
+      if(it == pose_indexes.end()) continue;
+      int a = 6 * it->second;
+      H.block<6, 6>(a, a) += J_pose.transpose() * information * J_pose;
+      g.segment<6>(a) += J_pose.transpose() * information * error;
+      observer_indexes.push_back(a);
+      H_pl.push_back(J_pose.transpose() * information * J_landmark);
+    }
+
+    const Eigen::MatrixXd H_ll_inv = PseudoInverse(H_ll);
+    for(size_t i = 0; i < observer_indexes.size(); i++){
+      const Eigen::MatrixXd H_pl_H_ll_inv = H_pl[i] * H_ll_inv;
+      g.segment<6>(observer_indexes[i]) -= H_pl_H_ll_inv * g_l;
+      for(size_t j = 0; j < observer_indexes.size(); j++){
+        H.block<6, 6>(observer_indexes[i], observer_indexes[j]) -= H_pl_H_ll_inv * H_pl[j].transpose();
+      }
+    }
+
+    int landmark_id = landmark->id() / 3;
+    if(landmark->id() % 3 == 1){
+      mappoint_ids.push_back(landmark_id);
+    }else{
+      mapline_ids.push_back(landmark_id);
+    }
+  }
+
+  // eliminate the leaving poses
+  if(_prior_edge){
+    _optimizer.removeEdge(_prior_edge);
+    _prior_edge = nullptr;
+  }
+  if(kept_num == 0) return;
+
+  int kept_dim = 6 * kept_num;
+  int marginalized_dim = dim - kept_dim;
+  Eigen::MatrixXd H_prior = H.topLeftCorner(kept_dim, kept_dim);
+  Eigen::VectorXd g_prior = g.head(kept_dim);
+  if(marginalized_dim > 0){
+    const Eigen::MatrixXd H_km_H_mm_inv = 
+        H.topRightCorner(kept_dim, marginalized_dim) * PseudoInverse(H.bottomRightCorner(marginalized_dim, marginalized_dim));
+    H_prior -= H_km_H_mm_inv * H.bottomLeftCorner(marginalized_dim, kept_dim);
+    g_prior -= H_km_H_mm_inv * g.tail(marginalized_dim);
+  }
+
+  std::vector<g2o::VertexSE3Expmap*> kept_poses(poses.begin(), poses.begin() + kept_num);
+  EdgePosePrior* prior_edge = new EdgePosePrior();
+  if(!prior_edge->SetPrior(kept_poses, H_prior, g_prior)){
+    delete prior_edge;
+    return;
+  }
+  _optimizer.addEdge(prior_edge);
+  _prior_edge = prior_edge;
+}
+
+LocalMapOptimizer::EdgeRecord* LocalMapOptimizer::FindEdge(int64_t key, int type){
+  std::unordered_map<int64_t, EdgeRecord>::iterator it = _edges.find(key);
+  if(it == _edges.end()) return nullptr;
+  if(it->second.type != type){
+    // the keypoint changed between mono and stereo
+    _optimizer.removeEdge(it->second.edge);
+    _edges.erase(it);
+    _removed_num++;
+    return nullptr;
+  }
+  it->second.stamp = _stamp;
+  return &(it->second);
+}
+
+LocalMapOptimizer::EdgeRecord* LocalMapOptimizer::AddEdge(
+    int64_t key, int type, g2o::OptimizableGraph::Edge* edge, double delta){
+  SwitchableHuberKernel* kernel = new SwitchableHuberKernel();
+  kernel->setDelta(delta);
+  edge->setRobustKernel(kernel);
+  _optimizer.addEdge(edge);
+  _added_num++;
+
+  EdgeRecord& record = _edges[key];
+  record.edge = edge;
+  record.kernel = kernel;
+  record.type = type;
+  record.stamp = _stamp;
+  return &record;
+}
+
+void LocalMapOptimizer::RemoveStale(){
+  for(std::unordered_map<int64_t, EdgeRecord>::iterator it = _edges.begin(); it != _edges.end();){
+    if(it->second.stamp == _stamp){
+      it++;
+      continue;
+    }
+    _optimizer.removeEdge(it->second.edge);
+    it = _edges.erase(it);
+    _removed_num++;
+  }
+
+  // edges of a stale vertex are all stale, so the vertex is detached here
+  for(std::unordered_map<int, int>::iterator it = _vertex_stamps.begin(); it != _vertex_stamps.end();){
+    if(it->second == _stamp){
+      it++;
+      continue;
+    }
+    g2o::OptimizableGraph::Vertex* vertex = _optimizer.vertex(it->first);
+    if(vertex && _prior_edge && vertex->edges().count(_prior_edge)){
+      _optimizer.removeEdge(_prior_edge);
+      _prior_edge = nullptr;
+    }
+    if(vertex) _optimizer.removeVertex(vertex);
+    it = _vertex_stamps.erase(it);
+    _removed_num++;
+  }
+}
+
+bool LocalMapOptimizer::Optimize(LocalMapProblem& problem, std::vector<CameraPtr>& camera_list, const OptimizationConfig& cfg){
+  VectorOfPoses& poses = problem.poses;
+  VectorOfPoints3d& points = problem.points;
+  VectorOfLine3d& lines = problem.lines;
+  VectorOfMonoPointConstraints& mono_point_constraints = problem.mono_point_constraints;
+  VectorOfStereoPointConstraints& stereo_point_constraints = problem.stereo_point_constraints;
+  VectorOfMonoLineConstraints& mono_line_constraints = problem.mono_line_constraints;
+  VectorOfStereoLineConstraints& stereo_line_constraints = problem.stereo_line_constraints;
+
+  _monitor->Start(cfg);
+  _stamp++;
+  _added_num = 0;
+  _removed_num = 0;
+
+  // frame vertex
+  for(const Pose3d& pose : poses){
+    int vertex_id = PoseVertexId(pose.id);
+    g2o::VertexSE3Expmap* frame_vertex = GetOrAddVertex<g2o::VertexSE3Expmap>(_optimizer, vertex_id, _added_num);
+    frame_vertex->setEstimate(g2o::SE3Quat(pose.q, pose.p).inverse());
+    frame_vertex->setFixed(pose.fixed);
+    _vertex_stamps[vertex_id] = _stamp;
+  }
+
+  // point vertex
+  for(const Position3d& point : points){
+    int vertex_id = PointVertexId(point.id);
+    g2o::VertexPointXYZ* point_vertex = GetOrAddVertex<g2o::VertexPointXYZ>(_optimizer, vertex_id, _added_num);
+    point_vertex->setEstimate(point.p);
+    point_vertex->setFixed(point.fixed);
+    point_vertex->setMarginalized(!point.fixed);
+    _vertex_stamps[vertex_id] = _stamp;
+  }
+
+  // line vertex
+  for(const Line3d& line : lines){
+    int vertex_id = LineVertexId(line.id);
+    VertexLine3D* line_vertex = GetOrAddVertex<VertexLine3D>(_optimizer, vertex_id, _added_num);
+    line_vertex->setEstimate(line.line_3d);
+    line_vertex->setFixed(line.fixed);
+    line_vertex->setMarginalized(!line.fixed);
+    _vertex_stamps[vertex_id] = _stamp;
+  }
+
+  // point edges
+  std::vector<g2o::EdgeSE3ProjectXYZ*> mono_edges;
+  mono_edges.reserve(mono_point_constraints.size());
+  std::vector<g2o::EdgeStereoSE3ProjectXYZ*> stereo_edges;
+  stereo_edges.reserve(stereo_point_constraints.size());
+  std::vector<SwitchableHuberKernel*> kernels;
+  kernels.reserve(mono_point_constraints.size() + stereo_point_constraints.size() +
+      mono_line_constraints.size() + stereo_line_constraints.size());
+  const float thHuberMonoPoint = sqrt(cfg.mono_point);
+  const float thHuberStereoPoint = sqrt(cfg.stereo_point);
+
+  // mono point edges
+  for(const MonoPointConstraint& mpc : mono_point_constraints){
+    int frame_id = poses[mpc.pose_index].id;
+    int point_vertex_id = PointVertexId(points[mpc.point_index].id);
+    int64_t key = EdgeKey(point_vertex_id, frame_id);
+    EdgeRecord* record = FindEdge(key, MonoPointEdge);
+    if(!record){
+      g2o::EdgeSE3ProjectXYZ* e = new g2o::EdgeSE3ProjectXYZ();
+      e->setVertex(0, _optimizer.vertex(point_vertex_id));
+      e->setVertex(1, _optimizer.vertex(PoseVertexId(frame_id)));
+      e->setInformation(Eigen::Matrix2d::Identity());
+      e->fx = camera_list[mpc.camera_index]->Fx();
+      e->fy = camera_list[mpc.camera_index]->Fy();
+      e->cx = camera_list[mpc.camera_index]->Cx();
+      e->cy = camera_list[mpc.camera_index]->Cy();
+      record = AddEdge(key, MonoPointEdge, e, thHuberMonoPoint);
+    }
+
+    g2o::EdgeSE3ProjectXYZ* e = static_cast<g2o::EdgeSE3ProjectXYZ*>(record->edge);
+    e->setMeasurement(mpc.keypoint);
+    e->setLevel(0);
+    record->kernel->setDelta(thHuberMonoPoint);
+    record->kernel->SetEnabled(true);
+    kernels.push_back(record->kernel);
+    mono_edges.push_back(e);
+  }
+
+  // stereo point edges
+  for(const StereoPointConstraint& spc : stereo_point_constraints){
+    int frame_id = poses[spc.pose_index].id;
+    int point_vertex_id = PointVertexId(points[spc.point_index].id);
+    int64_t key = EdgeKey(point_vertex_id, frame_id);
+    EdgeRecord* record = FindEdge(key, StereoPointEdge);
+    if(!record){
+      g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
+      e->setVertex(0, _optimizer.vertex(point_vertex_id));
+      e->setVertex(1, _optimizer.vertex(PoseVertexId(frame_id)));
+      e->setInformation(Eigen::Matrix3d::Identity());
+      e->fx = camera_list[spc.camera_index]->Fx();
+      e->fy = camera_list[spc.camera_index]->Fy();
+      e->cx = camera_list[spc.camera_index]->Cx();
+      e->cy = camera_list[spc.camera_index]->Cy();
+      e->bf = camera_list[spc.camera_index]->BF();
+      record = AddEdge(key, StereoPointEdge, e, thHuberStereoPoint);
+    }
+
+    g2o::EdgeStereoSE3ProjectXYZ* e = static_cast<g2o::EdgeStereoSE3ProjectXYZ*>(record->edge);
+    e->setMeasurement(spc.keypoint);
+    e->setLevel(0);
+    record->kernel->setDelta(thHuberStereoPoint);
+    record->kernel->SetEnabled(true);
+    kernels.push_back(record->kernel);
+    stereo_edges.push_back(e);
+  }
+
+  // line edges
+  std::vector<EdgeSE3ProjectLine*> mono_line_edges;
+  mono_line_edges.reserve(mono_line_constraints.size());
+  std::vector<EdgeStereoSE3ProjectLine*> stereo_line_edges;
+  stereo_line_edges.reserve(stereo_line_constraints.size());
+  const float thHuberMonoLine = sqrt(cfg.mono_line);
+  const float thHuberStereoLine = sqrt(cfg.stereo_line);
+
+  // mono line edges
+  for(const MonoLineConstraint& mlc : mono_line_constraints){
+    int frame_id = poses[mlc.pose_index].id;
+    int line_vertex_id = LineVertexId(lines[mlc.line_index].id);
+    int64_t key = EdgeKey(line_vertex_id, frame_id);
+    EdgeRecord* record = FindEdge(key, MonoLineEdge);
+    if(!record){
+      EdgeSE3ProjectLine* e = new EdgeSE3ProjectLine();
+      e->setVertex(0, _optimizer.vertex(line_vertex_id));
+      e->setVertex(1, _optimizer.vertex(PoseVertexId(frame_id)));
+      e->setInformation(Eigen::Matrix2d::Identity() * 0.1);
+      double fx = camera_list[mlc.camera_index]->Fx();
+      double fy = camera_list[mlc.camera_index]->Fy();
+      double cx = camera_list[mlc.camera_index]->Cx();
+      double cy = camera_list[mlc.camera_index]->Cy();
+      e->fx = fx;
+      e->fy = fy;
+      e->Kv << -fy * cx, -fx * cy, fx * fy;
+      record = AddEdge(key, MonoLineEdge, e, thHuberMonoLine);
+    }
+
+    EdgeSE3ProjectLine* e = static_cast<EdgeSE3ProjectLine*>(record->edge);
+    e->setMeasurement(mlc.line_2d);
+    e->setLevel(0);
+    record->kernel->setDelta(thHuberMonoLine);
+    record->kernel->SetEnabled(true);
+    kernels.push_back(record->kernel);
+    mono_line_edges.push_back(e);
+  }
+
+  // stereo line edges
+  for(const StereoLineConstraint& slc : stereo_line_constraints){
+    int frame_id = poses[slc.pose_index].id;
+    int line_vertex_id = LineVertexId(lines[slc.line_index].id);
+    int64_t key = EdgeKey(line_vertex_id, frame_id);
+    EdgeRecord* record = FindEdge(key, StereoLineEdge);
+    if(!record){
+      EdgeStereoSE3ProjectLine* e = new EdgeStereoSE3ProjectLine();
+      e->setVertex(0, _optimizer.vertex(line_vertex_id));
+      e->setVertex(1, _optimizer.vertex(PoseVertexId(frame_id)));
+      e->setInformation(Eigen::Matrix4d::Identity() * 0.1);
+      double fx = camera_list[slc.camera_index]->Fx();
+      double fy = camera_list[slc.camera_index]->Fy();
+      double cx = camera_list[slc.camera_index]->Cx();
+      double cy = camera_list[slc.camera_index]->Cy();
+      double bf = camera_list[slc.camera_index]->BF();
+      e->fx = fx;
+      e->fy = fy;
+      e->b = bf / fx;
+      e->Kv << -fy * cx, -fx * cy, fx * fy;
+      record = AddEdge(key, StereoLineEdge, e, thHuberStereoLine);
+    }
+
+    EdgeStereoSE3ProjectLine* e = static_cast<EdgeStereoSE3ProjectLine*>(record->edge);
+    e->setMeasurement(slc.line_2d);
+    e->setLevel(0);
+    record->kernel->setDelta(thHuberStereoLine);
+    record->kernel->SetEnabled(true);
+    kernels.push_back(record->kernel);
+    stereo_line_edges.push_back(e);
+  }
+
+  RemoveStale();
+
+  // select the block solver, after RemoveStale the graph has line vertices exactly when lines is not
+  // empty, and BlockSolver_6_3 can only be used without them
+  ParallelLevenberg* algorithm = lines.empty() ? _point_algorithm.get() : _mixed_algorithm.get();
+  if(_optimizer.algorithm() != algorithm){
+    _optimizer.setAlgorithm(algorithm);
+  }
+
+  // solve
+  // outliers can not be told apart on estimates that were never optimized
+  _optimizer.initializeOptimization();
+  if(!_monitor->StartPass()){
+    _interrupted = true;
+    return false;
+  }
+  _optimizer.optimize(10);
+
+  // check inlier observations
+  for(size_t i=0; i < mono_edges.size(); i++){
+    g2o::EdgeSE3ProjectXYZ* e = mono_edges[i];
+    if(e->chi2() > cfg.mono_point || !e->isDepthPositive()){
+      e->setLevel(1);
+    }
+  }
+
+  for(size_t i=0; i < stereo_edges.size(); i++){
+    g2o::EdgeStereoSE3ProjectXYZ* e = stereo_edges[i];
+    if(e->chi2() > cfg.stereo_point || !e->isDepthPositive()){
+        e->setLevel(1);
+    }
+  }
+
+  for(size_t i=0; i < mono_line_edges.size(); i++){
+    EdgeSE3ProjectLine* e = mono_line_edges[i];
+    if(e->chi2() > cfg.mono_line){
+      e->setLevel(1);
+    }
+  }
+
+  for(size_t i=0; i < stereo_line_edges.size(); i++){
+    EdgeStereoSE3ProjectLine* e = stereo_line_edges[i];
+    if(e->chi2() > cfg.stereo_line){
+        e->setLevel(1);
+    }
+  }
+
+  for(SwitchableHuberKernel* kernel : kernels){
+    kernel->SetEnabled(false);
+  }
+
+  // optimize again without the outliers
+  _optimizer.initializeOptimization(0);
+  if(_monitor->StartPass()){
+    _optimizer.optimize(5);
+  }
+  _interrupted = _monitor->interrupted;
+
+  // check inlier observations
+  for(size_t i = 0; i < mono_edges.size(); i++){
+    g2o::EdgeSE3ProjectXYZ* e = mono_edges[i];
+    mono_point_constraints[i].inlier = (e->chi2() <= cfg.mono_point && e->isDepthPositive());
+  }
+
+  for(size_t i = 0; i < stereo_edges.size(); i++){
+    g2o::EdgeStereoSE3ProjectXYZ* e = stereo_edges[i];
+    stereo_point_constraints[i].inlier = (e->chi2() <= cfg.stereo_point && e->isDepthPositive());
+  }
+
+  for(size_t i = 0; i < mono_line_edges.size(); i++){
+    EdgeSE3ProjectLine* e = mono_line_edges[i];
+    mono_line_constraints[i].inlier = (e->chi2() <= cfg.mono_line);
+  }
+
+  for(size_t i = 0; i < stereo_line_edges.size(); i++){
+    EdgeStereoSE3ProjectLine* e = stereo_line_edges[i];
+    stereo_line_constraints[i].inlier = (e->chi2() <= cfg.stereo_line);
+  }
+
+  // Recover optimized data
+  // Keyframes
+  for(Pose3d& pose : poses){
+    g2o::VertexSE3Expmap* frame_vertex = static_cast<g2o::VertexSE3Expmap*>(_optimizer.vertex(PoseVertexId(pose.id)));
+    g2o::SE3Quat SE3quat = frame_vertex->estimate().inverse();
+    pose.p = SE3quat.translation();
+    pose.q = SE3quat.rotation();
+  }
+  // Points
+  for(Position3d& point : points){
+    g2o::VertexPointXYZ* point_vertex = static_cast<g2o::VertexPointXYZ*>(_optimizer.vertex(PointVertexId(point.id)));
+    point.p = point_vertex->estimate();
+  }
+
+  // Lines
+  for(Line3d& line : lines){
+    VertexLine3D* line_vertex = static_cast<VertexLine3D*>(_optimizer.vertex(LineVertexId(line.id)));
+    line.line_3d = line_vertex->estimate();
+  }
+  return true;
+}
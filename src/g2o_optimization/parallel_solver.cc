@@ -0,0 +1,104 @@
+#include "g2o_optimization/parallel_solver.h"
+
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+#include <g2o/core/robust_kernel.h>
+
+ParallelLevenberg::ParallelLevenberg(std::unique_ptr<g2o::Solver> solver):
+    g2o::OptimizationAlgorithmWithHessian(*solver.get()), _owned_solver(std::move(solver)), _thread_pool(nullptr),
+    _max_trials(10), _tau(1e-5), _good_step_lower_scale(1.0 / 3.0), _good_step_upper_scale(2.0 / 3.0),
+    _current_lambda(-1), _ni(2), _levenberg_iterations(0) {}
+
+g2o::OptimizationAlgorithm::SolverResult ParallelLevenberg::solve(int iteration, bool online){
+  if(iteration == 0 && !online){
+    if(!_solver.buildStructure()){
+      std::cout << "ParallelLevenberg: failure while building the structure" << std::endl;
+      return Fail;
+    }
+  }
+
+  double current_chi2 = ComputeActiveErrors();
+  _solver.buildSystem();
+
+  if(iteration == 0){
+    _current_lambda = ComputeLambdaInit();
+    _ni = 2;
+  }
+
+  double rho = 0;
+  _levenberg_iterations = 0;
+  do{
+    _optimizer->push();
+    _solver.setLambda(_current_lambda, true);
+    bool ok = _solver.solve();
+    _optimizer->update(_solver.x());
+    _solver.restoreDiagonal();
+
+    double chi2 = ok ? ComputeActiveErrors() : std::numeric_limits<double>::max();
+    double scale = ok ? ComputeScale() + 1e-3 : 1.0;
+    rho = (current_chi2 - chi2) / scale;
+
+    if(rho > 0 && std::isfinite(chi2) && ok){
+      // good step, decrease the damping
+      double alpha = 1.0 - std::pow(2 * rho - 1, 3);
+      alpha = std::min(alpha, _good_step_upper_scale);
+      _current_lambda *= std::max(_good_step_lower_scale, alpha);
+      _ni = 2;
+      current_chi2 = chi2;
+      _optimizer->discardTop();
+    }else{
+      _current_lambda *= _ni;
+      _ni *= 2;
+      _optimizer->pop();
+      if(!std::isfinite(_current_lambda)) break;
+    }
+    _levenberg_iterations++;
+  }while(rho < 0 && _levenberg_iterations < _max_trials && !_optimizer->terminate());
+
+  if(_levenberg_iterations == _max_trials || rho == 0 || !std::isfinite(_current_lambda)){
+    return Terminate;
+  }
+  return OK;
+}
+
+void ParallelLevenberg::printVerbose(std::ostream& os) const {
+  os << "\t schur= " << _solver.schur() << "\t lambda= " << _current_lambda
+     << "\t levenbergIter= " << _levenberg_iterations;
+}
+
+double ParallelLevenberg::ComputeActiveErrors(){
+  const g2o::SparseOptimizer::EdgeContainer& edges = _optimizer->activeEdges();
+  if(!_thread_pool){
+    _optimizer->computeActiveErrors();
+    return _optimizer->activeRobustChi2();
+  }
+
+  size_t range_num = _thread_pool->RangeNum(edges.size(), 512);
+  _thread_pool->ParallelFor(edges.size(), range_num, [&](size_t t, size_t begin, size_t end){
+    for(size_t k = begin; k < end; k++){
+      edges[k]->computeError();
+    }
+  });
+  return _optimizer->activeRobustChi2();
+}
+
+double ParallelLevenberg::ComputeLambdaInit() const {
+  double max_diagonal = 0;
+  for(g2o::OptimizableGraph::Vertex* v : _optimizer->indexMapping()){
+    int dim = v->dimension();
+    for(int j = 0; j < dim; j++){
+      max_diagonal = std::max(std::fabs(v->hessian(j, j)), max_diagonal);
+    }
+  }
+  return _tau * max_diagonal;
+}
+
+double ParallelLevenberg::ComputeScale() const {
+  double scale = 0;
+  for(size_t j = 0; j < _solver.vectorSize(); j++){
+    scale += _solver.x()[j] * (_current_lambda * _solver.x()[j] + _solver.b()[j]);
+  }
+  return scale;
+}
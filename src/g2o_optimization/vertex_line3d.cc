@@ -21,4 +21,25 @@ bool VertexLine3D::read(std::istream& is) {
 
 bool VertexLine3D::write(std::ostream& os) const {
   return g2o::internal::writeVector(os, _estimate);
-}
\ No newline at end of file
+}
+
+Eigen::Matrix<double, 6, 4> VertexLine3D::oplusJacobian() const {
+  // Line3D::oplus right-multiplies the orthonormal representation U = [w/|w|, d/|d|, (w x d)/|w x d|]
+  // by a rotation from the quaternion (., v0, v1, v2) and W by a 2d rotation of angle v3
+  Eigen::Vector3d w = _estimate.w();
+  Eigen::Vector3d d = _estimate.d();
+  double w_norm = w.norm();
+  double d_norm = d.norm();
+  Eigen::Vector3d u0 = w / w_norm;
+  Eigen::Vector3d u1 = d / d_norm;
+  Eigen::Vector3d u2 = w.cross(d).normalized();
+
+  Eigen::Matrix<double, 6, 4> J = Eigen::Matrix<double, 6, 4>::Zero();
+  J.block<3, 1>(0, 1) = -2.0 * w_norm * u2;
+  J.block<3, 1>(0, 2) = 2.0 * w_norm * u1;
+  J.block<3, 1>(0, 3) = -d_norm * u0;
+  J.block<3, 1>(3, 0) = 2.0 * d_norm * u2;
+  J.block<3, 1>(3, 2) = -2.0 * d_norm * u0;
+  J.block<3, 1>(3, 3) = w_norm * u1;
+  return J;
+}
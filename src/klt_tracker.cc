@@ -0,0 +1,159 @@
+#include "klt_tracker.h"
+
+#include "line_processor.h"
+
+KltTracker::KltTracker(const KltConfig& klt_config): _klt_config(klt_config){
+}
+
+void KltTracker::AddDetectedFrame(FramePtr frame, const cv::Mat& image, FramePtr ref_keyframe,
+    const std::vector<cv::DMatch>& matches){
+  _detected_frame = frame;
+  _detected_image = image;
+
+  Invalidate();
+  if(!ref_keyframe) return;
+  _ref_keyframe = ref_keyframe;
+  _image = image;
+
+  // points
+  std::vector<cv::KeyPoint>& keypoints = frame->GetAllKeypoints();
+  for(const cv::DMatch& match : matches){
+    _point_ids.push_back(match.queryIdx);
+    _points.push_back(keypoints[match.trainIdx].pt);
+  }
+
+  // lines
+  std::vector<int> line_matches;
+  MatchLines(ref_keyframe->GetPointsOnLines(), frame->GetPointsOnLines(), matches,
+      ref_keyframe->FeatureNum(), frame->FeatureNum(), line_matches);
+  const std::vector<Eigen::Vector4d>& lines = frame->GatAllLines();
+  for(size_t i = 0; i < line_matches.size(); i++){
+    int j = line_matches[i];
+    if(j < 0) continue;
+    _line_ids.push_back(i);
+    _line_endpoints.emplace_back(lines[j](0), lines[j](1));
+    _line_endpoints.emplace_back(lines[j](2), lines[j](3));
+  }
+}
+
+bool KltTracker::SetReference(FramePtr ref_keyframe){
+  if(!ref_keyframe) return false;
+  if(_ref_keyframe == ref_keyframe && !_points.empty()) return true;
+  if(_detected_frame == ref_keyframe){
+    ResetFromKeyframe();
+    return true;
+  }
+  Invalidate();
+  return false;
+}
+
+int KltTracker::Track(const cv::Mat& image, Eigen::Matrix<double, 259, Eigen::Dynamic>& features,
+    std::vector<Eigen::Vector4d>& lines, std::vector<std::map<int, double>>& points_on_lines,
+    std::vector<cv::DMatch>& matches){
+  matches.clear();
+  lines.clear();
+  points_on_lines.clear();
+  if(!_ref_keyframe || _points.empty()) return 0;
+
+  // track points and line endpoints together, and check them backward
+  size_t point_num = _points.size();
+  std::vector<cv::Point2f> prev_points(_points);
+  prev_points.insert(prev_points.end(), _line_endpoints.begin(), _line_endpoints.end());
+  std::vector<cv::Point2f> next_points, back_points;
+  std::vector<uchar> status, back_status;
+  std::vector<float> error;
+  cv::Size window_size(_klt_config.window_size, _klt_config.window_size);
+  cv::calcOpticalFlowPyrLK(_image, image, prev_points, next_points, status, error,
+      window_size, _klt_config.pyramid_levels);
+  cv::calcOpticalFlowPyrLK(image, _image, next_points, back_points, back_status, error,
+      window_size, _klt_config.pyramid_levels);
+
+  const float fb_thr_square = _klt_config.fb_threshold * _klt_config.fb_threshold;
+  std::vector<bool> valid(prev_points.size());
+  for(size_t i = 0; i < prev_points.size(); i++){
+    cv::Point2f d = back_points[i] - prev_points[i];
+    const cv::Point2f& p = next_points[i];
+    bool in_image = (p.x >= 0 && p.y >= 0 && p.x < image.cols && p.y < image.rows);
+    valid[i] = status[i] && back_status[i] && in_image && (d.dot(d) < fb_thr_square);
+  }
+
+  // points keep the score and descriptor of the reference keyframe
+  const Eigen::Matrix<double, 259, Eigen::Dynamic>& ref_features = _ref_keyframe->GetAllFeatures();
+  std::vector<int> new_point_indexes(ref_features.cols(), -1);
+  int tracked_num = std::count(valid.begin(), valid.begin() + point_num, true);
+  features.resize(259, tracked_num);
+  int k = 0;
+  for(size_t i = 0; i < point_num; i++){
+    if(!valid[i]) continue;
+    int ref_idx = _point_ids[i];
+    features.col(k) = ref_features.col(ref_idx);
+    features(1, k) = next_points[i].x;
+    features(2, k) = next_points[i].y;
+    matches.emplace_back(ref_idx, k, 0.0f);
+    new_point_indexes[ref_idx] = k;
+    _points[k] = next_points[i];
+    _point_ids[k] = ref_idx;
+    k++;
+  }
+  _points.resize(tracked_num);
+  _point_ids.resize(tracked_num);
+
+  // lines keep the points-on-line relation of the reference keyframe
+  const std::vector<std::map<int, double>>& ref_points_on_lines = _ref_keyframe->GetPointsOnLines();
+  size_t l = 0;
+  for(size_t i = 0; i < _line_ids.size(); i++){
+    size_t e1 = point_num + 2 * i;
+    size_t e2 = e1 + 1;
+    if(!valid[e1] || !valid[e2]) continue;
+    lines.emplace_back(next_points[e1].x, next_points[e1].y, next_points[e2].x, next_points[e2].y);
+
+    std::map<int, double> points_on_line;
+    for(auto& kv : ref_points_on_lines[_line_ids[i]]){
+      int new_idx = new_point_indexes[kv.first];
+      if(new_idx >= 0) points_on_line[new_idx] = kv.second;
+    }
+    points_on_lines.push_back(points_on_line);
+
+    _line_ids[l] = _line_ids[i];
+    _line_endpoints[2*l] = next_points[e1];
+    _line_endpoints[2*l+1] = next_points[e2];
+    l++;
+  }
+  _line_ids.resize(l);
+  _line_endpoints.resize(2*l);
+
+  _image = image;
+  return tracked_num;
+}
+
+FramePtr KltTracker::GetReference(){
+  return _ref_keyframe;
+}
+
+void KltTracker::Invalidate(){
+  _ref_keyframe = nullptr;
+  _image = cv::Mat();
+  _points.clear();
+  _point_ids.clear();
+  _line_endpoints.clear();
+  _line_ids.clear();
+}
+
+void KltTracker::ResetFromKeyframe(){
+  Invalidate();
+  _ref_keyframe = _detected_frame;
+  _image = _detected_image;
+
+  std::vector<cv::KeyPoint>& keypoints = _ref_keyframe->GetAllKeypoints();
+  for(size_t i = 0; i < keypoints.size(); i++){
+    _point_ids.push_back(i);
+    _points.push_back(keypoints[i].pt);
+  }
+
+  const std::vector<Eigen::Vector4d>& lines = _ref_keyframe->GatAllLines();
+  for(size_t i = 0; i < lines.size(); i++){
+    _line_ids.push_back(i);
+    _line_endpoints.emplace_back(lines[i](0), lines[i](1));
+    _line_endpoints.emplace_back(lines[i](2), lines[i](3));
+  }
+}
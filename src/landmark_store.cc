@@ -0,0 +1,56 @@
+#include "landmark_store.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+LandmarkStore::Chunk::Chunk(): positions(ChunkSize, Eigen::Vector3d::Zero()), 
+    descriptors(ChunkSize * DescriptorDim, 0.0f), types(ChunkSize, 0), obverser_nums(ChunkSize, 0){
+}
+
+LandmarkStore::LandmarkStore(): _slot_num(0){
+  _chunks.reserve(MaxChunkNum);
+}
+
+LandmarkStore& LandmarkStore::Instance(){
+  static LandmarkStore store;
+  return store;
+}
+
+size_t LandmarkStore::Allocate(){
+  std::lock_guard<std::mutex> lock(_mutex);
+  size_t slot;
+  if(!_free_slots.empty()){
+    slot = _free_slots.back();
+    _free_slots.pop_back();
+  }else{
+    if(_slot_num == _chunks.size() * ChunkSize){
+      // readers index the chunk table without the lock, so it can not be reallocated. the table
+      // covers about 17GB of landmarks, running out of it is a fatal error
+      if(_chunks.size() == MaxChunkNum){
+        std::cerr << "Landmark store is full, " << _slot_num << " mappoints are allocated" << std::endl;
+        std::abort();
+      }
+      _chunks.emplace_back(new Chunk());
+    }
+    slot = _slot_num++;
+  }
+
+  Chunk& chunk = *_chunks[slot / ChunkSize];
+  size_t i = slot % ChunkSize;
+  chunk.positions[i].setZero();
+  std::fill_n(chunk.descriptors.begin() + i * DescriptorDim, DescriptorDim, 0.0f);
+  chunk.types[i] = 0;
+  chunk.obverser_nums[i] = 0;
+  return slot;
+}
+
+void LandmarkStore::Release(size_t slot){
+  std::lock_guard<std::mutex> lock(_mutex);
+  _free_slots.push_back(slot);
+}
+
+size_t LandmarkStore::Capacity(){
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _slot_num;
+}
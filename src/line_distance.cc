@@ -0,0 +1,202 @@
+#include "line_distance.h"
+
+#include <math.h>
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LINE_DISTANCE_HAS_AVX2 1
+#include <immintrin.h>
+#else
+#define LINE_DISTANCE_HAS_AVX2 0
+#endif
+
+namespace {
+
+struct Segment2DParams{
+  float x1, y1, x2, y2;
+  float a, b, c;          // a * x + b * y + c = 0
+  float norm;             // sqrt(a^2 + b^2)
+  float length_square;
+  float min_x, max_x, min_y, max_y;
+  float margin_square;
+};
+
+Segment2DParams MakeSegment2DParams(const Eigen::Vector4f& line, float margin){
+  Segment2DParams s;
+  s.x1 = line(0);
+  s.y1 = line(1);
+  s.x2 = line(2);
+  s.y2 = line(3);
+  s.a = s.y2 - s.y1;
+  s.b = s.x1 - s.x2;
+  s.c = s.x2 * s.y1 - s.x1 * s.y2;
+  s.length_square = s.a * s.a + s.b * s.b;
+  s.norm = std::sqrt(s.length_square);
+  s.min_x = std::min(s.x1, s.x2) - margin;
+  s.max_x = std::max(s.x1, s.x2) + margin;
+  s.min_y = std::min(s.y1, s.y2) - margin;
+  s.max_y = std::max(s.y1, s.y2) + margin;
+  s.margin_square = margin * margin;
+  return s;
+}
+
+void PointSegmentDistance2DScalar(const Segment2DParams& s, const float* x, const float* y,
+    size_t begin, size_t end, float* dist, uint8_t* inside){
+  for(size_t i = begin; i < end; i++){
+    const float px = x[i];
+    const float py = y[i];
+    dist[i] = std::abs(s.a * px + s.b * py + s.c) / s.norm;
+
+    const bool in_box = (px >= s.min_x) & (px <= s.max_x) & (py >= s.min_y) & (py <= s.max_y);
+    const float dx1 = s.x1 - px, dy1 = s.y1 - py;
+    const float dx2 = s.x2 - px, dy2 = s.y2 - py;
+    const float side1 = dx1 * dx1 + dy1 * dy1;
+    const float side2 = dx2 * dx2 + dy2 * dy2;
+    const bool near_endpoint = (side1 <= s.margin_square) | (side2 <= s.margin_square);
+    const bool projected_inside = (side1 < s.length_square + side2) & (side2 < s.length_square + side1);
+    inside[i] = static_cast<uint8_t>(in_box & (near_endpoint | projected_inside));
+  }
+}
+
+size_t PointLineDistance3DScalar(const Eigen::Vector3f& p, const Eigen::Vector3f& v, const float* x,
+    const float* y, const float* z, size_t begin, size_t end, float thr, float* dist, uint8_t* inlier){
+  size_t inlier_num = 0;
+  for(size_t i = begin; i < end; i++){
+    const float dx = x[i] - p(0);
+    const float dy = y[i] - p(1);
+    const float dz = z[i] - p(2);
+    const float cx = v(1) * dz - v(2) * dy;
+    const float cy = v(2) * dx - v(0) * dz;
+    const float cz = v(0) * dy - v(1) * dx;
+    dist[i] = std::sqrt(cx * cx + cy * cy + cz * cz);
+    inlier[i] = static_cast<uint8_t>(dist[i] < thr);
+    inlier_num += inlier[i];
+  }
+  return inlier_num;
+}
+
+#if LINE_DISTANCE_HAS_AVX2
+
+inline void StoreMask8(int bits, uint8_t* dst){
+  for(int k = 0; k < 8; k++){
+    dst[k] = static_cast<uint8_t>((bits >> k) & 1);
+  }
+}
+
+// no FMA on purpose: results stay bit-identical to the scalar path
+__attribute__((target("avx2")))
+size_t PointSegmentDistance2DAVX2(const Segment2DParams& s, const float* x, const float* y, size_t n,
+    float* dist, uint8_t* inside){
+  const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+  const __m256 a = _mm256_set1_ps(s.a);
+  const __m256 b = _mm256_set1_ps(s.b);
+  const __m256 c = _mm256_set1_ps(s.c);
+  const __m256 norm = _mm256_set1_ps(s.norm);
+  const __m256 x1 = _mm256_set1_ps(s.x1);
+  const __m256 y1 = _mm256_set1_ps(s.y1);
+  const __m256 x2 = _mm256_set1_ps(s.x2);
+  const __m256 y2 = _mm256_set1_ps(s.y2);
+  const __m256 min_x = _mm256_set1_ps(s.min_x);
+  const __m256 max_x = _mm256_set1_ps(s.max_x);
+  const __m256 min_y = _mm256_set1_ps(s.min_y);
+  const __m256 max_y = _mm256_set1_ps(s.max_y);
+  const __m256 length_square = _mm256_set1_ps(s.length_square);
+  const __m256 margin_square = _mm256_set1_ps(s.margin_square);
+
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8){
+    const __m256 px = _mm256_loadu_ps(x + i);
+    const __m256 py = _mm256_loadu_ps(y + i);
+
+    __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, px), _mm256_mul_ps(b, py)), c);
+    d = _mm256_div_ps(_mm256_andnot_ps(sign_mask, d), norm);
+    _mm256_storeu_ps(dist + i, d);
+
+    __m256 in_box = _mm256_and_ps(_mm256_cmp_ps(px, min_x, _CMP_GE_OQ), _mm256_cmp_ps(px, max_x, _CMP_LE_OQ));
+    in_box = _mm256_and_ps(in_box, _mm256_cmp_ps(py, min_y, _CMP_GE_OQ));
+    in_box = _mm256_and_ps(in_box, _mm256_cmp_ps(py, max_y, _CMP_LE_OQ));
+
+    const __m256 dx1 = _mm256_sub_ps(x1, px);
+    const __m256 dy1 = _mm256_sub_ps(y1, py);
+    const __m256 dx2 = _mm256_sub_ps(x2, px);
+    const __m256 dy2 = _mm256_sub_ps(y2, py);
+    const __m256 side1 = _mm256_add_ps(_mm256_mul_ps(dx1, dx1), _mm256_mul_ps(dy1, dy1));
+    const __m256 side2 = _mm256_add_ps(_mm256_mul_ps(dx2, dx2), _mm256_mul_ps(dy2, dy2));
+    const __m256 near_endpoint = _mm256_or_ps(_mm256_cmp_ps(side1, margin_square, _CMP_LE_OQ),
+        _mm256_cmp_ps(side2, margin_square, _CMP_LE_OQ));
+    const __m256 projected_inside = _mm256_and_ps(
+        _mm256_cmp_ps(side1, _mm256_add_ps(length_square, side2), _CMP_LT_OQ),
+        _mm256_cmp_ps(side2, _mm256_add_ps(length_square, side1), _CMP_LT_OQ));
+    const __m256 mask = _mm256_and_ps(in_box, _mm256_or_ps(near_endpoint, projected_inside));
+    StoreMask8(_mm256_movemask_ps(mask), inside + i);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+size_t PointLineDistance3DAVX2(const Eigen::Vector3f& p, const Eigen::Vector3f& v, const float* x,
+    const float* y, const float* z, size_t n, float thr, float* dist, uint8_t* inlier, size_t& inlier_num){
+  const __m256 px = _mm256_set1_ps(p(0));
+  const __m256 py = _mm256_set1_ps(p(1));
+  const __m256 pz = _mm256_set1_ps(p(2));
+  const __m256 vx = _mm256_set1_ps(v(0));
+  const __m256 vy = _mm256_set1_ps(v(1));
+  const __m256 vz = _mm256_set1_ps(v(2));
+  const __m256 thr8 = _mm256_set1_ps(thr);
+
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8){
+    const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+    const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+    const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), pz);
+    const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(vy, dz), _mm256_mul_ps(vz, dy));
+    const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(vz, dx), _mm256_mul_ps(vx, dz));
+    const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(vx, dy), _mm256_mul_ps(vy, dx));
+    const __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz)));
+    _mm256_storeu_ps(dist + i, d);
+
+    const int bits = _mm256_movemask_ps(_mm256_cmp_ps(d, thr8, _CMP_LT_OQ));
+    StoreMask8(bits, inlier + i);
+    inlier_num += __builtin_popcount(bits);
+  }
+  return i;
+}
+
+#endif  // LINE_DISTANCE_HAS_AVX2
+
+}  // namespace
+
+bool LineDistanceUseAVX2(){
+#if LINE_DISTANCE_HAS_AVX2
+  static const bool use_avx2 = __builtin_cpu_supports("avx2");
+  return use_avx2;
+#else
+  return false;
+#endif
+}
+
+void PointSegmentDistance2D(const Eigen::Vector4f& line, const float* x, const float* y, size_t n,
+    float margin, float* dist, uint8_t* inside){
+  const Segment2DParams s = MakeSegment2DParams(line, margin);
+  size_t begin = 0;
+#if LINE_DISTANCE_HAS_AVX2
+  if(LineDistanceUseAVX2()){
+    begin = PointSegmentDistance2DAVX2(s, x, y, n, dist, inside);
+  }
+#endif
+  PointSegmentDistance2DScalar(s, x, y, begin, n, dist, inside);
+}
+
+size_t PointLineDistance3D(const Eigen::Vector3f& point, const Eigen::Vector3f& direction,
+    const float* x, const float* y, const float* z, size_t n, float thr, float* dist, uint8_t* inlier){
+  size_t begin = 0;
+  size_t inlier_num = 0;
+#if LINE_DISTANCE_HAS_AVX2
+  if(LineDistanceUseAVX2()){
+    begin = PointLineDistance3DAVX2(point, direction, x, y, z, n, thr, dist, inlier, inlier_num);
+  }
+#endif
+  inlier_num += PointLineDistance3DScalar(point, direction, x, y, z, begin, n, thr, dist, inlier);
+  return inlier_num;
+}
@@ -1,11 +1,14 @@
 #include "line_processor.h"
 
+#include <algorithm>
 #include <math.h>
 #include <float.h>
 #include <iostream>
 #include <numeric>
+#include <thread>
 
 #include "camera.h"
+#include "line_distance.h"
 #include "timer.h"
 
 void FilterShortLines(std::vector<Eigen::Vector4f>& lines, float length_thr){
@@ -39,54 +42,42 @@ void FilterShortLines(std::vector<Eigen::Vector4d>& lines, float length_thr){
 }
 
 float PointLineDistance(Eigen::Vector4f line, Eigen::Vector2f point){
-  float x0 = point(0);
-  float y0 = point(1);
-  float x1 = line(0);
-  float y1 = line(1);
-  float x2 = line(2);
-  float y2 = line(3);
-  float d = (std::fabs((y2 - y1) * x0 +(x1 - x2) * y0 + ((x2 * y1) -(x1 * y2)))) / (std::sqrt(std::pow(y2 - y1, 2) + std::pow(x1 - x2, 2)));
-  return d;
+  float a = line(3) - line(1);
+  float b = line(0) - line(2);
+  float c = line(2) * line(1) - line(0) * line(3);
+  return std::abs(a * point(0) + b * point(1) + c) / std::sqrt(a * a + b * b);
 }
 
 double CVPointLineDistance3D(const std::vector<cv::Point3f> points, const cv::Vec6f& line, std::vector<float>& dist){
-  float px = line[3], py = line[4], pz = line[5];
-  float vx = line[0], vy = line[1], vz = line[2];
-  dist.resize(points.size());
-  double sum_dist = 0.;
-  float x, y, z;
-  Eigen::Vector3f p;
-
-  for(int j = 0; j < points.size(); j++){
-    x = points[j].x - px;
-    y = points[j].y - py;
-    z = points[j].z - pz;
-
-   // cross 
-    p(0) = vy * z - vz * y;
-    p(1) = vz * x - vx * z;
-    p(2) = vx * y - vy * x;
-
-    dist[j] = p.norm();
-    sum_dist += dist[j];
+  size_t point_num = points.size();
+  PointBlock3f block;
+  block.resize(point_num);
+  for(size_t i = 0; i < point_num; i++){
+    block.x[i] = points[i].x;
+    block.y[i] = points[i].y;
+    block.z[i] = points[i].z;
   }
 
-  return sum_dist;
+  dist.resize(point_num);
+  std::vector<uint8_t> inliers(point_num);
+  Eigen::Vector3f line_point(line[3], line[4], line[5]);
+  Eigen::Vector3f line_direction(line[0], line[1], line[2]);
+  PointLineDistance3D(line_point, line_direction, block.x.data(), block.y.data(), block.z.data(), 
+      point_num, FLT_MAX, dist.data(), inliers.data());
+  return std::accumulate(dist.begin(), dist.end(), 0.0);
 }
 
 void EigenPointLineDistance3D(
     const std::vector<Eigen::Vector3d>& points, const Vector6d& line, std::vector<double>& dist){
-  Eigen::Vector3d pl = line.head(3);
-  Eigen::Vector3d v = line.tail(3);
-  Eigen::Vector3d dp;
-  Eigen::Vector3d p;
+  // kept in double, without the float round trip and the blocks of PointLineDistance3D
   size_t point_num = points.size();
   dist.resize(point_num);
-  for(size_t i = 0; i < point_num; i++){
-    dp = points[i] - pl;
-    p = v.cross(dp);
-    dist[i] = p.norm();
-  }
+  if(point_num == 0) return;
+  Eigen::Map<const Eigen::Matrix3Xd> point_matrix(points[0].data(), 3, point_num);
+  Eigen::Map<Eigen::RowVectorXd> dist_map(dist.data(), point_num);
+  Eigen::Vector3d line_point = line.head(3);
+  Eigen::Vector3d line_direction = line.tail(3);
+  dist_map = (point_matrix.colwise() - line_point).colwise().cross(line_direction).colwise().norm();
 }
 
 float AngleDiff(float& angle1, float& angle2){
@@ -162,58 +153,55 @@ Eigen::Vector4f MergeTwoLines(const Eigen::Vector4f& line1, const Eigen::Vector4
 
 void AssignPointsToLines(std::vector<Eigen::Vector4d>& lines, Eigen::Matrix<double, 259, Eigen::Dynamic>& points, 
     std::vector<std::map<int, double>>& relation){
-  Eigen::Array2Xd point_array = points.middleRows(1, 2).array();
-  Eigen::Array4Xd line_array = Eigen::Map<Eigen::Array4Xd, Eigen::Unaligned>(lines[0].data(), 4, lines.size());
-
-  Eigen::ArrayXd x = point_array.row(0);
-  Eigen::ArrayXd y = point_array.row(1); 
-
-  Eigen::ArrayXd x1 = line_array.row(0);
-  Eigen::ArrayXd y1 = line_array.row(1);
-  Eigen::ArrayXd x2 = line_array.row(2);
-  Eigen::ArrayXd y2 = line_array.row(3);
-
-  Eigen::ArrayXd A = y2 - y1;
-  Eigen::ArrayXd B = x1 - x2;
-  Eigen::ArrayXd C = x2 * y1 - x1 * y2;
-  Eigen::ArrayXd D = (A.square() + B.square()).sqrt();
+  const float margin = 3;
+  size_t point_num = points.cols();
+  PointBlock2f block;
+  block.resize(point_num);
+  for(size_t j = 0; j < point_num; j++){
+    block.x[j] = points(1, j);
+    block.y[j] = points(2, j);
+  }
 
+  std::vector<float> dist(point_num);
+  std::vector<uint8_t> inside(point_num);
   relation.clear();
   relation.reserve(lines.size());
-  for(int i = 0, line_num = lines.size(); i < line_num; i++){
+  for(auto& line : lines){
+    PointSegmentDistance2D(line.cast<float>(), block.x.data(), block.y.data(), point_num, margin, 
+        dist.data(), inside.data());
+
     std::map<int, double> points_on_line;
-    for(int j = 0, point_num = points.cols(); j < point_num; j++){
-      // filter by x, y
-      double lx1 = x1(i);
-      double ly1 = y1(i);
-      double lx2 = x2(i);
-      double ly2 = y2(i);
-      double px = x(j);
-      double py = y(j);
-      
-      double min_lx = lx1;
-      double max_lx = lx2;
-      double min_ly = ly1;
-      double max_ly = ly2;
-      if(lx1 > lx2) std::swap(min_lx, max_lx);
-      if(ly1 > ly2) std::swap(min_ly, max_ly);
-      if(px < min_lx - 3 || px > max_lx + 3 || py < min_ly - 3 || py > max_ly + 3) continue;
-
-      // check distance
-      float pl_distance = std::abs((A(i) * px + B(i) * py + C(i))) / D(i);
-      if(pl_distance > 3) continue;
-
-      double side1 = std::pow((lx1 - px), 2) + std::pow((ly1 - py), 2);
-      double side2 = std::pow((lx2 - px), 2) + std::pow((ly2 - py), 2);
-      double line_side = std::pow(D(i), 2);
-      if(side1 <= 9 || side2 <= 9 || ((side1 < line_side + side2) && (side2 < line_side + side1))){
-        points_on_line[j] = pl_distance;
+    for(size_t j = 0; j < point_num; j++){
+      if(inside[j] && dist[j] <= margin){
+        points_on_line.emplace_hint(points_on_line.end(), j, dist[j]);
       }
     }
     relation.push_back(points_on_line);
   }
 }
 
+// point -> lines lookup in compressed form, lines of point i are lines[offsets[i]] ... lines[offsets[i+1]-1]
+static void IndexPointsOnLines(const std::vector<std::map<int, double>>& points_on_lines, size_t point_num,
+    std::vector<int>& offsets, std::vector<int>& lines){
+  offsets.assign(point_num + 1, 0);
+  for(size_t i = 0; i < points_on_lines.size(); i++){
+    for(auto& kv : points_on_lines[i]){
+      offsets[kv.first + 1]++;
+    }
+  }
+  for(size_t i = 0; i < point_num; i++){
+    offsets[i + 1] += offsets[i];
+  }
+
+  lines.resize(offsets[point_num]);
+  std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+  for(size_t i = 0; i < points_on_lines.size(); i++){
+    for(auto& kv : points_on_lines[i]){
+      lines[fill[kv.first]++] = i;
+    }
+  }
+}
+
 void MatchLines(const std::vector<std::map<int, double>>& points_on_line0, 
     const std::vector<std::map<int, double>>& points_on_line1, const std::vector<cv::DMatch>& point_matches, 
     size_t point_num0, size_t point_num1, std::vector<int>& line_matches){
@@ -226,51 +214,54 @@ void MatchLines(const std::vector<std::map<int, double>>& points_on_line0,
   }
   if(point_num0 == 0 || point_num1 == 0 || line_num0 == 0 || line_num1 == 0) return;
 
-  std::vector<std::vector<int>> assigned_lines0, assigned_lines1;
-  assigned_lines0.resize(point_num0);
-  assigned_lines1.resize(point_num1);
-  for(size_t i = 0; i < points_on_line0.size(); i++){
-    for(auto& kv : points_on_line0[i]){
-      assigned_lines0[kv.first].push_back(i);
-    }
-  }
-  
-  for(size_t i = 0; i < points_on_line1.size(); i++){
-    for(auto& kv : points_on_line1[i]){
-      assigned_lines1[kv.first].push_back(i);
-    }
-  }
+  std::vector<int> offsets0, offsets1, assigned_lines0, assigned_lines1;
+  IndexPointsOnLines(points_on_line0, point_num0, offsets0, assigned_lines0);
+  IndexPointsOnLines(points_on_line1, point_num1, offsets1, assigned_lines1);
 
-  // fill in matching matrix
-  Eigen::MatrixXi matching_matrix = Eigen::MatrixXi::Zero(line_num0, line_num1);
+  // one vote per (l0, l1) pair sharing a matched point, only non-zero entries are stored
+  std::vector<std::pair<int, int>> votes;
   for(auto& point_match : point_matches){
     int idx0 = point_match.queryIdx;
     int idx1 = point_match.trainIdx;
-
-    for(auto& l0 : assigned_lines0[idx0]){
-      for(auto& l1 : assigned_lines1[idx1]){
-        matching_matrix(l0, l1) += 1;
+    for(int a = offsets0[idx0]; a < offsets0[idx0+1]; a++){
+      for(int b = offsets1[idx1]; b < offsets1[idx1+1]; b++){
+        votes.emplace_back(assigned_lines0[a], assigned_lines1[b]);
       }
     }
   }
+  if(votes.empty()) return;
+  std::sort(votes.begin(), votes.end());
+
+  // best candidate of every line, ties go to the smaller index
+  std::vector<int> row_max_value(line_num0, 0), row_max_location(line_num0, -1);
+  std::vector<int> col_max_value(line_num1, 0), col_max_location(line_num1, -1);
+  for(size_t i = 0; i < votes.size();){
+    size_t k = i + 1;
+    while(k < votes.size() && votes[k] == votes[i]) k++;
+    int l0 = votes[i].first;
+    int l1 = votes[i].second;
+    int count = k - i;
+    if(count > row_max_value[l0]){
+      row_max_value[l0] = count;
+      row_max_location[l0] = l1;
+    }
+    if(count > col_max_value[l1]){
+      col_max_value[l1] = count;
+      col_max_location[l1] = l0;
+    }
+    i = k;
+  }
 
   // find good matches
-  int line_match_num = 0;
-  std::vector<int> row_max_value(line_num0), col_max_value(line_num1);
-  std::vector<Eigen::VectorXi::Index> row_max_location(line_num0), col_max_location(line_num1);
-  for(size_t i = 0; i < line_num0; i++){
-    row_max_value[i] = matching_matrix.row(i).maxCoeff(&row_max_location[i]);
-  }
   for(size_t j = 0; j < line_num1; j++){
-    Eigen::VectorXi::Index col_max_location;
-    int col_max_val = matching_matrix.col(j).maxCoeff(&col_max_location);
-    if(col_max_val < 2 || row_max_location[col_max_location] != j) continue;
+    int col_max_val = col_max_value[j];
+    int l0 = col_max_location[j];
+    if(col_max_val < 2 || row_max_location[l0] != (int)j) continue;
 
-    float score = (float)(col_max_val * col_max_val) / std::min(points_on_line0[col_max_location].size(), points_on_line1[j].size());
+    float score = (float)(col_max_val * col_max_val) / std::min(points_on_line0[l0].size(), points_on_line1[j].size());
     if(score < 0.8) continue;
 
-    line_matches[col_max_location] = j;
-    line_match_num++;
+    line_matches[l0] = j;
   }
 }
 
@@ -447,6 +438,13 @@ bool Point2DTo3D(const Eigen::Vector3d& anchor_point_3d1, const Eigen::Vector3d&
 LineDetector::LineDetector(const LineDetectorConfig &line_detector_config): _line_detector_config(line_detector_config){
   fld = cv::ximgproc::createFastLineDetector(line_detector_config.length_threshold, line_detector_config.distance_threshold, 
       line_detector_config.canny_th1, line_detector_config.canny_th2, line_detector_config.canny_aperture_size, false);
+
+  // detectors are not shared between threads, so each stripe gets its own
+  for(int i = 0; i < line_detector_config.tile_num && line_detector_config.tile_num > 1; i++){
+    tile_flds.push_back(cv::ximgproc::createFastLineDetector(line_detector_config.length_threshold, 
+        line_detector_config.distance_threshold, line_detector_config.canny_th1, line_detector_config.canny_th2, 
+        line_detector_config.canny_aperture_size, false));
+  }
 }
 
 void LineDetector::LineExtractor(const cv::Mat& image, std::vector<Eigen::Vector4d>& lines){
@@ -454,9 +452,16 @@ void LineDetector::LineExtractor(const cv::Mat& image, std::vector<Eigen::Vector
   std::vector<cv::Vec4f> cv_lines;
   cv::Mat smaller_image;
   cv::resize(image, smaller_image, cv::Size(), 0.5, 0.5, cv::INTER_LINEAR);
-  fld->detect(smaller_image, cv_lines);
-  for(auto& cv_line : cv_lines){
-    source_lines.emplace_back(cv_line[0]*2, cv_line[1]*2, cv_line[2]*2, cv_line[3]*2);
+  if(tile_flds.size() > 1){
+    TiledDetect(smaller_image, source_lines);
+    for(auto& line : source_lines){
+      line *= 2;
+    }
+  }else{
+    fld->detect(smaller_image, cv_lines);
+    for(auto& cv_line : cv_lines){
+      source_lines.emplace_back(cv_line[0]*2, cv_line[1]*2, cv_line[2]*2, cv_line[3]*2);
+    }
   }
 
   if(_line_detector_config.do_merge){
@@ -476,177 +481,289 @@ void LineDetector::LineExtractor(const cv::Mat& image, std::vector<Eigen::Vector
   }
 }
 
-void LineDetector::MergeLines(std::vector<Eigen::Vector4f>& source_lines, std::vector<Eigen::Vector4f>& dst_lines,
-    float angle_threshold, float distance_threshold, float endpoint_threshold){
+// whether two fragments found in neighboring stripes are parts of one segment cut by a seam: almost
+// parallel, the endpoints of each within a pixel of the other and no gap between them along the line.
+// thresholds are in pixels of the half resolution image
+static bool FragmentsToStitch(const Eigen::Vector4f& line1, const Eigen::Vector4f& line2){
+  const float sin_angle_thr = 0.02;
+  const float distance_thr = 1.5;
+  const float gap_thr = 2.0;
+
+  Eigen::Vector2f d1 = line1.tail<2>() - line1.head<2>();
+  Eigen::Vector2f d2 = line2.tail<2>() - line2.head<2>();
+  float length1 = d1.norm();
+  float length2 = d2.norm();
+  if(length1 < 1e-3 || length2 < 1e-3) return false;
+  d1 /= length1;
+  d2 /= length2;
+  if(std::abs(d1(0) * d2(1) - d1(1) * d2(0)) > sin_angle_thr) return false;
+
+  if(PointLineDistance(line1, line2.head<2>()) > distance_thr || PointLineDistance(line1, line2.tail<2>()) > distance_thr ||
+      PointLineDistance(line2, line1.head<2>()) > distance_thr || PointLineDistance(line2, line1.tail<2>()) > distance_thr){
+    return false;
+  }
 
-  size_t source_line_num = source_lines.size();
-  Eigen::Array4Xf line_array = Eigen::Map<Eigen::Array4Xf, Eigen::Unaligned>(source_lines[0].data(), 4, source_lines.size());
-  Eigen::ArrayXf x1 = line_array.row(0);
-  Eigen::ArrayXf y1 = line_array.row(1);
-  Eigen::ArrayXf x2 = line_array.row(2);
-  Eigen::ArrayXf y2 = line_array.row(3);
-
-  Eigen::ArrayXf dx = x2 - x1;
-  Eigen::ArrayXf dy = y2 - y1;
-  Eigen::ArrayXf eigen_angles = (dy / dx).atan();
-  Eigen::ArrayXf length = (dx * dx + dy * dy).sqrt();
+  // intervals along line1, negative gaps are overlaps
+  float begin2 = d1.dot(line2.head<2>() - line1.head<2>());
+  float end2 = d1.dot(line2.tail<2>() - line1.head<2>());
+  if(begin2 > end2) std::swap(begin2, end2);
+  float gap = std::max(begin2 - length1, -end2);
+  return gap <= gap_thr;
+}
 
-  std::vector<float> angles(&eigen_angles[0], eigen_angles.data()+eigen_angles.cols()*eigen_angles.rows());
-  std::vector<size_t> indices(angles.size());                                                        
-  std::iota(indices.begin(), indices.end(), 0);                                                      
-  std::sort(indices.begin(), indices.end(), [&angles](size_t i1, size_t i2) { return angles[i1] < angles[i2]; });
-
-  // search clusters
-  float angle_thr = angle_threshold;
-  float distance_thr = distance_threshold;
-  float ep_thr = endpoint_threshold * endpoint_threshold;
-  float quater_PI = M_PI / 4.0;
-
-  std::vector<std::vector<size_t>> neighbors;
-  neighbors.resize(source_line_num);
-  std::vector<bool> sort_by_x;
-  for(size_t i = 0; i < source_line_num; i++){
-    size_t idx1 = indices[i];
-    float x11 = source_lines[idx1](0);
-    float y11 = source_lines[idx1](1);
-    float x12 = source_lines[idx1](2);
-    float y12 = source_lines[idx1](3);
-    float angle1 = angles[idx1];
-    bool to_sort_x = (std::abs(angle1) < quater_PI);
-    sort_by_x.push_back(to_sort_x);
-    if((to_sort_x && (x12 < x11)) || ((!to_sort_x) && y12 < y11)){
-      std::swap(x11, x12);
-      std::swap(y11, y12);
+// the two endpoints of line1 and line2 that are farthest apart along line1
+static Eigen::Vector4f StitchFragments(const Eigen::Vector4f& line1, const Eigen::Vector4f& line2){
+  Eigen::Vector2f direction = (line1.tail<2>() - line1.head<2>()).normalized();
+  Eigen::Vector2f endpoints[4] = {line1.head<2>(), line1.tail<2>(), line2.head<2>(), line2.tail<2>()};
+  int min_idx = 0, max_idx = 0;
+  float min_t = 0, max_t = 0;
+  for(int i = 0; i < 4; i++){
+    float t = direction.dot(endpoints[i] - endpoints[0]);
+    if(t < min_t){
+      min_t = t;
+      min_idx = i;
+    }
+    if(t > max_t){
+      max_t = t;
+      max_idx = i;
     }
+  }
+  Eigen::Vector4f line;
+  line << endpoints[min_idx], endpoints[max_idx];
+  return line;
+}
 
-    for(size_t j = i +1; j < source_line_num; j++){
-      size_t idx2 = indices[j];
-      float x21 = source_lines[idx2](0);
-      float y21 = source_lines[idx2](1);
-      float x22 = source_lines[idx2](2);
-      float y22 = source_lines[idx2](3);
-      if((to_sort_x && (x22 < x21)) || ((!to_sort_x) && y22 < y21)){
-        std::swap(x21, x22);
-        std::swap(y21, y22);
+void LineDetector::TiledDetect(const cv::Mat& image, std::vector<Eigen::Vector4f>& lines){
+  int tile_num = tile_flds.size();
+  int rows = image.rows;
+  int overlap = std::max(0, _line_detector_config.tile_overlap);
+  int tile_height = (rows + tile_num - 1) / tile_num;
+
+  // detect on overlapping stripes in parallel
+  std::vector<std::vector<cv::Vec4f>> tile_lines(tile_num);
+  std::vector<std::thread> threads;
+  for(int k = 0; k < tile_num; k++){
+    threads.emplace_back([&, k](){
+      int row_begin = std::max(0, k * tile_height - overlap);
+      int row_end = std::min(rows, (k + 1) * tile_height + overlap);
+      if(row_end <= row_begin) return;
+      cv::Mat stripe = image.rowRange(row_begin, row_end);
+      tile_flds[k]->detect(stripe, tile_lines[k]);
+      for(auto& cv_line : tile_lines[k]){
+        cv_line[1] += row_begin;
+        cv_line[3] += row_begin;
       }
+    });
+  }
+  for(auto& thread : threads){
+    thread.join();
+  }
 
-      // check delta angle
-      float angle2 = angles[idx2];
-      float d_angle = AngleDiff(angle1, angle2);
-      if(d_angle > angle_thr){
-        if(std::abs(angle1) < (M_PI_2 - angle_threshold)){
-          break;
-        }else{
-          continue;
-        }
+  // a stripe owns the segments whose midpoints are in its core rows, segments close to a seam 
+  // may have been cut and are stitched afterwards
+  std::vector<Eigen::Vector4f> seam_lines;
+  std::vector<uint32_t> seam_tiles;     // bit k is set for fragments from stripe k
+  lines.clear();
+  for(int k = 0; k < tile_num; k++){
+    float core_begin = k * tile_height;
+    float core_end = (k + 1) * tile_height;
+    for(auto& cv_line : tile_lines[k]){
+      float mid_y = 0.5 * (cv_line[1] + cv_line[3]);
+      if(mid_y < core_begin || mid_y >= core_end) continue;
+
+      Eigen::Vector4f line(cv_line[0], cv_line[1], cv_line[2], cv_line[3]);
+      bool near_seam = false;
+      for(int s = 1; s < tile_num && !near_seam; s++){
+        float seam = s * tile_height;
+        float min_y = std::min(line(1), line(3)), max_y = std::max(line(1), line(3));
+        near_seam = (min_y <= seam + overlap && max_y >= seam - overlap);
       }
-
-      // check distance
-      Eigen::Vector2f mid1 = 0.5 * (source_lines[idx1].head(2) + source_lines[idx1].tail(2));
-      Eigen::Vector2f mid2 = 0.5 * (source_lines[idx2].head(2) + source_lines[idx2].tail(2));
-      float mid1_to_line2 = PointLineDistance(source_lines[idx2], mid1);
-      float mid2_to_line1 = PointLineDistance(source_lines[idx1], mid2);
-      if(mid1_to_line2 > distance_thr && mid2_to_line1 > distance_thr) continue;
-
-      // check endpoints distance
-      float cx12, cy12, cx21, cy21;
-      if((to_sort_x && x12 > x22) || (!to_sort_x && y12 > y22)){
-        cx12 = x22;
-        cy12 = y22;
-        cx21 = x11;
-        cy21 = y11;
+      if(near_seam){
+        seam_lines.push_back(line);
+        seam_tiles.push_back(1u << (k % 32));
       }else{
-        cx12 = x12;
-        cy12 = y12;
-        cx21 = x21;
-        cy21 = y21;
-      }
-      bool to_merge = ((to_sort_x && cx12 >= cx21) || (!to_sort_x && cy12 >= cy21));
-      if(!to_merge){
-        float d_ep = (cx21 - cx12) * (cx21 - cx12) + (cy21 - cy12) * (cy21 - cy12);
-        to_merge = (d_ep < ep_thr);
+        lines.push_back(line);
       }
+    }
+  }
 
-      // check cluster code
-      if(to_merge){
-        neighbors[idx1].push_back(idx2);
-        neighbors[idx2].push_back(idx1);
+  // only fragments of different stripes that continue each other are stitched, independent of
+  // do_merge, so parallel segments near a seam stay apart like in the untiled detection
+  bool stitched = true;
+  while(stitched){
+    stitched = false;
+    for(size_t i = 0; i < seam_lines.size(); i++){
+      for(size_t j = i + 1; j < seam_lines.size(); j++){
+        if((seam_tiles[i] & seam_tiles[j]) || !FragmentsToStitch(seam_lines[i], seam_lines[j])) continue;
+        seam_lines[i] = StitchFragments(seam_lines[i], seam_lines[j]);
+        seam_tiles[i] |= seam_tiles[j];
+        seam_lines.erase(seam_lines.begin() + j);
+        seam_tiles.erase(seam_tiles.begin() + j);
+        stitched = true;
+        j--;
       }
     }
   }
+  lines.insert(lines.end(), seam_lines.begin(), seam_lines.end());
+}
 
-  // clusters
-  std::vector<int> cluster_codes(source_line_num, -1);
-  std::vector<std::vector<size_t>> cluster_ids;
-  for(size_t i = 0; i < source_line_num; i++){
-    if(cluster_codes[i] >= 0) continue;
-
-    size_t new_code = cluster_ids.size();
-    cluster_codes[i] = new_code;
-    std::vector<size_t> to_check_ids = neighbors[i];
-    std::vector<size_t> cluster;
-    cluster.push_back(i);
-    while(to_check_ids.size() > 0){
-      std::set<size_t> tmp;
-      for(auto& j : to_check_ids){
-        if(cluster_codes[j] < 0){
-          cluster_codes[j] = new_code;
-          cluster.push_back(j);
-        }
+static bool LinesToMerge(const Eigen::Vector4f& line1, float angle1, const Eigen::Vector4f& line2, 
+    float distance_thr, float ep_thr_square){
+  // check distance
+  Eigen::Vector2f mid1 = 0.5 * (line1.head(2) + line1.tail(2));
+  Eigen::Vector2f mid2 = 0.5 * (line2.head(2) + line2.tail(2));
+  float mid1_to_line2 = PointLineDistance(line2, mid1);
+  float mid2_to_line1 = PointLineDistance(line1, mid2);
+  if(mid1_to_line2 > distance_thr && mid2_to_line1 > distance_thr) return false;
+
+  // sort endpoints along the main direction of line1
+  bool to_sort_x = (std::abs(angle1) < M_PI_4);
+  float x11 = line1(0), y11 = line1(1), x12 = line1(2), y12 = line1(3);
+  float x21 = line2(0), y21 = line2(1), x22 = line2(2), y22 = line2(3);
+  if((to_sort_x && (x12 < x11)) || ((!to_sort_x) && y12 < y11)){
+    std::swap(x11, x12);
+    std::swap(y11, y12);
+  }
+  if((to_sort_x && (x22 < x21)) || ((!to_sort_x) && y22 < y21)){
+    std::swap(x21, x22);
+    std::swap(y21, y22);
+  }
 
-        std::vector<size_t> j_neighbor = neighbors[j];
-        for(auto& k : j_neighbor){
-          if(cluster_codes[k] < 0){
-            tmp.insert(k);
-          } 
-        }
-      }
-      to_check_ids.clear();
-      to_check_ids.assign(tmp.begin(), tmp.end());    
-    }
-    cluster_ids.push_back(cluster);
+  // check endpoints distance
+  float cx12, cy12, cx21, cy21;
+  if((to_sort_x && x12 > x22) || (!to_sort_x && y12 > y22)){
+    cx12 = x22;
+    cy12 = y22;
+    cx21 = x11;
+    cy21 = y11;
+  }else{
+    cx12 = x12;
+    cy12 = y12;
+    cx21 = x21;
+    cy21 = y21;
   }
+  if((to_sort_x && cx12 >= cx21) || (!to_sort_x && cy12 >= cy21)) return true;
+  float d_ep = (cx21 - cx12) * (cx21 - cx12) + (cy21 - cy12) * (cy21 - cy12);
+  return (d_ep < ep_thr_square);
+}
 
-  // search sub-cluster
-  std::vector<std::vector<size_t>> new_cluster_ids;
-  for(auto& cluster : cluster_ids){
-    size_t cluster_size = cluster.size();
-    if(cluster_size <= 2){
-      new_cluster_ids.push_back(cluster);
-      continue;
-    }
+static int FindClusterRoot(std::vector<int>& parents, int i){
+  while(parents[i] != i){
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
 
-    std::sort(cluster.begin(), cluster.end(), [&length](size_t i1, size_t i2) { return length(i1) > length(i2); });
-    std::unordered_map<size_t, size_t> line_location;
-    for(size_t i = 0; i < cluster_size; i++){
-      line_location[cluster[i]] = i;
-    }
+void LineDetector::MergeLines(std::vector<Eigen::Vector4f>& source_lines, std::vector<Eigen::Vector4f>& dst_lines,
+    float angle_threshold, float distance_threshold, float endpoint_threshold){
+  dst_lines.clear();
+  int source_line_num = source_lines.size();
+  if(source_line_num == 0) return;
+
+  Eigen::Array4Xf line_array = Eigen::Map<Eigen::Array4Xf, Eigen::Unaligned>(source_lines[0].data(), 4, source_lines.size());
+  Eigen::ArrayXf dx = line_array.row(2) - line_array.row(0);
+  Eigen::ArrayXf dy = line_array.row(3) - line_array.row(1);
+  Eigen::ArrayXf angles = (dy / dx).atan();
+  Eigen::ArrayXf length = (dx * dx + dy * dy).sqrt();
+  Eigen::ArrayXf mid_x = 0.5 * (line_array.row(0) + line_array.row(2));
+  Eigen::ArrayXf mid_y = 0.5 * (line_array.row(1) + line_array.row(3));
+
+  // longest lines first, they anchor the clusters
+  std::vector<int> order(source_line_num);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&length](int i1, int i2) { return length(i1) > length(i2); });
+  std::vector<int> rank(source_line_num);
+  for(int r = 0; r < source_line_num; r++){
+    rank[order[r]] = r;
+  }
+
+  // angle buckets: angles are in [-pi/2, pi/2] and wrap around, so similar lines are in the same 
+  // or in an adjacent bucket. the count is capped, which also covers a zero threshold
+  const float max_bucket_num = 1024;
+  int bucket_num = (angle_threshold > M_PI / max_bucket_num) ? std::max(1, (int)(M_PI / angle_threshold)) : (int)max_bucket_num;
+  float bucket_width = M_PI / bucket_num;
+  std::vector<int> buckets(source_line_num);
+  for(int i = 0; i < source_line_num; i++){
+    buckets[i] = std::min(bucket_num - 1, std::max(0, (int)((angles(i) + M_PI_2) / bucket_width)));
+  }
 
-    std::vector<bool> clustered(cluster_size, false);
-    for(size_t j = 0; j < cluster_size; j++){
-      if(clustered[j]) continue;
-
-      size_t line_idx = cluster[j];
-      std::vector<size_t> sub_cluster;
-      sub_cluster.push_back(line_idx);
-      std::vector<size_t> line_neighbors = neighbors[line_idx];
-      for(size_t k : line_neighbors){
-        clustered[line_location[k]] = true;
-        sub_cluster.push_back(k);
+  // spatial hash on midpoints, stored as a sorted (key, line) array
+  float search_margin = endpoint_threshold + distance_threshold;
+  float cell_size = std::max(search_margin, length.mean());
+  float min_x = mid_x.minCoeff(), min_y = mid_y.minCoeff();
+  int64_t grid_cols = (int64_t)((mid_x.maxCoeff() - min_x) / cell_size) + 1;
+  int64_t grid_rows = (int64_t)((mid_y.maxCoeff() - min_y) / cell_size) + 1;
+  auto cell_key = [&](int bucket, int64_t gx, int64_t gy){ return ((int64_t)bucket * grid_rows + gy) * grid_cols + gx; };
+  std::vector<std::pair<int64_t, int>> cells;
+  cells.reserve(source_line_num);
+  for(int i = 0; i < source_line_num; i++){
+    int64_t gx = (int64_t)((mid_x(i) - min_x) / cell_size);
+    int64_t gy = (int64_t)((mid_y(i) - min_y) / cell_size);
+    cells.emplace_back(cell_key(buckets[i], gx, gy), i);
+  }
+  std::sort(cells.begin(), cells.end());
+
+  // union-find clustering. A set is rooted at its longest line and only takes lines that can be merged
+  // with that root directly, as the longest-first sub-clusters did, so chains of lines are not joined
+  std::vector<int> parents(source_line_num);
+  std::iota(parents.begin(), parents.end(), 0);
+  float ep_thr_square = endpoint_threshold * endpoint_threshold;
+  int neighbor_bucket_num = std::min(bucket_num, 3);
+  for(int r = 0; r < source_line_num; r++){
+    int i = order[r];
+    // two lines can only be merged if their midpoints are closer than this
+    float radius = length(i) + search_margin;
+    int64_t min_gx = std::max<int64_t>(0, (int64_t)std::floor((mid_x(i) - radius - min_x) / cell_size));
+    int64_t max_gx = std::min<int64_t>(grid_cols - 1, (int64_t)std::floor((mid_x(i) + radius - min_x) / cell_size));
+    int64_t min_gy = std::max<int64_t>(0, (int64_t)std::floor((mid_y(i) - radius - min_y) / cell_size));
+    int64_t max_gy = std::min<int64_t>(grid_rows - 1, (int64_t)std::floor((mid_y(i) + radius - min_y) / cell_size));
+
+    for(int db = 0; db < neighbor_bucket_num; db++){
+      int bucket = (buckets[i] + db - (neighbor_bucket_num > 1 ? 1 : 0) + bucket_num) % bucket_num;
+      for(int64_t gy = min_gy; gy <= max_gy; gy++){
+        for(int64_t gx = min_gx; gx <= max_gx; gx++){
+          int64_t key = cell_key(bucket, gx, gy);
+          auto it = std::lower_bound(cells.begin(), cells.end(), std::pair<int64_t, int>(key, -1));
+          for(; it != cells.end() && it->first == key; it++){
+            int j = it->second;
+            if(rank[j] <= r) continue;  // every pair is tested once, from the longer line
+
+            float angle1 = angles(i), angle2 = angles(j);
+            if(AngleDiff(angle1, angle2) > angle_threshold) continue;
+            if(!LinesToMerge(source_lines[i], angle1, source_lines[j], distance_threshold, ep_thr_square)) continue;
+
+            // j already belongs to a longer line
+            if(parents[j] != j) continue;
+            int root_i = FindClusterRoot(parents, i);
+            if(root_i != i){
+              float root_angle = angles(root_i);
+              if(AngleDiff(root_angle, angle2) > angle_threshold) continue;
+              if(!LinesToMerge(source_lines[root_i], root_angle, source_lines[j], distance_threshold, ep_thr_square)) continue;
+            }
+            parents[j] = root_i;
+          }
+        }
       }
-      new_cluster_ids.push_back(sub_cluster);
     }
   }
 
-  // merge clusters
-  dst_lines.clear();
-  dst_lines.reserve(new_cluster_ids.size());
-  for(auto& cluster : new_cluster_ids){
-    size_t idx0 = cluster[0];
-    Eigen::Vector4f new_line = source_lines[idx0];
-    for(size_t i = 1; i < cluster.size(); i++){
-      new_line = MergeTwoLines(new_line, source_lines[cluster[i]]);
+  // merge clusters in one pass: lines grouped by root, each group starting from its root
+  std::vector<int> roots(source_line_num);
+  for(int i = 0; i < source_line_num; i++){
+    roots[i] = FindClusterRoot(parents, i);
+  }
+  std::sort(order.begin(), order.end(), [&roots, &rank](int i1, int i2) { 
+    return (roots[i1] != roots[i2]) ? (roots[i1] < roots[i2]) : (rank[i1] < rank[i2]); 
+  });
+
+  dst_lines.reserve(source_line_num);
+  for(int k = 0; k < source_line_num; k++){
+    int idx = order[k];
+    if(k == 0 || roots[idx] != roots[order[k-1]]){
+      dst_lines.push_back(source_lines[idx]);
+    }else{
+      dst_lines.back() = MergeTwoLines(dst_lines.back(), source_lines[idx]);
     }
-    dst_lines.push_back(new_line);
   }
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include <cmath> 
 #include <math.h>
 #include <numeric>
+#include <algorithm>
 #include <Eigen/Dense>
 #include <Eigen/SparseCore>
 #include <opencv2/core/core.hpp>
@@ -13,12 +14,16 @@
 #include "map.h"
 #include "utils.h"
 #include "line_processor.h"
+#include "line_distance.h"
 #include "frame.h"
-#include "g2o_optimization/g2o_optimization.h"
 #include "timer.h"
 
 Map::Map(OptimizationConfig& backend_optimization_config, CameraPtr camera, RosPublisherPtr ros_publisher):
-    _backend_optimization_config(backend_optimization_config), _camera(camera), _ros_publisher(ros_publisher){
+    _backend_optimization_config(backend_optimization_config), _camera(camera), _mappoint_index(0.5), 
+    _covisibility_graph(15), _epoch(0), _ros_publisher(ros_publisher){
+  _thread_pool = std::shared_ptr<ThreadPool>(new ThreadPool(backend_optimization_config.thread_num));
+  _local_map_optimizer = std::shared_ptr<LocalMapOptimizer>(new LocalMapOptimizer());
+  _local_map_optimizer->SetThreadPool(_thread_pool);
 }
 
 void Map::InsertKeyframe(FramePtr frame){
@@ -26,6 +31,7 @@ void Map::InsertKeyframe(FramePtr frame){
   int frame_id = frame->GetFrameId();
   _keyframes[frame_id] = frame;
   _keyframe_ids.push_back(frame_id);
+  _epoch++;
   if(_keyframes.size() < 2) return;
 
   // update mappoints
@@ -39,6 +45,11 @@ void Map::InsertKeyframe(FramePtr frame){
   Eigen::Vector3d twf = Twf.block<3, 1>(0, 3);
   for(size_t i = 0; i < frame->FeatureNum(); i++){
     MappointPtr mpt = mappoints[i];
+    if(mpt && mpt->IsBad()){
+      // tracked from a landmark that has been removed, it is not observed again
+      frame->RemoveMappoint(i);
+      continue;
+    }
     if(mpt == nullptr){
       if(track_ids[i] < 0) continue;  // would not happen normally
       mpt = std::shared_ptr<Mappoint>(new Mappoint(track_ids[i]));
@@ -53,14 +64,14 @@ void Map::InsertKeyframe(FramePtr frame){
       frame->InsertMappoint(i, mpt);
       new_mappoints.push_back(mpt);
     }
-    mpt->AddObverser(frame_id, i);
+    AddMappointObverser(mpt, frame_id, i);
     if(mpt->GetType() == Mappoint::Type::UnTriangulated && mpt->ObverserNum() > 2){
-      TriangulateMappoint(mpt);
+      if(TriangulateMappoint(mpt)) UpdateMappointIndex(mpt);
     }
   }
 
   // add new mappoints to map
-  for(MappointPtr mpt:new_mappoints){
+  for(const MappointPtr& mpt:new_mappoints){
     InsertMappoint(mpt);
   }
 
@@ -97,10 +108,13 @@ void Map::InsertKeyframe(FramePtr frame){
   }
 
   // add new maplines to map
-  for(MaplinePtr mpl:new_maplines){
+  for(const MaplinePtr& mpl:new_maplines){
     InsertMapline(mpl);
   }
 
+  // merge duplicated mappoints before they enter the optimization
+  FuseMappoints(frame);
+
   // optimization
   if(_keyframes.size() >= 2){
     LocalMapOptimization(frame);
@@ -108,22 +122,23 @@ void Map::InsertKeyframe(FramePtr frame){
 
 }
 
-void Map::InsertMappoint(MappointPtr mappoint){
+void Map::InsertMappoint(const MappointPtr& mappoint){
   int mappoint_id = mappoint->GetId();
   _mappoints[mappoint_id] = mappoint;
+  UpdateMappointIndex(mappoint);
 }
 
-void Map::InsertMapline(MaplinePtr mapline){
+void Map::InsertMapline(const MaplinePtr& mapline){
   int mapline_id = mapline->GetId();
   _maplines[mapline_id] = mapline;
 }
 
-bool Map::UppdateMapline(MaplinePtr mapline){
+bool Map::UppdateMapline(const MaplinePtr& mapline){
   if(!mapline || !mapline->IsValid()) return false;
 
   // get associated mappoints
-  std::vector<Eigen::Vector3d> points;
-  const std::map<int, int>& obversers = mapline->GetAllObversers();
+  PointBlock3f points;
+  const ObservationList& obversers = mapline->GetAllObversers();
   if(obversers.empty()) return false;
   for(auto& kv : obversers){
     int frame_id = kv.first;
@@ -133,26 +148,30 @@ bool Map::UppdateMapline(MaplinePtr mapline){
     for(auto& point : points_on_line){
       MappointPtr mpt = frame->GetMappoint(point.first);
       if(mpt && mpt->IsValid()){
-        points.push_back(mpt->GetPosition());
+        const Eigen::Vector3d& p = mpt->GetPosition();
+        points.push_back(p(0), p(1), p(2));
       }
     }
   }
 
   // find endpoints
-  std::vector<double> dist;
+  size_t point_num = points.size();
+  std::vector<float> dist(point_num);
+  std::vector<uint8_t> inliers(point_num);
   Vector6d line_cart = mapline->GetLine3D().toCartesian();
-  EigenPointLineDistance3D(points, line_cart, dist);
-  assert(dist.size() == points.size());
   Eigen::Vector3d line_point = line_cart.head(3);
   Eigen::Vector3d line_direction = line_cart.tail(3);
+  PointLineDistance3D(line_point.cast<float>(), line_direction.cast<float>(), points.x.data(), points.y.data(), 
+      points.z.data(), point_num, 0.2, dist.data(), inliers.data());
   Eigen::Index max_index;
   line_direction.array().abs().maxCoeff(&max_index);
   size_t md = max_index;  // main direction
+  const std::vector<float>& md_values = (md == 0) ? points.x : ((md == 1) ? points.y : points.z);
   double max_point_d = DBL_MIN, min_point_d = DBL_MAX;
   bool find_max = false, find_min = false;
-  for(size_t i = 0; i < points.size(); i++){
-    if(dist[i] > 0.2) continue;
-    double di = points[i](md);
+  for(size_t i = 0; i < point_num; i++){
+    if(!inliers[i]) continue;
+    double di = md_values[i];
     if(di > max_point_d){
       max_point_d = di;
       find_max = true;
@@ -176,11 +195,11 @@ bool Map::UppdateMapline(MaplinePtr mapline){
   return true;
 }
 
-void Map::UpdateMaplineEndpoints(MaplinePtr mapline){
+void Map::UpdateMaplineEndpoints(const MaplinePtr& mapline){
   if(!mapline || !mapline->IsValid() || !mapline->ToUpdateEndpoints()) return;
   ConstLine3DPtr line_3d = mapline->GetLine3DPtr();
-  const std::map<int, int>& obversers = mapline->GetAllObversers();
-  const std::map<int, int>& included_endpoints = mapline->GetAllObverserEndpointStatus();
+  const ObservationList& obversers = mapline->GetAllObversers();
+  const ObservationList& included_endpoints = mapline->GetAllObverserEndpointStatus();
 
   std::vector<Eigen::Vector3d> point_3d_vector;
   if(mapline->EndpointsValid()){
@@ -269,28 +288,24 @@ void Map::UpdateMaplineEndpoints(MaplinePtr mapline){
 }
 
 FramePtr Map::GetFramePtr(int frame_id){
-  if(_keyframes.count(frame_id) == 0){
-    return nullptr;
-  }
-  return _keyframes[frame_id];
+  return _keyframes.get(frame_id);
 }
 
 MappointPtr Map::GetMappointPtr(int mappoint_id){
-  if(_mappoints.count(mappoint_id) == 0){
-    return nullptr;
-  }
-  return _mappoints[mappoint_id];
+  return _mappoints.get(mappoint_id);
 }
 
 MaplinePtr Map::GetMaplinePtr(int mapline_id){
-  if(_maplines.count(mapline_id) == 0){
-    return nullptr;
-  }
-  return _maplines[mapline_id];
+  return _maplines.get(mapline_id);
+}
+
+Frame* Map::FindKeyframe(int frame_id){
+  FramePtr* kf = _keyframes.find(frame_id);
+  return kf ? kf->get() : nullptr;
 }
 
-bool Map::TriangulateMappoint(MappointPtr mappoint){
-  const std::map<int, int> obversers = mappoint->GetAllObversers();
+bool Map::TriangulateMappoint(const MappointPtr& mappoint){
+  const ObservationList& obversers = mappoint->GetAllObversers();
   Eigen::Matrix3Xd G_bearing_vectors;
   Eigen::Matrix3Xd p_G_C_vector;
   G_bearing_vectors.resize(Eigen::NoChange, obversers.size());
@@ -299,15 +314,16 @@ bool Map::TriangulateMappoint(MappointPtr mappoint){
   for(const auto kv : obversers){
     int frame_id = kv.first;
     int keypoint_id = kv.second;
-    if(_keyframes.count(frame_id) == 0) continue;
+    const FramePtr* kf = _keyframes.find(frame_id);
+    if(!kf) continue;
     if(keypoint_id < 0) continue;
-    // if(!_keyframes[frame_id]->IsValid()) continue;
+    // if(!(*kf)->IsValid()) continue;
     Eigen::Vector3d keypoint_pos;
-    if(!_keyframes[frame_id]->GetKeypointPosition(keypoint_id, keypoint_pos)) continue;
+    if(!(*kf)->GetKeypointPosition(keypoint_id, keypoint_pos)) continue;
 
     Eigen::Vector3d backprojected_pos;
     _camera->BackProjectMono(keypoint_pos.head(2), backprojected_pos);
-    Eigen::Matrix4d frame_pose = _keyframes[frame_id]->GetPose();
+    Eigen::Matrix4d frame_pose = (*kf)->GetPose();
     Eigen::Matrix3d frame_R = frame_pose.block<3, 3>(0, 0);
     Eigen::Vector3d frame_p = frame_pose.block<3, 1>(0, 3);
 
@@ -338,9 +354,9 @@ bool Map::TriangulateMappoint(MappointPtr mappoint){
   return true;
 }
 
-bool Map::TriangulateMaplineByMappoints(MaplinePtr mapline){
+bool Map::TriangulateMaplineByMappoints(const MaplinePtr& mapline){
   if(mapline->IsValid()) return true;
-  const std::map<int, int>& obversers = mapline->GetAllObversers();
+  const ObservationList& obversers = mapline->GetAllObversers();
   if(obversers.size() < 2) return false;
   std::vector<cv::Point3f> points;
   for(const auto& kv : obversers){
@@ -356,25 +372,43 @@ bool Map::TriangulateMaplineByMappoints(MaplinePtr mapline){
   }
   if(points.size() < 2) return false;
 
+  PointBlock3f block;
+  block.resize(points.size());
+  for(size_t j = 0; j < points.size(); j++){
+    block.x[j] = points[j].x;
+    block.y[j] = points[j].y;
+    block.z[j] = points[j].z;
+  }
+  std::vector<float> dist(points.size());
+  std::vector<uint8_t> inliers(points.size());
+
   cv::Vec6f line;
   for(size_t i = 0; i < 4; i++){
     // fit line
     cv::fitLine(points, line, cv::DIST_L2, 0, 5e-2, 1e-2);
 
     // remove outlier
-    std::vector<float> dist;
-    CVPointLineDistance3D(points, line, dist);
-    size_t inlier_num = 0;
-    for(size_t j = 0; j < points.size(); j++){
-      if(dist[j] < 0.2){
-        points[inlier_num] = points[j];
-        inlier_num++;
+    size_t point_num = points.size();
+    Eigen::Vector3f line_point(line[3], line[4], line[5]);
+    Eigen::Vector3f line_direction(line[0], line[1], line[2]);
+    size_t inlier_num = PointLineDistance3D(line_point, line_direction, block.x.data(), block.y.data(), 
+        block.z.data(), point_num, 0.2, dist.data(), inliers.data());
+    if(inlier_num < point_num){
+      size_t k = 0;
+      for(size_t j = 0; j < point_num; j++){
+        if(!inliers[j]) continue;
+        points[k] = points[j];
+        block.x[k] = block.x[j];
+        block.y[k] = block.y[j];
+        block.z[k] = block.z[j];
+        k++;
       }
+      points.resize(inlier_num);
+      block.resize(inlier_num);
     }
-    points.resize(inlier_num);
 
     // check
-    if(inlier_num == dist.size() || inlier_num < 3){
+    if(inlier_num == point_num || inlier_num < 3){
       break;
     }
   }
@@ -418,8 +452,8 @@ bool Map::TriangulateMaplineByMappoints(MaplinePtr mapline){
   return true;
 }
 
-bool Map::UpdateMappointDescriptor(MappointPtr mappoint){
-  const std::map<int, int> obversers = mappoint->GetAllObversers();
+bool Map::UpdateMappointDescriptor(const MappointPtr& mappoint){
+  const ObservationList& obversers = mappoint->GetAllObversers();
   typedef Eigen::Matrix<double, 256, 1> Descriptor;
   std::vector<Descriptor, Eigen::aligned_allocator<Descriptor> > descriptor_array;
   descriptor_array.resize(obversers.size());
@@ -427,8 +461,9 @@ bool Map::UpdateMappointDescriptor(MappointPtr mappoint){
   for(const auto kv : obversers){
     int frame_id = kv.first;
     int keypoint_id = kv.second;
-    if(_keyframes.count(frame_id) == 0 || keypoint_id < 0) continue;
-    if(_keyframes[frame_id]->GetDescriptor(keypoint_id, descriptor_array[num_valid_obversers])){
+    const FramePtr* kf = _keyframes.find(frame_id);
+    if(!kf || keypoint_id < 0) continue;
+    if((*kf)->GetDescriptor(keypoint_id, descriptor_array[num_valid_obversers])){
       num_valid_obversers++;
     }
   }
@@ -484,7 +519,8 @@ void Map::SearchNeighborFrames(FramePtr frame, std::vector<FramePtr>& neighbor_f
   // 2. when keyframes are more than target_num
   neighbor_frames.push_back(frame);
   frame->local_map_optimization_frame_id = frame_id;
-  std::vector<std::pair<int, FramePtr>> connections = frame->GetOrderedConnections(-1);
+  std::vector<std::pair<int, FramePtr>> connections;
+  GetCovisibleKeyframes(frame_id, connections);
   int connection_num = connections.size();
   int added_first_layer_num = std::min(connection_num, target_num-1);
   for(int i = 0; i < added_first_layer_num; i++){
@@ -500,11 +536,13 @@ void Map::SearchNeighborFrames(FramePtr frame, std::vector<FramePtr>& neighbor_f
   // 3. if not enough, search deeper layers
   while(neighbor_frames.size() < target_num){
     std::map<FramePtr, int> deeper_layer;
-    for(auto kf : neighbor_frames){
-      std::vector<std::pair<int, FramePtr>> deeper_layer_connections = kf->GetOrderedConnections(-1);
+    for(const FramePtr& kf : neighbor_frames){
+      const std::vector<std::pair<int, int>>& deeper_layer_connections = 
+          _covisibility_graph.GetOrderedNeighbors(kf->GetFrameId());
       for(auto& kv : deeper_layer_connections){
-        if(kv.second->local_map_optimization_frame_id != frame_id){
-          deeper_layer[kv.second] += kv.first;
+        const FramePtr* connected_frame = _keyframes.find(kv.second);
+        if(connected_frame && (*connected_frame)->local_map_optimization_frame_id != frame_id){
+          deeper_layer[*connected_frame] += kv.first;
         }
       }
     }
@@ -524,209 +562,344 @@ void Map::SearchNeighborFrames(FramePtr frame, std::vector<FramePtr>& neighbor_f
   }
 }
 
-void Map::AddFrameVertex(FramePtr frame, MapOfPoses& poses, bool fix_this_frame){
-  int frame_id = frame->GetFrameId();
-  Eigen::Matrix4d& frame_pose = frame->GetPose();
-  Pose3d pose;
-  pose.q = frame_pose.block<3, 3>(0, 0);
-  pose.p = frame_pose.block<3, 1>(0, 3);
-  pose.fixed = fix_this_frame;
-  poses.insert(std::pair<int, Pose3d>(frame_id, pose)); 
-}
+// small windows are not worth splitting for
+static const size_t MinLandmarksPerThread = 1024;
 
-void Map::LocalMapOptimization(FramePtr new_frame){
-  UpdateFrameConnection(new_frame);
-  int new_frame_id = new_frame->GetFrameId();  
-
-  MapOfPoses poses;
-  MapOfPoints3d points;
-  MapOfLine3d lines;
-  std::vector<CameraPtr> camera_list;
-  VectorOfMonoPointConstraints mono_point_constraints;
-  VectorOfStereoPointConstraints stereo_point_constraints;
-  VectorOfMonoLineConstraints mono_line_constraints;
-  VectorOfStereoLineConstraints stereo_line_constraints;
+// appends the landmarks and constraints of src to dst, pose indexes are shared and kept as they are
+static void AppendLandmarks(const LocalMapProblem& src, LocalMapProblem& dst){
+  int point_offset = dst.points.size();
+  int line_offset = dst.lines.size();
+  dst.points.insert(dst.points.end(), src.points.begin(), src.points.end());
+  dst.lines.insert(dst.lines.end(), src.lines.begin(), src.lines.end());
 
-  // camera
-  camera_list.emplace_back(_camera);
+  for(const MonoPointConstraint& constraint : src.mono_point_constraints){
+    dst.mono_point_constraints.push_back(constraint);
+    dst.mono_point_constraints.back().point_index += point_offset;
+  }
+  for(const StereoPointConstraint& constraint : src.stereo_point_constraints){
+    dst.stereo_point_constraints.push_back(constraint);
+    dst.stereo_point_constraints.back().point_index += point_offset;
+  }
+  for(const MonoLineConstraint& constraint : src.mono_line_constraints){
+    dst.mono_line_constraints.push_back(constraint);
+    dst.mono_line_constraints.back().line_index += line_offset;
+  }
+  for(const StereoLineConstraint& constraint : src.stereo_line_constraints){
+    dst.stereo_line_constraints.push_back(constraint);
+    dst.stereo_line_constraints.back().line_index += line_offset;
+  }
+}
 
-  // select frames
-  size_t fixed_frame_num = 0;
-  std::vector<FramePtr> neighbor_frames;
-  SearchNeighborFrames(new_frame, neighbor_frames);
+void Map::SelectSlidingWindow(FramePtr frame, std::vector<FramePtr>& window_frames){
+  const size_t window_size = _backend_optimization_config.sliding_window_size;
+  int frame_id = frame->GetFrameId();
 
-  for(auto& kf : neighbor_frames){
-    bool fix_this_frame = (kf->GetFrameId() == 0);
-    fixed_frame_num = fix_this_frame ? (fixed_frame_num + 1) : fixed_frame_num;
-    AddFrameVertex(kf, poses, fix_this_frame);
+  // window keyframes are never culled, this only guards against keyframes removed otherwise
+  std::vector<int> last_window;
+  for(int id : _sliding_window_frame_ids){
+    if(FindKeyframe(id)) last_window.push_back(id);
   }
 
-  // select fixed frames and mappoints
-  std::map<FramePtr, int> fixed_frames;
-  std::vector<MappointPtr> mappoints;
-  std::vector<MaplinePtr> maplines;
-  for(auto neighbor_frame : neighbor_frames){
-    std::vector<MappointPtr>& neighbor_mappoints = neighbor_frame->GetAllMappoints();
-    for(MappointPtr mpt : neighbor_mappoints){
-      if(!mpt || !mpt->IsValid() || mpt->local_map_optimization_frame_id == new_frame_id) continue;
-      mpt->local_map_optimization_frame_id = new_frame_id;
-      mappoints.push_back(mpt);
-
-      const std::map<int, int> obversers = mpt->GetAllObversers();
-      for(auto& kv : obversers){
-        FramePtr kf = GetFramePtr(kv.first);
-        if(!kf) continue;
-        if(kf->local_map_optimization_frame_id != new_frame_id){
-          fixed_frames[kf]++;
-        }
-      }
-    }
+  _sliding_window_frame_ids = last_window;
+  _sliding_window_frame_ids.push_back(frame_id);
+  if(_sliding_window_frame_ids.size() > window_size){
+    _sliding_window_frame_ids.erase(_sliding_window_frame_ids.begin(), 
+        _sliding_window_frame_ids.end() - window_size);
+  }
 
-    const std::vector<MaplinePtr>& neighbor_maplines = neighbor_frame->GetConstAllMaplines();
-    for(const MaplinePtr& mpl : neighbor_maplines){
-      if(!mpl || !mpl->IsValid() || mpl->local_map_optimization_frame_id == new_frame_id) continue;
-      mpl->local_map_optimization_frame_id = new_frame_id;
-      maplines.push_back(mpl);
+  std::vector<int> kept_frame_ids, marginalized_frame_ids;
+  for(int id : last_window){
+    if(std::find(_sliding_window_frame_ids.begin(), _sliding_window_frame_ids.end(), id) != _sliding_window_frame_ids.end()){
+      kept_frame_ids.push_back(id);
+    }else{
+      marginalized_frame_ids.push_back(id);
     }
   }
 
-  const size_t max_fixed_frame_num = 1;
-  if(fixed_frames.size() > 0 && max_fixed_frame_num > fixed_frame_num){
-    std::set<std::pair<int, FramePtr>> ordered_fixed_frames;
-    for(auto& kv : fixed_frames){
-      ordered_fixed_frames.insert(std::pair<int, FramePtr>(kv.second, kv.first));
+  // the observations of the marginalized landmarks by the last window are in the prior now, the
+  // landmarks stay fixed and only observations by newer keyframes are added for them. this is an
+  // approximation on purpose: re-opening them would need the prior to be re-linearized
+  if(!marginalized_frame_ids.empty()){
+    std::vector<int> mappoint_ids, mapline_ids;
+    _local_map_optimizer->Marginalize(kept_frame_ids, marginalized_frame_ids, mappoint_ids, mapline_ids);
+    for(int mappoint_id : mappoint_ids){
+      MappointPtr* mpt = _mappoints.find(mappoint_id);
+      if(mpt) (*mpt)->local_map_marginalization_frame_id = last_window.back();
     }
-
-    size_t to_add_fixed_num = std::min((max_fixed_frame_num-fixed_frame_num), ordered_fixed_frames.size());
-    for(std::set<std::pair<int, FramePtr>>::reverse_iterator rit = ordered_fixed_frames.rbegin(); to_add_fixed_num > 0; to_add_fixed_num--, rit++){
-      rit->second->local_map_optimization_fix_frame_id = new_frame_id;
-      AddFrameVertex(rit->second, poses, true);
+    for(int mapline_id : mapline_ids){
+      MaplinePtr* mpl = _maplines.find(mapline_id);
+      if(mpl) (*mpl)->local_map_marginalization_frame_id = last_window.back();
     }
-    fixed_frame_num += to_add_fixed_num;
   }
 
-  // add point constraint
-  for(auto& mpt : mappoints){
+  window_frames.clear();
+  for(int id : _sliding_window_frame_ids){
+    FramePtr kf = _keyframes.get(id);
+    if(!kf) continue;
+    kf->local_map_optimization_frame_id = frame_id;
+    window_frames.push_back(kf);
+  }
+}
+
+void Map::AddFrameVertex(const FramePtr& frame, LocalMapProblem& problem, bool fix_this_frame){
+  Eigen::Matrix4d& frame_pose = frame->GetPose();
+  frame->local_map_optimization_index = problem.poses.size();
+  problem.poses.emplace_back();
+  Pose3d& pose = problem.poses.back();
+  pose.id = frame->GetFrameId();
+  pose.q = frame_pose.block<3, 3>(0, 0);
+  pose.p = frame_pose.block<3, 1>(0, 3);
+  pose.fixed = fix_this_frame;
+}
+
+void Map::AddPointConstraints(const std::vector<Mappoint*>& mappoints, size_t begin, size_t end, 
+    int frame_id, LocalMapProblem& problem){
+  for(size_t i = begin; i < end; i++){
+    Mappoint* mpt = mappoints[i];
     if(!mpt || !mpt->IsValid()) continue;
 
     // vertex
-    int mpt_id = mpt->GetId();
-    Position3d point;
+    int point_index = problem.points.size();
+    problem.points.emplace_back();
+    Position3d& point = problem.points.back();
+    point.id = mpt->GetId();
     point.p = mpt->GetPosition();
-    point.fixed = false;
+    point.fixed = (mpt->local_map_marginalization_frame_id >= 0);
 
     // constraints
-    VectorOfMonoPointConstraints tmp_mono_point_constraints;
-    VectorOfStereoPointConstraints tmp_stereo_point_constraints;
-    const std::map<int, int> obversers = mpt->GetAllObversers();
+    size_t mono_begin = problem.mono_point_constraints.size();
+    size_t stereo_begin = problem.stereo_point_constraints.size();
+    const ObservationList& obversers = mpt->GetAllObversers();
     for(auto& kv : obversers){
-      FramePtr kf = GetFramePtr(kv.first);
-      if(!kf || (kf->local_map_optimization_frame_id != new_frame_id && kf->local_map_optimization_fix_frame_id != new_frame_id)) continue;
+      if(kv.first <= mpt->local_map_marginalization_frame_id) continue;
+      Frame* kf = FindKeyframe(kv.first);
+      if(!kf || (kf->local_map_optimization_frame_id != frame_id && kf->local_map_optimization_fix_frame_id != frame_id)) continue;
 
       Eigen::Vector3d keypoint; 
       if(!kf->GetKeypointPosition(kv.second, keypoint)) continue;
       // visual constraint
       if(keypoint(2) > 0){
-        StereoPointConstraintPtr stereo_constraint = std::shared_ptr<StereoPointConstraint>(new StereoPointConstraint()); 
-        stereo_constraint->id_pose = kv.first;
-        stereo_constraint->id_point = mpt_id;
-        stereo_constraint->id_camera = 0;
-        stereo_constraint->inlier = true;
-        stereo_constraint->keypoint = keypoint;
-        stereo_constraint->pixel_sigma = 0.8;
-        tmp_stereo_point_constraints.push_back(stereo_constraint);
+        problem.stereo_point_constraints.emplace_back();
+        StereoPointConstraint& stereo_constraint = problem.stereo_point_constraints.back();
+        stereo_constraint.pose_index = kf->local_map_optimization_index;
+        stereo_constraint.point_index = point_index;
+        stereo_constraint.camera_index = 0;
+        stereo_constraint.inlier = true;
+        stereo_constraint.keypoint = keypoint;
       }else{
-        MonoPointConstraintPtr mono_constraint = std::shared_ptr<MonoPointConstraint>(new MonoPointConstraint()); 
-        mono_constraint->id_pose = kv.first;
-        mono_constraint->id_point = mpt_id;
-        mono_constraint->id_camera = 0;
-        mono_constraint->inlier = true;
-        mono_constraint->keypoint = keypoint.head(2);
-        mono_constraint->pixel_sigma = 0.8;
-        tmp_mono_point_constraints.push_back(mono_constraint);
+        problem.mono_point_constraints.emplace_back();
+        MonoPointConstraint& mono_constraint = problem.mono_point_constraints.back();
+        mono_constraint.pose_index = kf->local_map_optimization_index;
+        mono_constraint.point_index = point_index;
+        mono_constraint.camera_index = 0;
+        mono_constraint.inlier = true;
+        mono_constraint.keypoint = keypoint.head(2);
       }
     }
 
-    // add to optimization
-    if(tmp_stereo_point_constraints.size() > 0 || tmp_mono_point_constraints.size() > 1){
-      points.insert(std::pair<int, Position3d>(mpt_id, point));
-      mono_point_constraints.insert(mono_point_constraints.end(),
-          tmp_mono_point_constraints.begin(), tmp_mono_point_constraints.end());
-      stereo_point_constraints.insert(stereo_point_constraints.end(),
-          tmp_stereo_point_constraints.begin(), tmp_stereo_point_constraints.end());
+    size_t mono_num = problem.mono_point_constraints.size() - mono_begin;
+    size_t stereo_num = problem.stereo_point_constraints.size() - stereo_begin;
+    bool constrained = point.fixed ? (stereo_num + mono_num > 0) : (stereo_num > 0 || mono_num > 1);
+    if(!constrained){
+      problem.points.pop_back();
+      problem.mono_point_constraints.resize(mono_begin);
+      problem.stereo_point_constraints.resize(stereo_begin);
     }
   }
+}
 
-  // add line constraint
-  for(auto& mpl : maplines){
+void Map::AddLineConstraints(const std::vector<Mapline*>& maplines, size_t begin, size_t end, 
+    int frame_id, LocalMapProblem& problem){
+  for(size_t i = begin; i < end; i++){
+    Mapline* mpl = maplines[i];
     if(!mpl || !mpl->IsValid()) continue;
 
     // vertex
-    int mpl_id = mpl->GetId();
-    Line3d line_3d;
+    int line_index = problem.lines.size();
+    problem.lines.emplace_back();
+    Line3d& line_3d = problem.lines.back();
+    line_3d.id = mpl->GetId();
     line_3d.line_3d = mpl->GetLine3D();
-    line_3d.fixed = false;
+    line_3d.fixed = (mpl->local_map_marginalization_frame_id >= 0);
 
     // constraints
-    VectorOfMonoLineConstraints tmp_mono_line_constraints;
-    VectorOfStereoLineConstraints tmp_stereo_line_constraints;
-    const std::map<int, int> obversers = mpl->GetAllObversers();
+    size_t mono_begin = problem.mono_line_constraints.size();
+    size_t stereo_begin = problem.stereo_line_constraints.size();
+    const ObservationList& obversers = mpl->GetAllObversers();
     for(auto& kv : obversers){
-      FramePtr kf = GetFramePtr(kv.first);
-      if(!kf || (kf->local_map_optimization_frame_id != new_frame_id && kf->local_map_optimization_fix_frame_id != new_frame_id)) continue;
+      if(kv.first <= mpl->local_map_marginalization_frame_id) continue;
+      Frame* kf = FindKeyframe(kv.first);
+      if(!kf || (kf->local_map_optimization_frame_id != frame_id && kf->local_map_optimization_fix_frame_id != frame_id)) continue;
 
       Eigen::Vector4d line_left, line_right;
       if(!kf->GetLine(kv.second, line_left)) continue;
       if(kf->GetLineRight(kv.second, line_right)){
-        StereoLineConstraintPtr stereo_line_constraint = std::shared_ptr<StereoLineConstraint>(new StereoLineConstraint()); 
-        stereo_line_constraint->id_pose = kv.first;
-        stereo_line_constraint->id_line = mpl_id;
-        stereo_line_constraint->id_camera = 0;
-        stereo_line_constraint->inlier = true;
-        stereo_line_constraint->line_2d << line_left, line_right;
-        stereo_line_constraint->pixel_sigma = 0.8;
-        tmp_stereo_line_constraints.push_back(stereo_line_constraint);
+        problem.stereo_line_constraints.emplace_back();
+        StereoLineConstraint& stereo_line_constraint = problem.stereo_line_constraints.back();
+        stereo_line_constraint.pose_index = kf->local_map_optimization_index;
+        stereo_line_constraint.line_index = line_index;
+        stereo_line_constraint.camera_index = 0;
+        stereo_line_constraint.inlier = true;
+        stereo_line_constraint.line_2d << line_left, line_right;
       }else{
-        MonoLineConstraintPtr mono_line_constraint = std::shared_ptr<MonoLineConstraint>(new MonoLineConstraint()); 
-        mono_line_constraint->id_pose = kv.first;
-        mono_line_constraint->id_line = mpl_id;
-        mono_line_constraint->id_camera = 0;
-        mono_line_constraint->inlier = true;
-        mono_line_constraint->line_2d = line_left;
-        mono_line_constraint->pixel_sigma = 0.8;
-        tmp_mono_line_constraints.push_back(mono_line_constraint);
+        problem.mono_line_constraints.emplace_back();
+        MonoLineConstraint& mono_line_constraint = problem.mono_line_constraints.back();
+        mono_line_constraint.pose_index = kf->local_map_optimization_index;
+        mono_line_constraint.line_index = line_index;
+        mono_line_constraint.camera_index = 0;
+        mono_line_constraint.inlier = true;
+        mono_line_constraint.line_2d = line_left;
       }
     }
-    if(tmp_stereo_line_constraints.size() > 0 || tmp_mono_line_constraints.size() > 1){
-      lines.insert(std::pair<int, Line3d>(mpl_id, line_3d));
-      mono_line_constraints.insert(mono_line_constraints.end(),
-          tmp_mono_line_constraints.begin(), tmp_mono_line_constraints.end());
-      stereo_line_constraints.insert(stereo_line_constraints.end(),
-          tmp_stereo_line_constraints.begin(), tmp_stereo_line_constraints.end());
+
+    size_t mono_num = problem.mono_line_constraints.size() - mono_begin;
+    size_t stereo_num = problem.stereo_line_constraints.size() - stereo_begin;
+    bool constrained = line_3d.fixed ? (stereo_num + mono_num > 0) : (stereo_num > 0 || mono_num > 1);
+    if(!constrained){
+      problem.lines.pop_back();
+      problem.mono_line_constraints.resize(mono_begin);
+      problem.stereo_line_constraints.resize(stereo_begin);
     }
   }
+}
+
+void Map::SetLocalMapOptimizationAbortFlag(const std::atomic<bool>* abort_flag){
+  _local_map_optimizer->SetAbortFlag(abort_flag);
+}
+
+void Map::LocalMapOptimization(FramePtr new_frame){
+  int new_frame_id = new_frame->GetFrameId();  
+
+  // the problem keeps its capacity between keyframes
+  LocalMapProblem& problem = _local_map_problem;
+  problem.Clear();
+  std::vector<CameraPtr> camera_list;
 
-  LocalmapOptimization(poses, points, lines, camera_list, mono_point_constraints, 
-      stereo_point_constraints, mono_line_constraints, stereo_line_constraints, _backend_optimization_config);
+  // camera
+  camera_list.emplace_back(_camera);
+
+  // select frames
+  size_t fixed_frame_num = 0;
+  std::vector<FramePtr> neighbor_frames;
+  bool sliding_window = (_backend_optimization_config.sliding_window_size > 0);
+  if(sliding_window){
+    SelectSlidingWindow(new_frame, neighbor_frames);
+  }else{
+    SearchNeighborFrames(new_frame, neighbor_frames);
+  }
+
+  for(auto& kf : neighbor_frames){
+    bool fix_this_frame = (kf->GetFrameId() == 0);
+    fixed_frame_num = fix_this_frame ? (fixed_frame_num + 1) : fixed_frame_num;
+    AddFrameVertex(kf, problem, fix_this_frame);
+  }
+
+  // select mappoints and maplines, the map owns everything collected here so raw pointers are used.
+  // this pass only marks landmarks, the order it visits them in is the order of the problem
+  std::vector<Mappoint*>& mappoints = _local_map_mappoints;
+  std::vector<Mapline*>& maplines = _local_map_maplines;
+  mappoints.clear();
+  maplines.clear();
+  for(const FramePtr& neighbor_frame : neighbor_frames){
+    const std::vector<MappointPtr>& neighbor_mappoints = neighbor_frame->GetAllMappoints();
+    for(const MappointPtr& mpt : neighbor_mappoints){
+      if(!mpt || !mpt->IsValid() || mpt->local_map_optimization_frame_id == new_frame_id) continue;
+      mpt->local_map_optimization_frame_id = new_frame_id;
+      mappoints.push_back(mpt.get());
+    }
+
+    const std::vector<MaplinePtr>& neighbor_maplines = neighbor_frame->GetConstAllMaplines();
+    for(const MaplinePtr& mpl : neighbor_maplines){
+      if(!mpl || !mpl->IsValid() || mpl->local_map_optimization_frame_id == new_frame_id) continue;
+      mpl->local_map_optimization_frame_id = new_frame_id;
+      maplines.push_back(mpl.get());
+    }
+  }
+
+  // vote for fixed frames, votes are summed so the result does not depend on the thread number.
+  // the prior of the sliding window fixes the gauge, so no frame is fixed there
+  size_t vote_num = sliding_window ? 0 : mappoints.size();
+  size_t thread_num = _thread_pool->RangeNum(vote_num, MinLandmarksPerThread);
+  std::vector<std::map<int, int>> thread_votes(thread_num);
+  _thread_pool->ParallelFor(vote_num, thread_num, [&](size_t t, size_t begin, size_t end){
+    std::map<int, int>& votes = thread_votes[t];
+    for(size_t i = begin; i < end; i++){
+      const ObservationList& obversers = mappoints[i]->GetAllObversers();
+      for(auto& kv : obversers){
+        Frame* kf = FindKeyframe(kv.first);
+        if(!kf) continue;
+        if(kf->local_map_optimization_frame_id != new_frame_id){
+          votes[kv.first]++;
+        }
+      }
+    }
+  });
+  std::map<int, int>& fixed_frames = thread_votes[0];
+  for(size_t t = 1; t < thread_num; t++){
+    for(auto& kv : thread_votes[t]){
+      fixed_frames[kv.first] += kv.second;
+    }
+  }
+
+  const size_t max_fixed_frame_num = 1;
+  if(fixed_frames.size() > 0 && max_fixed_frame_num > fixed_frame_num){
+    std::set<std::pair<int, int>> ordered_fixed_frames;
+    for(auto& kv : fixed_frames){
+      ordered_fixed_frames.insert(std::pair<int, int>(kv.second, kv.first));
+    }
+
+    size_t to_add_fixed_num = std::min((max_fixed_frame_num-fixed_frame_num), ordered_fixed_frames.size());
+    for(std::set<std::pair<int, int>>::reverse_iterator rit = ordered_fixed_frames.rbegin(); to_add_fixed_num > 0; to_add_fixed_num--, rit++){
+      const FramePtr& fixed_frame = *_keyframes.find(rit->second);
+      fixed_frame->local_map_optimization_fix_frame_id = new_frame_id;
+      AddFrameVertex(fixed_frame, problem, true);
+    }
+    fixed_frame_num += to_add_fixed_num;
+  }
+
+  // add point and line constraints, each thread fills its own problem from a contiguous range of
+  // landmarks and the problems are appended in range order, which gives the single thread result.
+  // the pose indexes of the frames are only read here
+  size_t point_thread_num = _thread_pool->RangeNum(mappoints.size(), MinLandmarksPerThread);
+  size_t line_thread_num = _thread_pool->RangeNum(maplines.size(), MinLandmarksPerThread);
+  if(_local_map_problem_buffers.size() < std::max(point_thread_num, line_thread_num)){
+    _local_map_problem_buffers.resize(std::max(point_thread_num, line_thread_num));
+  }
+  for(LocalMapProblem& buffer : _local_map_problem_buffers){
+    buffer.Clear();
+  }
+  _thread_pool->ParallelFor(mappoints.size(), point_thread_num, [&](size_t t, size_t begin, size_t end){
+    LocalMapProblem& output = (point_thread_num == 1) ? problem : _local_map_problem_buffers[t];
+    AddPointConstraints(mappoints, begin, end, new_frame_id, output);
+  });
+  _thread_pool->ParallelFor(maplines.size(), line_thread_num, [&](size_t t, size_t begin, size_t end){
+    LocalMapProblem& output = (line_thread_num == 1) ? problem : _local_map_problem_buffers[t];
+    AddLineConstraints(maplines, begin, end, new_frame_id, output);
+  });
+  for(const LocalMapProblem& buffer : _local_map_problem_buffers){
+    AppendLandmarks(buffer, problem);
+  }
+
+  if(!_local_map_optimizer->Optimize(problem, camera_list, _backend_optimization_config)) return;
 
   // erase point outliers
   std::vector<std::pair<FramePtr, MappointPtr>> outliers;
-  for(auto& mono_point_constraint : mono_point_constraints){
-    if(!mono_point_constraint->inlier){
-      std::map<int, FramePtr>::iterator frame_it = _keyframes.find(mono_point_constraint->id_pose);
-      std::map<int, MappointPtr>::iterator mpt_it = _mappoints.find(mono_point_constraint->id_point);
-      if(frame_it != _keyframes.end() && mpt_it != _mappoints.end() && frame_it->second && mpt_it->second){
-        outliers.emplace_back(frame_it->second, mpt_it->second);
+  for(const MonoPointConstraint& mono_point_constraint : problem.mono_point_constraints){
+    if(!mono_point_constraint.inlier){
+      FramePtr kf = _keyframes.get(problem.poses[mono_point_constraint.pose_index].id);
+      MappointPtr mpt = _mappoints.get(problem.points[mono_point_constraint.point_index].id);
+      if(kf && mpt){
+        outliers.emplace_back(kf, mpt);
       }
     }
   }
 
-  for(auto& stereo_point_constraint : stereo_point_constraints){
-    if(!stereo_point_constraint->inlier){
-      std::map<int, FramePtr>::iterator frame_it = _keyframes.find(stereo_point_constraint->id_pose);
-      std::map<int, MappointPtr>::iterator mpt_it = _mappoints.find(stereo_point_constraint->id_point);
-      if(frame_it != _keyframes.end() && mpt_it != _mappoints.end() && frame_it->second && mpt_it->second){
-        outliers.emplace_back(frame_it->second, mpt_it->second);
+  for(const StereoPointConstraint& stereo_point_constraint : problem.stereo_point_constraints){
+    if(!stereo_point_constraint.inlier){
+      FramePtr kf = _keyframes.get(problem.poses[stereo_point_constraint.pose_index].id);
+      MappointPtr mpt = _mappoints.get(problem.points[stereo_point_constraint.point_index].id);
+      if(kf && mpt){
+        outliers.emplace_back(kf, mpt);
       }
     }
   }
@@ -734,29 +907,27 @@ void Map::LocalMapOptimization(FramePtr new_frame){
 
   // erase line outliers
   std::vector<std::pair<FramePtr, MaplinePtr>> line_outliers;
-  for(auto& mono_line_constraint : mono_line_constraints){
-    if(!mono_line_constraint->inlier){
-      std::map<int, FramePtr>::iterator frame_it = _keyframes.find(mono_line_constraint->id_pose);
-      std::map<int, MaplinePtr>::iterator mpl_it = _maplines.find(mono_line_constraint->id_line);
-      if(frame_it != _keyframes.end() && mpl_it != _maplines.end() && frame_it->second && mpl_it->second){
-        line_outliers.emplace_back(frame_it->second, mpl_it->second);
+  for(const MonoLineConstraint& mono_line_constraint : problem.mono_line_constraints){
+    if(!mono_line_constraint.inlier){
+      FramePtr kf = _keyframes.get(problem.poses[mono_line_constraint.pose_index].id);
+      MaplinePtr mpl = _maplines.get(problem.lines[mono_line_constraint.line_index].id);
+      if(kf && mpl){
+        line_outliers.emplace_back(kf, mpl);
       }
     }
   }
 
-  for(auto& stereo_line_constraint : stereo_line_constraints){
-    if(!stereo_line_constraint->inlier){
-      std::map<int, FramePtr>::iterator frame_it = _keyframes.find(stereo_line_constraint->id_pose);
-      std::map<int, MaplinePtr>::iterator mpl_it = _maplines.find(stereo_line_constraint->id_line);
-      if(frame_it != _keyframes.end() && mpl_it != _maplines.end() && frame_it->second && mpl_it->second){
-        line_outliers.emplace_back(frame_it->second, mpl_it->second);
+  for(const StereoLineConstraint& stereo_line_constraint : problem.stereo_line_constraints){
+    if(!stereo_line_constraint.inlier){
+      FramePtr kf = _keyframes.get(problem.poses[stereo_line_constraint.pose_index].id);
+      MaplinePtr mpl = _maplines.get(problem.lines[stereo_line_constraint.line_index].id);
+      if(kf && mpl){
+        line_outliers.emplace_back(kf, mpl);
       }
     }
   }
 
   RemoveLineOutliers(line_outliers);
-
-  UpdateFrameConnection(new_frame);
   // PrintConnection();
 
   // copy back to map
@@ -764,35 +935,35 @@ void Map::LocalMapOptimization(FramePtr new_frame){
   MapMessagePtr map_message = std::shared_ptr<MapMessage>(new MapMessage);
   MapLineMessagePtr mapline_message = std::shared_ptr<MapLineMessage>(new MapLineMessage);
 
-  for(auto& kv : poses){
-    int frame_id = kv.first;
-    Pose3d pose = kv.second;
-    if(_keyframes.count(frame_id) == 0) continue;
+  for(const Pose3d& pose : problem.poses){
+    int frame_id = pose.id;
+    FramePtr kf = _keyframes.get(frame_id);
+    if(!kf) continue;
     Eigen::Matrix4d pose_eigen;
     pose_eigen.block<3, 3>(0, 0) = pose.q.matrix();
     pose_eigen.block<3, 1>(0, 3) = pose.p;
-    _keyframes[frame_id]->SetPose(pose_eigen);
+    kf->SetPose(pose_eigen);
 
-    keyframe_message->times.push_back(_keyframes[frame_id]->GetTimestamp());
+    keyframe_message->times.push_back(kf->GetTimestamp());
     keyframe_message->ids.push_back(frame_id);
     keyframe_message->poses.push_back(pose_eigen);
   }
 
-  for(auto& kv : points){
-    int mpt_id = kv.first;
-    Position3d position = kv.second;
-    if(_mappoints.count(mpt_id) == 0) continue;
-    _mappoints[mpt_id]->SetPosition(position.p);
+  for(const Position3d& position : problem.points){
+    int mpt_id = position.id;
+    MappointPtr* mpt = _mappoints.find(mpt_id);
+    if(!mpt) continue;
+    (*mpt)->SetPosition(position.p);
+    UpdateMappointIndex(*mpt);
 
     map_message->ids.push_back(mpt_id);
     map_message->points.push_back(position.p);
   }
 
-  for(auto& kv : lines){
-    int mpl_id = kv.first;
-    Line3d line = kv.second; 
-    if(_maplines.count(mpl_id) == 0) continue;
-    MaplinePtr mpl = _maplines[mpl_id];
+  for(const Line3d& line : problem.lines){
+    int mpl_id = line.id;
+    MaplinePtr mpl = _maplines.get(mpl_id);
+    if(!mpl) continue;
     mpl->SetLine3D(line.line_3d);
     mpl->SetEndpointsValidStatus(UppdateMapline(mpl));
     if(!mpl->EndpointsValid()) continue;
@@ -806,140 +977,275 @@ void Map::LocalMapOptimization(FramePtr new_frame){
   _ros_publisher->PublishMapLine(mapline_message);  
 }
 
-std::pair<FramePtr, FramePtr> Map::MakeFramePair(FramePtr frame0, FramePtr frame1){
-  if(frame0->GetFrameId() > frame1->GetFrameId()){
-    return std::pair<FramePtr, FramePtr>(frame0, frame1);
-  }else{
-    return std::pair<FramePtr, FramePtr>(frame1, frame0);
-  }
-}
-
 void Map::RemoveOutliers(const std::vector<std::pair<FramePtr, MappointPtr>>& outliers){
-  std::map<std::pair<FramePtr, FramePtr>, int> bad_connections; 
   for(auto& kv : outliers){
-    FramePtr frame = kv.first;
-    MappointPtr mpt = kv.second;
+    const FramePtr& frame = kv.first;
+    const MappointPtr& mpt = kv.second;
     if(!frame || !mpt || mpt->IsBad()) continue;
 
     // remove connection in mappoint
-    mpt->RemoveObverser(frame->GetFrameId());
-    std::map<int, int> obversers = mpt->GetAllObversers();
-    for(auto& ob : obversers){
-      std::map<int, FramePtr>::iterator obverser_it = _keyframes.find(ob.first);
-      if(obverser_it != _keyframes.end()){
-        bad_connections[MakeFramePair(frame, obverser_it->second)]++;
-      }
-    }
-
+    int frame_id = frame->GetFrameId();
+    int keypoint_idx = mpt->GetKeypointIdx(frame_id);
+    RemoveMappointObverser(mpt, frame_id);
+    const ObservationList& obversers = mpt->GetAllObversers();
     if(mpt->ObverserNum() < 2 && !mpt->IsBad()){
       // delete mappoint if it has only a mono obversor
       bool delete_mappoint = true;
       if(mpt->ObverserNum() > 0){
-        std::map<int, FramePtr>::iterator obverser_it = _keyframes.find(obversers.begin()->first);
-        if(obverser_it != _keyframes.end()){
-          int ktp_idx = mpt->GetKeypointIdx(obverser_it->first);
-          if(obverser_it->second->GetRightPosition(ktp_idx) < 0){
-            obverser_it->second->RemoveMappoint(obversers.begin()->second);
+        FramePtr* obverser = _keyframes.find(obversers.front().first);
+        if(obverser){
+          int ktp_idx = mpt->GetKeypointIdx(obversers.front().first);
+          if((*obverser)->GetRightPosition(ktp_idx) < 0){
+            (*obverser)->RemoveMappoint(obversers.front().second);
           }else{
             delete_mappoint = false;
           }
         }
       }
-      if(delete_mappoint) mpt->SetBad();
+      if(delete_mappoint){
+        SetMappointBad(mpt);
+      }
     }
 
     // remove connection in frame
-    frame->RemoveMappoint(mpt);
-  }
-
-  // update connections between frames
-  for(auto& bad_connection : bad_connections){
-    FramePtr frame0 = bad_connection.first.first;
-    FramePtr frame1 = bad_connection.first.second;
-    frame0->DecreaseWeight(frame1, bad_connection.second);
-    frame1->DecreaseWeight(frame0, bad_connection.second);
+    frame->RemoveMappoint(keypoint_idx);
   }
 }
 
 void Map::RemoveLineOutliers(const std::vector<std::pair<FramePtr, MaplinePtr>>& line_outliers){
   for(auto& kv : line_outliers){
-    FramePtr frame = kv.first;
-    MaplinePtr mpl = kv.second;
+    const FramePtr& frame = kv.first;
+    const MaplinePtr& mpl = kv.second;
     if(!frame || !mpl || mpl->IsBad()) continue;
 
     // remove connection in mappoint
-    mpl->RemoveObverser(frame->GetFrameId());
-    std::map<int, int> obversers = mpl->GetAllObversers();
+    int frame_id = frame->GetFrameId();
+    int line_idx = mpl->GetLineIdx(frame_id);
+    mpl->RemoveObverser(frame_id);
+    const ObservationList& obversers = mpl->GetAllObversers();
     if(mpl->ObverserNum() < 2 && !mpl->IsBad()){
       // delete mapline if it has only a mono obversor
       bool delete_mapline = true;
       if(mpl->ObverserNum() > 0){
-        std::map<int, FramePtr>::iterator obverser_it = _keyframes.find(obversers.begin()->first);
-        if(obverser_it != _keyframes.end()){
-          int line_idx = mpl->GetLineIdx(obverser_it->first);
-          if(!obverser_it->second->GetRightLineStatus(line_idx)){
-            obverser_it->second->RemoveMapline(obversers.begin()->second);
+        FramePtr* obverser = _keyframes.find(obversers.front().first);
+        if(obverser){
+          int line_idx = mpl->GetLineIdx(obversers.front().first);
+          if(!(*obverser)->GetRightLineStatus(line_idx)){
+            (*obverser)->RemoveMapline(obversers.front().second);
           }else{
             delete_mapline = false;
           }
         }
       }
       if(delete_mapline){
-        mpl->SetBad();
+        SetMaplineBad(mpl);
       } 
     }
 
-    frame->RemoveMapline(mpl);
+    frame->RemoveMapline(line_idx);
   }
 }
 
-void Map::UpdateFrameConnection(FramePtr frame){
+int Map::FuseMappoints(const FramePtr& frame){
   int frame_id = frame->GetFrameId();
-  std::vector<MappointPtr> mappoints = frame->GetAllMappoints();
-  std::map<int, int> connections;
-  for(MappointPtr mpt : mappoints){
-    if(!mpt || mpt->IsBad()) continue;
-    std::map<int, int> obversers = mpt->GetAllObversers();
-    for(auto& kv : obversers){
-      int observer_id = kv.first;
-      if(observer_id == frame_id) continue;
-      if(_keyframes.find(observer_id) == _keyframes.end()) continue;
-      connections[observer_id]++;
+  std::vector<std::pair<int, FramePtr>> covisible_keyframes;
+  GetCovisibleKeyframes(frame_id, covisible_keyframes);
+  if(covisible_keyframes.empty()) return 0;
+
+  // mappoints of the new keyframe into its covisible keyframes
+  int fused_num = 0;
+  const std::vector<MappointPtr> frame_mappoints = frame->GetAllMappoints();
+  for(auto& kv : covisible_keyframes){
+    fused_num += FuseByProjection(kv.second.get(), frame_mappoints);
+  }
+
+  // and mappoints of the covisible keyframes back into the new keyframe
+  std::vector<MappointPtr> covisible_mappoints;
+  for(auto& kv : covisible_keyframes){
+    const std::vector<MappointPtr>& mappoints = kv.second->GetAllMappoints();
+    for(const MappointPtr& mpt : mappoints){
+      if(!mpt || !mpt->IsValid() || mpt->fuse_frame_id == frame_id) continue;
+      mpt->fuse_frame_id = frame_id;
+      covisible_mappoints.push_back(mpt);
     }
   }
-  if(connections.empty()) return;
-
-  std::set<std::pair<int, FramePtr>> good_connections;
-  FramePtr best_connection;
-  int best_weight = -1;
-  const int MinWeight = 15;
-  for(auto& kv : connections){
-    FramePtr connected_frame = _keyframes[kv.first];
-    assert(connected_frame != nullptr);
-    int connected_weight = kv.second;
-    if(connected_weight > best_weight){
-      best_connection = connected_frame;
-      best_weight = connected_weight;
+  fused_num += FuseByProjection(frame.get(), covisible_mappoints);
+  return fused_num;
+}
+
+int Map::FuseByProjection(Frame* frame, const std::vector<MappointPtr>& mappoints){
+  int frame_id = frame->GetFrameId();
+  Eigen::Matrix4d& pose = frame->GetPose();
+  Eigen::Matrix3d Rcw = pose.block<3, 3>(0, 0).transpose();
+  Eigen::Vector3d tcw = -Rcw * pose.block<3, 1>(0, 3);
+  Eigen::Matrix<double, 259, Eigen::Dynamic>& features = frame->GetAllFeatures();
+  std::vector<MappointPtr>& frame_mappoints = frame->GetAllMappoints();
+  CameraPtr camera = frame->GetCamera();
+  const double r = 5.0;
+  const double distance_threshold = 0.35;
+
+  int fused_num = 0;
+  std::vector<int> candidate_ids;
+  for(const MappointPtr& mpt : mappoints){
+    if(!mpt || !mpt->IsValid() || mpt->GetAllObversers().count(frame_id)) continue;
+
+    Eigen::Vector3d pc = Rcw * mpt->GetPosition() + tcw;
+    if(pc(2) <= 0) continue;
+    double u = pc(0) / pc(2) * camera->Fx() + camera->Cx();
+    double v = pc(1) / pc(2) * camera->Fy() + camera->Cy();
+    if(u <= 0 || u >= camera->ImageWidth() || v <= 0 || v >= camera->ImageHeight()) continue;
+
+    // keypoints that already have a mappoint, right positions are not compared
+    Eigen::Vector3d p2D(u, v, -1);
+    candidate_ids.clear();
+    frame->FindNeighborKeypoints(p2D, candidate_ids, r, false);
+    const float* mpt_desc = mpt->GetDescriptor();
+    double best_dist = distance_threshold;
+    int best_idx = -1;
+    for(auto& idx : candidate_ids){
+      double dist = DescriptorDistance(mpt_desc, features.col(idx).data() + 3);
+      if(dist < best_dist){
+        best_dist = dist;
+        best_idx = idx;
+      }
+    }
+    if(best_idx < 0) continue;
+
+    MappointPtr duplicate = frame_mappoints[best_idx];
+    if(!duplicate || !duplicate->IsValid() || duplicate == mpt) continue;
+
+    // one keyframe can not observe the merged mappoint twice
+    bool shared_obverser = false;
+    const ObservationList& obversers = mpt->GetAllObversers();
+    for(auto& kv : obversers){
+      if(duplicate->GetAllObversers().count(kv.first)){
+        shared_obverser = true;
+        break;
+      }
     }
+    if(shared_obverser) continue;
 
-    if(connected_weight > MinWeight){
-      good_connections.insert(std::pair<int, FramePtr>(connected_weight, connected_frame));
-      connected_frame->AddConnection(frame, connected_weight);
+    // keep the mappoint with more observations
+    if(duplicate->ObverserNum() >= mpt->ObverserNum()){
+      MergeMappoints(duplicate, mpt);
+    }else{
+      MergeMappoints(mpt, duplicate);
     }
+    fused_num++;
+  }
+  return fused_num;
+}
+
+void Map::MergeMappoints(const MappointPtr& kept, const MappointPtr& merged){
+  // the observer list is cleared when the mappoint is set bad
+  ObservationList obversers = merged->GetAllObversers();
+  SetMappointBad(merged);
+  for(auto& kv : obversers){
+    Frame* kf = FindKeyframe(kv.first);
+    if(!kf || kv.second < 0) continue;
+    if(kf->GetMappoint(kv.second) != merged) continue;
+    kf->InsertMappoint(kv.second, kept);
+    kf->SetTrackId(kv.second, kept->GetId());
+    AddMappointObverser(kept, kv.first, kv.second);
+  }
+  UpdateMappointDescriptor(kept);
+}
+
+void Map::FindRedundantKeyframes(const FramePtr& frame, const KeyframeCullingConfig& config, 
+    const std::set<int>& pinned_keyframe_ids, std::vector<int>& redundant_keyframe_ids){
+  redundant_keyframe_ids.clear();
+  int frame_id = frame->GetFrameId();
+  if(!_keyframes.count(frame_id)) return;
+
+  std::vector<std::pair<int, FramePtr>> candidates;
+  GetCovisibleKeyframes(frame_id, candidates);
+  for(auto& kv : candidates){
+    int kf_id = kv.second->GetFrameId();
+    if(kf_id == frame_id) continue;
+    if(IsRedundantKeyframe(kv.second, config, pinned_keyframe_ids)) redundant_keyframe_ids.push_back(kf_id);
   }
+}
+
+void Map::CullKeyframes(const std::vector<int>& keyframe_ids, const KeyframeCullingConfig& config, 
+    const std::set<int>& pinned_keyframe_ids, std::vector<int>& culled_keyframe_ids){
+  culled_keyframe_ids.clear();
+  for(int kf_id : keyframe_ids){
+    // checked again, the map has changed since the keyframe was found and a keyframe culled before
+    // may have taken observations it counted on
+    FramePtr kf = _keyframes.get(kf_id);
+    if(!kf || !IsRedundantKeyframe(kf, config, pinned_keyframe_ids)) continue;
+    RemoveKeyframe(kf);
+    culled_keyframe_ids.push_back(kf_id);
+  }
+}
 
-  if(good_connections.empty()){
-    good_connections.insert(std::pair<int, FramePtr>(best_weight, best_connection));
-    best_connection->AddConnection(frame, best_weight);  
+bool Map::IsRedundantKeyframe(const FramePtr& kf, const KeyframeCullingConfig& config, 
+    const std::set<int>& pinned_keyframe_ids){
+  if(_keyframe_ids.size() < 3) return false;
+  int kf_id = kf->GetFrameId();
+  if(kf_id == _keyframe_ids.front() || kf_id == _keyframe_ids.back()) return false;
+  if(pinned_keyframe_ids.count(kf_id)) return false;
+
+  // sliding window poses must leave through marginalization, dropping one would cut the prior
+  if(std::find(_sliding_window_frame_ids.begin(), _sliding_window_frame_ids.end(), kf_id) != 
+      _sliding_window_frame_ids.end()) return false;
+
+  // the observation of kf itself is included in ObverserNum
+  int valid_num = 0;
+  int redundant_num = 0;
+  const std::vector<MappointPtr>& mappoints = kf->GetAllMappoints();
+  for(const MappointPtr& mpt : mappoints){
+    if(!mpt || mpt->IsBad()) continue;
+    valid_num++;
+    if(mpt->ObverserNum() > config.min_obverser_num) redundant_num++;
   }
- 
-  frame->AddConnection(good_connections);
+  return (valid_num > 0 && redundant_num > config.redundant_ratio * valid_num);
+}
+
+void Map::RemoveKeyframe(const FramePtr& frame){
+  int frame_id = frame->GetFrameId();
+  if(!_keyframes.count(frame_id)) return;
+
+  // unlink mappoints
+  std::vector<MappointPtr>& mappoints = frame->GetAllMappoints();
+  for(size_t i = 0; i < mappoints.size(); i++){
+    MappointPtr mpt = mappoints[i];
+    if(!mpt) continue;
+    frame->RemoveMappoint(i);
+    if(mpt->IsBad()) continue;
+    RemoveMappointObverser(mpt, frame_id);
+    if(mpt->ObverserNum() < 1) SetMappointBad(mpt);
+  }
+
+  // unlink maplines
+  std::vector<MaplinePtr>& maplines = frame->GetAllMaplines();
+  for(size_t i = 0; i < maplines.size(); i++){
+    MaplinePtr mpl = maplines[i];
+    if(!mpl) continue;
+    frame->RemoveMapline(i);
+    if(mpl->IsBad()) continue;
+    mpl->RemoveObverser(frame_id);
+    if(mpl->ObverserNum() < 1) SetMaplineBad(mpl);
+  }
+
+  // bridge the spanning tree over the removed keyframe
+  FramePtr parent = frame->GetParent();
+  FramePtr child = frame->GetChild();
+  if(child && child->GetParent() == frame) child->SetParent(parent);
+  if(parent && parent->GetChild() == frame) parent->SetChild(child);
+  frame->SetParent(nullptr);
+  frame->SetChild(nullptr);
+
+  _covisibility_graph.RemoveFrame(frame_id);
+  _keyframes.erase(frame_id);
+  _keyframe_ids.erase(std::remove(_keyframe_ids.begin(), _keyframe_ids.end(), frame_id), _keyframe_ids.end());
 }
 
 void Map::PrintConnection(){
   for(auto& kv : _keyframes){
     FramePtr frame = kv.second;
-    std::vector<std::pair<int, FramePtr>> connections = frame->GetOrderedConnections(-1);
+    std::vector<std::pair<int, FramePtr>> connections;
+    GetCovisibleKeyframes(frame->GetFrameId(), connections);
     std::cout << "Connection of frame " << frame->GetFrameId() << " : ";
     for(auto& kv : connections){
       std::cout << kv.second->GetFrameId() << "--" << kv.first << ", ";
@@ -948,9 +1254,109 @@ void Map::PrintConnection(){
   }
 }
 
+void Map::AddMappointObverser(const MappointPtr& mappoint, int frame_id, int keypoint_index){
+  const ObservationList& obversers = mappoint->GetAllObversers();
+  if(!mappoint->IsBad() && !obversers.count(frame_id)){
+    for(auto& kv : obversers){
+      _covisibility_graph.ChangeWeight(frame_id, kv.first, 1);
+    }
+  }
+  mappoint->AddObverser(frame_id, keypoint_index);
+}
+
+void Map::RemoveMappointObverser(const MappointPtr& mappoint, int frame_id){
+  const ObservationList& obversers = mappoint->GetAllObversers();
+  if(!obversers.count(frame_id)) return;
+  mappoint->RemoveObverser(frame_id);
+  if(mappoint->IsBad()) return;
+  for(auto& kv : obversers){
+    _covisibility_graph.ChangeWeight(frame_id, kv.first, -1);
+  }
+}
+
+void Map::SetMappointBad(const MappointPtr& mappoint){
+  if(mappoint->IsBad()) return;
+  const ObservationList& obversers = mappoint->GetAllObversers();
+  for(auto it0 = obversers.begin(); it0 != obversers.end(); it0++){
+    for(auto it1 = it0 + 1; it1 != obversers.end(); it1++){
+      _covisibility_graph.ChangeWeight(it0->first, it1->first, -1);
+    }
+  }
+  _retired_mappoints.emplace_back(_epoch, mappoint, obversers);
+  mappoint->SetBad();
+  UpdateMappointIndex(mappoint);
+}
+
+void Map::SetMaplineBad(const MaplinePtr& mapline){
+  if(mapline->IsBad()) return;
+  _retired_maplines.emplace_back(_epoch, mapline, mapline->GetAllObversers());
+  mapline->SetBad();
+}
+
+int Map::CollectGarbage(){
+  // landmarks retired in an earlier epoch can no longer be held by a tracking or optimization pass
+  int reclaimed_num = 0;
+  size_t mappoint_num = 0;
+  for(; mappoint_num < _retired_mappoints.size(); mappoint_num++){
+    RetiredLandmark<MappointPtr>& retired = _retired_mappoints[mappoint_num];
+    if(retired.epoch >= _epoch) break;
+    const MappointPtr& mpt = retired.landmark;
+    for(auto& kv : retired.obversers){
+      Frame* kf = FindKeyframe(kv.first);
+      if(!kf || kv.second < 0) continue;
+      std::vector<MappointPtr>& mappoints = kf->GetAllMappoints();
+      if(kv.second < (int)mappoints.size() && mappoints[kv.second] == mpt){
+        mappoints[kv.second] = nullptr;
+      }
+    }
+    if(_mappoints.get(mpt->GetId()) == mpt){
+      _mappoints.erase(mpt->GetId());
+    }
+    reclaimed_num++;
+  }
+  _retired_mappoints.erase(_retired_mappoints.begin(), _retired_mappoints.begin() + mappoint_num);
+
+  size_t mapline_num = 0;
+  for(; mapline_num < _retired_maplines.size(); mapline_num++){
+    RetiredLandmark<MaplinePtr>& retired = _retired_maplines[mapline_num];
+    if(retired.epoch >= _epoch) break;
+    const MaplinePtr& mpl = retired.landmark;
+    for(auto& kv : retired.obversers){
+      Frame* kf = FindKeyframe(kv.first);
+      if(!kf || kv.second < 0) continue;
+      std::vector<MaplinePtr>& maplines = kf->GetAllMaplines();
+      if(kv.second < (int)maplines.size() && maplines[kv.second] == mpl){
+        maplines[kv.second] = nullptr;
+      }
+    }
+    if(_maplines.get(mpl->GetId()) == mpl){
+      _maplines.erase(mpl->GetId());
+    }
+    reclaimed_num++;
+  }
+  _retired_maplines.erase(_retired_maplines.begin(), _retired_maplines.begin() + mapline_num);
+  return reclaimed_num;
+}
+
+void Map::GetCovisibleKeyframes(int frame_id, std::vector<std::pair<int, FramePtr>>& covisible_keyframes){
+  covisible_keyframes.clear();
+  const std::vector<std::pair<int, int>>& neighbors = _covisibility_graph.GetOrderedNeighbors(frame_id);
+  covisible_keyframes.reserve(neighbors.size());
+  for(auto& kv : neighbors){
+    const FramePtr* kf = _keyframes.find(kv.second);
+    if(kf) covisible_keyframes.emplace_back(kv.first, *kf);
+  }
+}
+
+int Map::GetCovisibilityWeight(int frame_id0, int frame_id1){
+  return _covisibility_graph.GetWeight(frame_id0, frame_id1);
+}
+
+// descriptor matching of projected mappoints is split into ranges of at least this size
+static const size_t MinPointsPerThread = 256;
+
 void Map::SearchByProjection(FramePtr frame, std::vector<MappointPtr>& mappoints, 
     int thr, std::vector<std::pair<int, MappointPtr>>& good_projections){
-  int frame_id = frame->GetFrameId();
   Eigen::Matrix4d pose = frame->GetPose();
   Eigen::Matrix3d Rwc = pose.block<3, 3>(0, 0);
   Eigen::Vector3d twc = pose.block<3, 1>(0, 3);
@@ -958,48 +1364,110 @@ void Map::SearchByProjection(FramePtr frame, std::vector<MappointPtr>& mappoints
   CameraPtr camera = frame->GetCamera();
   double image_width = camera->ImageWidth();
   double image_height = camera->ImageHeight();
+  double fx = camera->Fx();
+  double fy = camera->Fy();
+  double cx = camera->Cx();
+  double cy = camera->Cy();
+  double bf = camera->BF();
   const double r = 15.0 * thr;
 
-  for(auto& mpt : mappoints){
-    // check whether mappoint is valid
-    if(!mpt || !mpt->IsValid()) continue;
-
-    // check whether mappoint is in the front of camera
-    const Eigen::Vector3d& pw = mpt->GetPosition();
-    Eigen::Vector3d pc = Rwc.transpose() * (pw - twc);
-    if(pc(2) <= 0) continue;
-
-    // check whether mappoint can project on the image
-    Eigen::Vector3d p2D;
-    camera->StereoProject(p2D, pc);
-    if(p2D(0) <= 0 || p2D(0) >= image_width || p2D(1) <=0 || p2D(1) >= image_height) continue;
+  // gather valid mappoints and transform them to the camera frame at once
+  std::vector<size_t> valid_indexes;
+  valid_indexes.reserve(mappoints.size());
+  for(size_t i = 0; i < mappoints.size(); i++){
+    if(mappoints[i] && mappoints[i]->IsValid()) valid_indexes.push_back(i);
+  }
+  size_t valid_num = valid_indexes.size();
+  if(valid_num == 0) return;
 
-    // find neighbor features 
+  Eigen::Matrix3Xd pw(3, valid_num);
+  for(size_t k = 0; k < valid_num; k++){
+    pw.col(k) = mappoints[valid_indexes[k]]->GetPosition();
+  }
+  Eigen::Matrix3Xd pc = Rwc.transpose() * (pw.colwise() - twc);
+
+  // project and keep points in front of the camera and inside the image
+  Eigen::Array<double, 1, Eigen::Dynamic> z_inv = pc.row(2).array().inverse();
+  Eigen::Array<double, 1, Eigen::Dynamic> u = (pc.row(0).array() * z_inv) * fx + cx;
+  Eigen::Array<double, 1, Eigen::Dynamic> v = (pc.row(1).array() * z_inv) * fy + cy;
+  Eigen::Array<bool, 1, Eigen::Dynamic> mask = (pc.row(2).array() > 0) && (u > 0) && (u < image_width) && (v > 0) && (v < image_height);
+
+  std::vector<size_t> visible;
+  visible.reserve(valid_num);
+  for(size_t k = 0; k < valid_num; k++){
+    if(mask(k)) visible.push_back(k);
+  }
+  if(visible.empty()) return;
+
+  // match contiguous ranges of visible points and merge them in order, so the result does not depend
+  // on the thread number
+  size_t range_num = _thread_pool->RangeNum(visible.size(), MinPointsPerThread);
+  std::vector<std::vector<std::pair<int, MappointPtr>>> outputs(range_num);
+  _thread_pool->ParallelFor(visible.size(), range_num, [&](size_t t, size_t begin, size_t end){
+    std::vector<std::pair<int, MappointPtr>>& output = outputs[t];
     std::vector<int> candidate_ids;
-    frame->FindNeighborKeypoints(p2D, candidate_ids, r, true);
-    if(candidate_ids.empty()) continue;
+    for(size_t n = begin; n < end; n++){
+      size_t k = visible[n];
+      Eigen::Vector3d p2D(u(k), v(k), u(k) - bf * z_inv(k));
+
+      // find neighbor features 
+      candidate_ids.clear();
+      frame->FindNeighborKeypoints(p2D, candidate_ids, r, true);
+      if(candidate_ids.empty()) continue;
+
+      const MappointPtr& mpt = mappoints[valid_indexes[k]];
+      const float* mpd_desc = mpt->GetDescriptor(); 
+      double best_dist = 4.0;
+      int best_idx = -1;
+      double second_dist = 4.0;
+      for(auto& idx : candidate_ids){
+        double dist = DescriptorDistance(mpd_desc, features.col(idx).data() + 3);
+        if(dist < best_dist){
+          second_dist = best_dist;
+          best_dist = dist;
+          best_idx = idx;
+        }else if(dist < second_dist){
+          second_dist = dist;
+        }
+      }
 
-    Eigen::Matrix<double, 256, 1>& mpd_desc = mpt->GetDescriptor(); 
-    double best_dist = 4.0;
-    int best_idx = -1;
-    double second_dist = 4.0;
-    for(auto& idx : candidate_ids){
-      double dist = DescriptorDistance(mpd_desc, features.block<256, 1>(3, idx));
-      if(dist < best_dist){
-        second_dist = best_dist;
-        best_dist = dist;
-        best_idx = idx;
-      }else if(dist < second_dist){
-        second_dist = dist;
+      const double distance_threshold = 0.35;
+      const double ratio_threshold = 0.6;
+      if(best_dist < distance_threshold && best_dist < ratio_threshold * second_dist){
+        output.emplace_back(best_idx, mpt);
       }
     }
+  });
+  for(auto& output : outputs){
+    good_projections.insert(good_projections.end(), output.begin(), output.end());
+  }
+}
 
-    const double distance_threshold = 0.35;
-    const double ratio_threshold = 0.6;
-    if(best_dist < distance_threshold && best_dist < ratio_threshold * second_dist){
-      // frame->InsertMappoint(best_idx, mpt);
-      good_projections.emplace_back(best_idx, mpt);
-    }
+void Map::UpdateMappointIndex(const MappointPtr& mappoint){
+  if(mappoint->IsValid()){
+    _mappoint_index.Update(mappoint->GetId(), mappoint->GetPosition());
+  }else{
+    _mappoint_index.Remove(mappoint->GetId());
+  }
+}
+
+void Map::GetMappointsInRadius(const Eigen::Vector3d& center, double radius, std::vector<MappointPtr>& mappoints){
+  std::vector<int> ids;
+  _mappoint_index.RadiusQuery(center, radius, ids);
+  mappoints.clear();
+  for(int id : ids){
+    MappointPtr mpt = _mappoints.get(id);
+    if(mpt && mpt->IsValid()) mappoints.push_back(mpt);
+  }
+}
+
+void Map::GetMappointsInFrustum(const Eigen::Matrix4d& Twc, double max_depth, std::vector<MappointPtr>& mappoints){
+  std::vector<int> ids;
+  _mappoint_index.FrustumQuery(Twc, _camera, _camera->DepthLowerThr(), max_depth, ids);
+  mappoints.clear();
+  for(int id : ids){
+    MappointPtr mpt = _mappoints.get(id);
+    if(mpt && mpt->IsValid()) mappoints.push_back(mpt);
   }
 }
 
@@ -1010,7 +1478,7 @@ void Map::SaveKeyframeTrajectory(std::string file_path){
   f << std::fixed;
   std::cout << "_keyframe_ids.size = " << _keyframe_ids.size() << std::endl;
   for(auto& frame_id : _keyframe_ids){
-    FramePtr kf = _keyframes[frame_id];
+    FramePtr kf = _keyframes.get(frame_id);
     Eigen::Matrix4d& pose = kf->GetPose();
     Eigen::Vector3d t = pose.block<3, 1>(0, 3);
     Eigen::Quaterniond q(pose.block<3, 3>(0, 0));
@@ -14,11 +14,11 @@
 #include "frame.h"
 #include "point_matching.h"
 #include "map.h"
-#include "g2o_optimization/g2o_optimization.h"
 #include "timer.h"
 #include "debug.h"
 
-MapBuilder::MapBuilder(Configs& configs): _shutdown(false), _init(false), _track_id(0), _line_track_id(0), 
+MapBuilder::MapBuilder(Configs& configs): _klt_detection_request(false), _abort_local_map_optimization(false),
+    _shutdown(false), _init(false), _track_id(0), _line_track_id(0), _reclaimed_landmark_num(0),
     _to_update_local_map(false), _configs(configs){
   _camera = std::shared_ptr<Camera>(new Camera(configs.camera_config_path));
   _superpoint = std::shared_ptr<SuperPoint>(new SuperPoint(configs.superpoint_config));
@@ -28,11 +28,18 @@ MapBuilder::MapBuilder(Configs& configs): _shutdown(false), _init(false), _track
   }
   _point_matching = std::shared_ptr<PointMatching>(new PointMatching(configs.superglue_config));
   _line_detector = std::shared_ptr<LineDetector>(new LineDetector(configs.line_detector_config));
+  _klt_tracker = std::shared_ptr<KltTracker>(new KltTracker(configs.klt_config));
+  _pose_solver = std::shared_ptr<PoseSolver>(new PoseSolver());
+  _pose_solver->SetCamera(_camera);
+  _pnp_solver = std::shared_ptr<PnpSolver>(new PnpSolver());
+  _pnp_solver->SetCamera(_camera);
   _ros_publisher = std::shared_ptr<RosPublisher>(new RosPublisher(configs.ros_publisher_config));
   _map = std::shared_ptr<Map>(new Map(_configs.backend_optimization_config, _camera, _ros_publisher));
+  _map->SetLocalMapOptimizationAbortFlag(&_abort_local_map_optimization);
 
   _feature_thread = std::thread(boost::bind(&MapBuilder::ExtractFeatureThread, this));
   _tracking_thread = std::thread(boost::bind(&MapBuilder::TrackingThread, this));
+  _culling_thread = std::thread(boost::bind(&MapBuilder::KeyframeCullingThread, this));
 }
 
 void MapBuilder::AddInput(InputDataPtr data){
@@ -80,20 +87,35 @@ void MapBuilder::ExtractFeatureThread(){
         _last_image = image_left_rect;
         _last_right_image = image_right_rect;
         _last_keyimage = image_left_rect;
+        _klt_tracker->AddDetectedFrame(frame, image_left_rect, nullptr, std::vector<cv::DMatch>());
       }
       PublishFrame(frame, image_left_rect);
       continue;;
     }
 
-    // extract features and track last keyframe
-    FramePtr last_keyframe = _last_keyframe;
-    const Eigen::Matrix<double, 259, Eigen::Dynamic> features_last_keyframe = last_keyframe->GetAllFeatures();
-
+    // track last keyframe by optical flow, or extract features and match them. the keyframe is pinned
+    // until the tracking thread is done with the frame, and while optical flow tracks from it
+    FramePtr last_keyframe;
+    _culling_mutex.lock();
+    last_keyframe = _last_keyframe;
+    if(last_keyframe != _klt_reference_keyframe){
+      if(_klt_reference_keyframe) UnpinKeyframe(_klt_reference_keyframe->GetFrameId());
+      _klt_reference_keyframe = last_keyframe;
+      PinKeyframe(last_keyframe->GetFrameId());
+    }
+    PinKeyframe(last_keyframe->GetFrameId());
+    _culling_mutex.unlock();
     std::vector<cv::DMatch> matches;
-    Eigen::Matrix<double, 259, Eigen::Dynamic> features_left;
-    std::vector<Eigen::Vector4d> lines_left;
-    ExtractFeatureAndMatch(image_left_rect, features_last_keyframe, features_left, lines_left, matches);
-    frame->AddLeftFeatures(features_left, lines_left);
+    if(!_configs.klt_config.enable || !TrackByKlt(last_keyframe, image_left_rect, frame, matches)){
+      const Eigen::Matrix<double, 259, Eigen::Dynamic> features_last_keyframe = last_keyframe->GetAllFeatures();
+      Eigen::Matrix<double, 259, Eigen::Dynamic> features_left;
+      std::vector<Eigen::Vector4d> lines_left;
+      ExtractFeatureAndMatch(image_left_rect, features_last_keyframe, features_left, lines_left, matches);
+      frame->AddLeftFeatures(features_left, lines_left);
+      if(_configs.klt_config.enable){
+        _klt_tracker->AddDetectedFrame(frame, image_left_rect, last_keyframe, matches);
+      }
+    }
 
     TrackingDataPtr tracking_data = std::shared_ptr<TrackingData>(new TrackingData());
     tracking_data->frame = frame;
@@ -102,6 +124,7 @@ void MapBuilder::ExtractFeatureThread(){
     tracking_data->input_data = input_data;
     
     while(_tracking_data_buffer.size() >= 2){
+      _abort_local_map_optimization = true;
       usleep(2000);
     }
 
@@ -137,11 +160,17 @@ void MapBuilder::TrackingThread(){
     frame->SetPose(_last_frame->GetPose());
     std::function<int()> track_last_frame = [&](){
       if(_num_since_last_keyframe < 1 || !_last_frame_track_well) return -1;
-      InsertKeyframe(_last_frame, _last_right_image);
+      // frames tracked by optical flow are never used as keyframes, so their features are detected first
+      FramePtr last_frame = _last_frame;
+      if(last_frame->TrackedByKlt()){
+        last_frame = DetectKltFrame(_last_frame, _last_image);
+        if(!last_frame) return -1;
+      }
+      InsertKeyframe(last_frame, _last_right_image);
       _last_keyimage = _last_image;
       matches.clear();
-      ref_keyframe = _last_frame;
-      return TrackFrame(_last_frame, frame, matches);
+      ref_keyframe = last_frame;
+      return TrackFrame(last_frame, frame, matches);
     };
 
     int num_match = matches.size();
@@ -153,10 +182,20 @@ void MapBuilder::TrackingThread(){
         num_match = track_last_frame();
       }
     }
+
+    // lost against the keyframes, match the mappoints in view of the last pose instead. frames tracked
+    // by optical flow have no descriptors to match
+    if(num_match < _configs.keyframe_config.min_num_match && _last_frame_track_well && !frame->TrackedByKlt()){
+      num_match = TrackLocalMap(frame, _configs.keyframe_config.min_num_match);
+    }
     PublishFrame(frame, image_left_rect);
 
     _last_frame_track_well = (num_match >= _configs.keyframe_config.min_num_match);
-    if(!_last_frame_track_well) continue;
+    if(!_last_frame_track_well){
+      if(frame->TrackedByKlt()) _klt_detection_request = true;
+      ReleaseTrackingData(tracking_data);
+      continue;
+    }
 
     frame->SetPreviousFrame(ref_keyframe);
     _last_frame_track_well = true;
@@ -165,16 +204,37 @@ void MapBuilder::TrackingThread(){
     // SaveTrackingResult(_last_keyimage, image_left, _last_keyframe, frame, matches, _configs.saving_dir);
 
     if(AddKeyframe(ref_keyframe, frame, num_match) && ref_keyframe->GetFrameId() == _last_keyframe->GetFrameId()){
-      InsertKeyframe(frame, image_right_rect);
-      _last_keyimage = image_left_rect;
+      if(frame->TrackedByKlt()){
+        // keyframes need their own features, so ask for a detected frame instead
+        _klt_detection_request = true;
+      }else{
+        InsertKeyframe(frame, image_right_rect);
+        _last_keyimage = image_left_rect;
+      }
     }
 
     _last_frame = frame;
     _last_image = image_left_rect;
     _last_right_image = image_right_rect;
+    ReleaseTrackingData(tracking_data);
   }  
 }
 
+void MapBuilder::ReleaseTrackingData(const TrackingDataPtr& tracking_data){
+  std::lock_guard<std::mutex> lock(_culling_mutex);
+  UnpinKeyframe(tracking_data->ref_keyframe->GetFrameId());
+}
+
+void MapBuilder::PinKeyframe(int frame_id){
+  _pinned_keyframes[frame_id]++;
+}
+
+void MapBuilder::UnpinKeyframe(int frame_id){
+  std::map<int, int>::iterator it = _pinned_keyframes.find(frame_id);
+  if(it == _pinned_keyframes.end()) return;
+  if(--(it->second) == 0) _pinned_keyframes.erase(it);
+}
+
 void MapBuilder::ExtractFeatrue(const cv::Mat& image, Eigen::Matrix<double, 259, Eigen::Dynamic>& points, 
     std::vector<Eigen::Vector4d>& lines){
   std::function<void()> extract_point = [&](){
@@ -304,10 +364,11 @@ bool MapBuilder::Init(FramePtr frame, cv::Mat& image_left, cv::Mat& image_right)
 
   // add frame and mappoints to map
   InsertKeyframe(frame);
-  for(MappointPtr mappoint : new_mappoints){
+  std::lock_guard<std::mutex> map_lock(_map_mutex);
+  for(const MappointPtr& mappoint : new_mappoints){
     _map->InsertMappoint(mappoint);
   }
-  for(MaplinePtr mapline : new_maplines){
+  for(const MaplinePtr& mapline : new_maplines){
     _map->InsertMapline(mapline);
   }
   _ref_keyframe = frame;
@@ -315,12 +376,49 @@ bool MapBuilder::Init(FramePtr frame, cv::Mat& image_left, cv::Mat& image_right)
   return true;
 }
 
+bool MapBuilder::TrackByKlt(FramePtr ref_keyframe, const cv::Mat& image, FramePtr frame, std::vector<cv::DMatch>& matches){
+  if(_klt_detection_request){
+    _klt_detection_request = false;
+    return false;
+  }
+  if(!_klt_tracker->SetReference(ref_keyframe)) return false;
+
+  Eigen::Matrix<double, 259, Eigen::Dynamic> features;
+  std::vector<Eigen::Vector4d> lines;
+  std::vector<std::map<int, double>> points_on_lines;
+  int tracked_num = _klt_tracker->Track(image, features, lines, points_on_lines, matches);
+  if(tracked_num < _configs.klt_config.min_tracked_points){
+    _klt_tracker->Invalidate();
+    matches.clear();
+    return false;
+  }
+
+  frame->AddLeftFeatures(features, lines, points_on_lines);
+  frame->SetTrackedByKlt(true);
+  return true;
+}
+
+FramePtr MapBuilder::DetectKltFrame(FramePtr frame, const cv::Mat& image){
+  Eigen::Matrix<double, 259, Eigen::Dynamic> features;
+  std::vector<Eigen::Vector4d> lines;
+  std::vector<cv::DMatch> matches;
+  ExtractFeatureAndMatch(image, _last_keyframe->GetAllFeatures(), features, lines, matches);
+
+  FramePtr detected_frame = std::shared_ptr<Frame>(new Frame(frame->GetFrameId(), false, _camera, frame->GetTimestamp()));
+  detected_frame->AddLeftFeatures(features, lines);
+  detected_frame->SetPose(frame->GetPose());
+  int num_match = TrackFrame(_last_keyframe, detected_frame, matches);
+  if(num_match < _configs.keyframe_config.min_num_match) return nullptr;
+  detected_frame->SetPreviousFrame(_last_keyframe);
+  return detected_frame;
+}
+
 int MapBuilder::TrackFrame(FramePtr frame0, FramePtr frame1, std::vector<cv::DMatch>& matches){
   // line tracking
   Eigen::Matrix<double, 259, Eigen::Dynamic>& features0 = frame0->GetAllFeatures();
   Eigen::Matrix<double, 259, Eigen::Dynamic>& features1 = frame1->GetAllFeatures();
-  std::vector<std::map<int, double>> points_on_lines0 = frame0->GetPointsOnLines();
-  std::vector<std::map<int, double>> points_on_lines1 = frame1->GetPointsOnLines();
+  const std::vector<std::map<int, double>>& points_on_lines0 = frame0->GetPointsOnLines();
+  const std::vector<std::map<int, double>>& points_on_lines1 = frame1->GetPointsOnLines();
   std::vector<int> line_matches;
   MatchLines(points_on_lines0, points_on_lines1, matches, features0.cols(), features1.cols(), line_matches);
 
@@ -374,96 +472,43 @@ int MapBuilder::TrackFrame(FramePtr frame0, FramePtr frame1, std::vector<cv::DMa
 
 int MapBuilder::FramePoseOptimization(
     FramePtr frame, std::vector<MappointPtr>& mappoints, std::vector<int>& inliers, int pose_init){
-  // solve PnP using opencv to get initial pose
-  Eigen::Matrix4d Twc = Eigen::Matrix4d::Identity();
-  std::vector<int> cv_inliers;
-  int num_cv_inliers = SolvePnPWithCV(frame, mappoints, Twc, cv_inliers);
+  // solve PnP with RANSAC to get initial pose, the last frame pose is the motion prior
+  Eigen::Matrix4d Twc = _last_frame->GetPose();
+  std::vector<int> pnp_inliers;
+  int num_pnp_inliers = _pnp_solver->Solve(frame, mappoints, Twc, pnp_inliers);
   Eigen::Vector3d check_dp = Twc.block<3, 1>(0, 3) - _last_frame->GetPose().block<3, 1>(0, 3);
-  if(check_dp.norm() > 0.5 || num_cv_inliers < _configs.keyframe_config.min_num_match){
+  if(check_dp.norm() > 0.5 || num_pnp_inliers < _configs.keyframe_config.min_num_match){
     Twc = _last_frame->GetPose();
   }
 
   // Second, optimization
-  MapOfPoses poses;
-  MapOfPoints3d points;
-  std::vector<CameraPtr> camera_list;
-  VectorOfMonoPointConstraints mono_point_constraints;
-  VectorOfStereoPointConstraints stereo_point_constraints;
-
-  camera_list.emplace_back(_camera);
-
-  // map of poses
-  Pose3d pose;
-  pose.p = Twc.block<3, 1>(0, 3);
-  pose.q = Twc.block<3, 3>(0, 0);
-  int frame_id = frame->GetFrameId();    
-  poses.insert(std::pair<int, Pose3d>(frame_id, pose));  
-
-  // visual constraint construction
-  std::vector<size_t> mono_indexes;
-  std::vector<size_t> stereo_indexes;
+  _pose_solver->Clear();
+  _pose_observation_indexes.clear();
   for(size_t i = 0; i < mappoints.size(); i++){
-    // points
-    MappointPtr mpt = mappoints[i];
+    const MappointPtr& mpt = mappoints[i];
     if(mpt == nullptr || !mpt->IsValid()) continue;
     Eigen::Vector3d keypoint; 
     if(!frame->GetKeypointPosition(i, keypoint)) continue;
 
-    int mpt_id = mpt->GetId();
-    Position3d point;
-    point.p = mpt->GetPosition();
-    point.fixed = true;
-    points.insert(std::pair<int, Position3d>(mpt_id, point));
-
-    // visual constraint
     if(keypoint(2) > 0){
-      StereoPointConstraintPtr stereo_constraint = std::shared_ptr<StereoPointConstraint>(new StereoPointConstraint()); 
-      stereo_constraint->id_pose = frame_id;
-      stereo_constraint->id_point = mpt_id;
-      stereo_constraint->id_camera = 0;
-      stereo_constraint->inlier = true;
-      stereo_constraint->keypoint = keypoint;
-      stereo_constraint->pixel_sigma = 0.8;
-      stereo_point_constraints.push_back(stereo_constraint);
-      stereo_indexes.push_back(i);
+      _pose_solver->AddStereoObservation(mpt->GetPosition(), keypoint);
     }else{
-      MonoPointConstraintPtr mono_constraint = std::shared_ptr<MonoPointConstraint>(new MonoPointConstraint()); 
-      mono_constraint->id_pose = frame_id;
-      mono_constraint->id_point = mpt_id;
-      mono_constraint->id_camera = 0;
-      mono_constraint->inlier = true;
-      mono_constraint->keypoint = keypoint.head(2);
-      mono_constraint->pixel_sigma = 0.8;
-      mono_point_constraints.push_back(mono_constraint);
-      mono_indexes.push_back(i);
+      _pose_solver->AddMonoObservation(mpt->GetPosition(), keypoint.head(2));
     }
-
+    _pose_observation_indexes.push_back(i);
   }
-  int num_inliers = FrameOptimization(poses, points, camera_list, mono_point_constraints, 
-      stereo_point_constraints, _configs.tracking_optimization_config);
+  int num_inliers = _pose_solver->Solve(Twc, _configs.tracking_optimization_config);
 
   if(num_inliers > _configs.keyframe_config.min_num_match){
     // set frame pose
-    Eigen::Matrix4d frame_pose = Eigen::Matrix4d::Identity();
-    frame_pose.block<3, 3>(0, 0) = poses.begin()->second.q.matrix();
-    frame_pose.block<3, 1>(0, 3) = poses.begin()->second.p;
-    frame->SetPose(frame_pose);
+    frame->SetPose(Twc);
 
     // update tracked mappoints
-    for(size_t i = 0; i < mono_point_constraints.size(); i++){
-      size_t idx = mono_indexes[i];
-      if(!mono_point_constraints[i]->inlier){
-        inliers[idx] = -1;
+    for(size_t i = 0; i < _pose_observation_indexes.size(); i++){
+      if(!_pose_solver->IsInlier(i)){
+        inliers[_pose_observation_indexes[i]] = -1;
       }
     }
-
-    for(size_t i = 0; i < stereo_point_constraints.size(); i++){
-      size_t idx = stereo_indexes[i];
-      if(!stereo_point_constraints[i]->inlier){
-        inliers[idx] = -1;
-      }
-    }
-
   }
 
   return num_inliers;
@@ -492,7 +537,9 @@ bool MapBuilder::AddKeyframe(FramePtr last_keyframe, FramePtr current_frame, int
 }
 
 void MapBuilder::InsertKeyframe(FramePtr frame, const cv::Mat& image_right){
+  _culling_mutex.lock();
   _last_keyframe = frame;
+  _culling_mutex.unlock();
 
   Eigen::Matrix<double, 259, Eigen::Dynamic> features_right;
   std::vector<Eigen::Vector4d> lines_right;
@@ -504,7 +551,9 @@ void MapBuilder::InsertKeyframe(FramePtr frame, const cv::Mat& image_right){
 }
 
 void MapBuilder::InsertKeyframe(FramePtr frame){
+  _culling_mutex.lock();
   _last_keyframe = frame;
+  _culling_mutex.unlock();
 
   // create new track id
   std::vector<int>& track_ids = frame->GetAllTrackIds();
@@ -522,8 +571,34 @@ void MapBuilder::InsertKeyframe(FramePtr frame){
     }
   }
 
-  // insert keyframe to map
+  // keyframes the culling thread found redundant are removed here, so that only the tracking thread
+  // changes the map and reads it without the lock
+  std::vector<int> redundant_keyframe_ids;
+  std::set<int> pinned_keyframe_ids;
+  _culling_mutex.lock();
+  redundant_keyframe_ids.swap(_redundant_keyframe_ids);
+  for(auto& kv : _pinned_keyframes){
+    pinned_keyframe_ids.insert(kv.first);
+  }
+  _culling_mutex.unlock();
+
+  // insert keyframe to map, then reclaim landmarks that went bad before it. the lock keeps the keyframe
+  // culling thread from reading the map meanwhile
+  _abort_local_map_optimization = false;
+  _map_mutex.lock();
+  if(!redundant_keyframe_ids.empty()){
+    std::vector<int> culled_keyframe_ids;
+    _map->CullKeyframes(redundant_keyframe_ids, _configs.keyframe_culling_config, pinned_keyframe_ids, 
+        culled_keyframe_ids);
+  }
   _map->InsertKeyframe(frame);
+  _reclaimed_landmark_num += _map->CollectGarbage();
+  _map_mutex.unlock();
+  if(_configs.keyframe_culling_config.enable){
+    _culling_mutex.lock();
+    _culling_buffer.push(frame);
+    _culling_mutex.unlock();
+  }
 
   // update last keyframe
   _num_since_last_keyframe = 1;
@@ -531,29 +606,64 @@ void MapBuilder::InsertKeyframe(FramePtr frame){
   _to_update_local_map = true;
 }
 
+void MapBuilder::KeyframeCullingThread(){
+  while(!_shutdown){
+    if(_culling_buffer.empty()){
+      usleep(2000);
+      continue;
+    }
+
+    FramePtr keyframe;
+    _culling_mutex.lock();
+    keyframe = _culling_buffer.front();
+    _culling_buffer.pop();
+    _culling_mutex.unlock();
+
+    // only finds the redundant keyframes, the tracking thread removes them when it inserts the next
+    // keyframe and checks the pins again then
+    std::set<int> pinned_keyframe_ids;
+    _culling_mutex.lock();
+    for(auto& kv : _pinned_keyframes){
+      pinned_keyframe_ids.insert(kv.first);
+    }
+    _culling_mutex.unlock();
+
+    std::vector<int> redundant_keyframe_ids;
+    _map_mutex.lock();
+    _map->FindRedundantKeyframes(keyframe, _configs.keyframe_culling_config, pinned_keyframe_ids, 
+        redundant_keyframe_ids);
+    _map_mutex.unlock();
+    if(redundant_keyframe_ids.empty()) continue;
+
+    _culling_mutex.lock();
+    _redundant_keyframe_ids.insert(_redundant_keyframe_ids.end(), redundant_keyframe_ids.begin(), 
+        redundant_keyframe_ids.end());
+    _culling_mutex.unlock();
+  }
+}
+
 void MapBuilder::UpdateReferenceFrame(FramePtr frame){
   int current_frame_id = frame->GetFrameId();
-  std::vector<MappointPtr>& mappoints = frame->GetAllMappoints();
-  std::map<FramePtr, int> keyframes;
-  for(MappointPtr mpt : mappoints){
+  const std::vector<MappointPtr>& mappoints = frame->GetAllMappoints();
+  std::map<int, int> keyframes;
+  for(const MappointPtr& mpt : mappoints){
     if(!mpt || mpt->IsBad()) continue;
-    const std::map<int, int> obversers = mpt->GetAllObversers();
+    const ObservationList& obversers = mpt->GetAllObversers();
     for(auto& kv : obversers){
       int observer_id = kv.first;
       if(observer_id == current_frame_id) continue;
-      FramePtr keyframe = _map->GetFramePtr(observer_id);
-      if(!keyframe) continue;
-      keyframes[keyframe]++;
+      keyframes[observer_id]++;
     }
   }
-  if(keyframes.empty()) return;
 
   std::pair<FramePtr, int> max_covi = std::pair<FramePtr, int>(nullptr, -1);
   for(auto& kv : keyframes){
-    if(kv.second > max_covi.second){
-      max_covi = kv;
-    }
+    if(kv.second <= max_covi.second) continue;
+    FramePtr keyframe = _map->GetFramePtr(kv.first);
+    if(!keyframe) continue;
+    max_covi = std::pair<FramePtr, int>(keyframe, kv.second);
   }
+  if(!max_covi.first) return;
  
   if(max_covi.first->GetFrameId() != _ref_keyframe->GetFrameId()){
     _ref_keyframe = max_covi.first;
@@ -563,24 +673,17 @@ void MapBuilder::UpdateReferenceFrame(FramePtr frame){
 
 void MapBuilder::UpdateLocalKeyframes(FramePtr frame){
   _local_keyframes.clear();
-  std::vector<std::pair<int, FramePtr>> neighbor_frames = _ref_keyframe->GetOrderedConnections(-1);
+  std::vector<std::pair<int, FramePtr>> neighbor_frames;
+  _map->GetCovisibleKeyframes(_ref_keyframe->GetFrameId(), neighbor_frames);
   for(auto& kv : neighbor_frames){
     _local_keyframes.push_back(kv.second);
   }
 }
 
 void MapBuilder::UpdateLocalMappoints(FramePtr frame){
-  _local_mappoints.clear();
-  int current_frame_id = frame->GetFrameId();
-  for(auto& kf : _local_keyframes){
-    const std::vector<MappointPtr>& mpts = kf->GetAllMappoints();
-    for(auto& mpt : mpts){
-      if(mpt && mpt->IsValid() && mpt->tracking_frame_id != current_frame_id){
-        mpt->tracking_frame_id = current_frame_id;
-        _local_mappoints.push_back(mpt);
-      }
-    }
-  }
+  // the valid mappoints in the view frustum of the predicted pose, also those of keyframes that are not
+  // covisible with the reference keyframe
+  _map->GetMappointsInFrustum(frame->GetPose(), _camera->DepthUpperThr(), _local_mappoints);
 }
 
 void MapBuilder::SearchLocalPoints(FramePtr frame, std::vector<std::pair<int, MappointPtr>>& good_projections){
@@ -601,10 +704,8 @@ void MapBuilder::SearchLocalPoints(FramePtr frame, std::vector<std::pair<int, Ma
 }
 
 int MapBuilder::TrackLocalMap(FramePtr frame, int num_inlier_thr){
-  if(_to_update_local_map){
-    UpdateLocalKeyframes(frame);
-    UpdateLocalMappoints(frame);
-  }
+  // the frustum moves with the pose, so the local mappoints are queried for every frame
+  UpdateLocalMappoints(frame);
 
   std::vector<std::pair<int, MappointPtr>> good_projections;
   SearchLocalPoints(frame, good_projections);
@@ -617,13 +718,17 @@ int MapBuilder::TrackLocalMap(FramePtr frame, int num_inlier_thr){
     mappoints[idx] = good_projection.second;
   }
 
+  // FramePoseOptimization only marks the outliers
   std::vector<int> inliers(mappoints.size(), -1);
+  for(size_t i = 0; i < mappoints.size(); i++){
+    if(mappoints[i] && mappoints[i]->IsValid()) inliers[i] = mappoints[i]->GetId();
+  }
   int num_inliers = FramePoseOptimization(frame, mappoints, inliers, 2);
 
   // update track id
   if(num_inliers > _configs.keyframe_config.min_num_match && num_inliers > num_inlier_thr){
     for(size_t i = 0; i < mappoints.size(); i++){
-      if(inliers[i] > 0){
+      if(inliers[i] >= 0){
         frame->SetTrackId(i, mappoints[i]->GetId());
         frame->InsertMappoint(i, mappoints[i]);
       }
@@ -671,4 +776,6 @@ void MapBuilder::ShutDown(){
   _shutdown = true;
   _feature_thread.join();
   _tracking_thread.join();
+  _culling_thread.join();
+  std::cout << "Reclaimed " << _reclaimed_landmark_num << " bad mappoints and maplines" << std::endl;
 }
@@ -2,12 +2,12 @@
 #include "utils.h"
 #include "line_processor.h"
 
-Mapline::Mapline():local_map_optimization_frame_id(-1), _type(Type::UnTriangulated), 
+Mapline::Mapline():local_map_optimization_frame_id(-1), local_map_marginalization_frame_id(-1), _type(Type::UnTriangulated), 
     _to_update_endpoints(false), _endpoints_valid(false), 
     _line_3d(std::shared_ptr<g2o::Line3D>(new g2o::Line3D())){
 }
 
-Mapline::Mapline(int mappoint_id):local_map_optimization_frame_id(-1),  _id(mappoint_id),
+Mapline::Mapline(int mappoint_id):local_map_optimization_frame_id(-1), local_map_marginalization_frame_id(-1), _id(mappoint_id),
      _type(Type::UnTriangulated), _to_update_endpoints(false), _endpoints_valid(false), 
     _line_3d(std::shared_ptr<g2o::Line3D>(new g2o::Line3D())){
 }
@@ -46,19 +46,12 @@ bool Mapline::IsValid(){
 }
 
 void Mapline::AddObverser(const int& frame_id, const int& line_index){
-  _obversers[frame_id] = line_index;
+  _obversers.set(frame_id, line_index);
 }
 
 void Mapline::RemoveObverser(const int& frame_id){
-  std::map<int, int>::iterator it = _obversers.find(frame_id);
-  if(it != _obversers.end()){
-    _obversers.erase(it);
-  }
-
-  it = _included_endpoints.find(frame_id);
-  if(it != _included_endpoints.end()){
-    _included_endpoints.erase(it);
-  }
+  _obversers.erase(frame_id);
+  _included_endpoints.erase(frame_id);
 }
 
 int Mapline::ObverserNum(){
@@ -128,25 +121,22 @@ g2o::Line3D Mapline::GetLine3D(){
   return *_line_3d;
 }
 
-const std::map<int, int>& Mapline::GetAllObversers(){
+const ObservationList& Mapline::GetAllObversers(){
   return _obversers;
 }
 
 int Mapline::GetLineIdx(int frame_id){
-  if(_obversers.count(frame_id) > 0) return _obversers[frame_id];
-  return -1;
+  return _obversers.get(frame_id, -1);
 }
 
 void Mapline::SetObverserEndpointStatus(int frame_id, int status){
-  _included_endpoints[frame_id] = status;
+  _included_endpoints.set(frame_id, status);
 }
 
 int Mapline::GetObverserEndpointStatus(int frame_id){
-  std::map<int, int>::iterator it = _included_endpoints.find(frame_id);
-  if(it == _included_endpoints.end()) return -1;
-  return it->second;
+  return _included_endpoints.get(frame_id, -1);
 }
 
-const std::map<int, int>& Mapline::GetAllObverserEndpointStatus(){
+const ObservationList& Mapline::GetAllObverserEndpointStatus(){
   return _included_endpoints;
 }
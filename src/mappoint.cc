@@ -1,22 +1,36 @@
 #include "mappoint.h"
 
 Mappoint::Mappoint(): tracking_frame_id(-1), last_frame_seen(-1), local_map_optimization_frame_id(-1),
-     _type(Type::UnTriangulated){
+    local_map_marginalization_frame_id(-1), fuse_frame_id(-1), _slot(LandmarkStore::Instance().Allocate()){
+  LandmarkStore::Instance().Type(_slot) = Type::UnTriangulated;
 }
 
 Mappoint::Mappoint(int& mappoint_id): tracking_frame_id(-1), last_frame_seen(-1),
-    local_map_optimization_frame_id(-1), _id(mappoint_id), _type(Type::UnTriangulated){
+    local_map_optimization_frame_id(-1), local_map_marginalization_frame_id(-1), fuse_frame_id(-1), 
+    _id(mappoint_id), _slot(LandmarkStore::Instance().Allocate()){
   if(mappoint_id < 0) exit(0);
+  LandmarkStore::Instance().Type(_slot) = Type::UnTriangulated;
 }
 
 Mappoint::Mappoint(int& mappoint_id, Eigen::Vector3d& p): tracking_frame_id(-1), last_frame_seen(-1), 
-    local_map_optimization_frame_id(-1), _id(mappoint_id), _type(Type::Good), _position(p){
+    local_map_optimization_frame_id(-1), local_map_marginalization_frame_id(-1), fuse_frame_id(-1), 
+    _id(mappoint_id), _slot(LandmarkStore::Instance().Allocate()){
+  LandmarkStore& store = LandmarkStore::Instance();
+  store.Type(_slot) = Type::Good;
+  store.Position(_slot) = p;
 }
 
 Mappoint::Mappoint(int& mappoint_id, Eigen::Vector3d& p, Eigen::Matrix<double, 256, 1>& d):
     tracking_frame_id(-1), last_frame_seen(-1), local_map_optimization_frame_id(-1), 
-    _id(mappoint_id), _type(Type::Good), _position(p), _descriptor(d){
+    local_map_marginalization_frame_id(-1), fuse_frame_id(-1), _id(mappoint_id), _slot(LandmarkStore::Instance().Allocate()){
+  LandmarkStore& store = LandmarkStore::Instance();
+  store.Type(_slot) = Type::Good;
+  store.Position(_slot) = p;
+  SetDescriptor(d);
+}
 
+Mappoint::~Mappoint(){
+  LandmarkStore::Instance().Release(_slot);
 }
 
 void Mappoint::SetId(int id){
@@ -28,75 +42,78 @@ int Mappoint::GetId(){
 }
 
 void Mappoint::SetType(Type& type){
-  _type = type;
+  LandmarkStore::Instance().Type(_slot) = type;
 }
 
 Mappoint::Type Mappoint::GetType(){
-  return _type;
+  return static_cast<Type>(LandmarkStore::Instance().Type(_slot));
 }
 
 void Mappoint::SetBad(){
-  _type = Type::Bad;
+  LandmarkStore& store = LandmarkStore::Instance();
+  store.Type(_slot) = Type::Bad;
+  store.ObverserNum(_slot) = 0;
   _obversers.clear();
 }
 
 bool Mappoint::IsBad(){
-  return (_type == Type::Bad);
+  return (GetType() == Type::Bad);
 }
 
 void Mappoint::SetGood(){
-  _type = Type::Good;
+  LandmarkStore::Instance().Type(_slot) = Type::Good;
 }
 
 bool Mappoint::IsValid(){
-  return (_type == Type::Good);
+  return (GetType() == Type::Good);
 }
 
 void Mappoint::AddObverser(const int& frame_id, const int& keypoint_index){
-  _obversers[frame_id] = keypoint_index;
+  int old_index = _obversers.get(frame_id, -1);
+  _obversers.set(frame_id, keypoint_index);
+  LandmarkStore::Instance().ObverserNum(_slot) += (keypoint_index >= 0) - (old_index >= 0);
 }
 
 void Mappoint::RemoveObverser(const int& frame_id){
-  std::map<int, int>::iterator it = _obversers.find(frame_id);
-  if(it != _obversers.end()){
-    _obversers.erase(it);
+  int old_index = _obversers.get(frame_id, -1);
+  if(_obversers.erase(frame_id) && old_index >= 0){
+    LandmarkStore::Instance().ObverserNum(_slot)--;
   }
 }
 
 int Mappoint::ObverserNum(){
-  int obverser_num = 0;
-  for(auto& kv : _obversers){
-    if(kv.second >= 0){
-      obverser_num++;
-    }
-  }
-  return obverser_num;
+  return LandmarkStore::Instance().ObverserNum(_slot);
 }
 
 void Mappoint::SetPosition(Eigen::Vector3d& p){
-  _position = p;
-  if(_type == Type::UnTriangulated){
-    _type = Type::Good;
+  LandmarkStore& store = LandmarkStore::Instance();
+  store.Position(_slot) = p;
+  if(store.Type(_slot) == Type::UnTriangulated){
+    store.Type(_slot) = Type::Good;
   }
 }
 
 Eigen::Vector3d& Mappoint::GetPosition(){
-  return _position;
+  return LandmarkStore::Instance().Position(_slot);
 }
 
 void Mappoint::SetDescriptor(const Eigen::Matrix<double, 256, 1>& descriptor){
-  _descriptor = descriptor;
+  Eigen::Map<Eigen::Matrix<float, 256, 1>> d(LandmarkStore::Instance().Descriptor(_slot));
+  d = descriptor.cast<float>();
 }
 
-Eigen::Matrix<double, 256, 1>& Mappoint::GetDescriptor(){
-  return _descriptor;
+const float* Mappoint::GetDescriptor(){
+  return LandmarkStore::Instance().Descriptor(_slot);
 }
 
-std::map<int, int>& Mappoint::GetAllObversers(){
+const ObservationList& Mappoint::GetAllObversers(){
   return _obversers;
 }
 
 int Mappoint::GetKeypointIdx(int frame_id){
-  if(_obversers.count(frame_id) > 0) return _obversers[frame_id];
-  return -1;
-}
\ No newline at end of file
+  return _obversers.get(frame_id, -1);
+}
+
+size_t Mappoint::GetStoreSlot(){
+  return _slot;
+}
@@ -0,0 +1,316 @@
+#include "pnp_solver.h"
+
+#include <math.h>
+#include <algorithm>
+#include <Eigen/Eigenvalues>
+
+namespace {
+
+// coefficients in ascending order
+template<int N, int M>
+Eigen::Matrix<double, N + M - 1, 1> PolynomialProduct(const Eigen::Matrix<double, N, 1>& a, const Eigen::Matrix<double, M, 1>& b){
+  Eigen::Matrix<double, N + M - 1, 1> c = Eigen::Matrix<double, N + M - 1, 1>::Zero();
+  for(int i = 0; i < N; i++){
+    for(int j = 0; j < M; j++){
+      c(i + j) += a(i) * b(j);
+    }
+  }
+  return c;
+}
+
+// real roots of c(0) + c(1) x + ... + c(4) x^4, returns the number of roots
+int SolveQuartic(const Eigen::Matrix<double, 5, 1>& c, double* roots){
+  if(std::abs(c(4)) < 1e-12 * c.cwiseAbs().maxCoeff()) return 0;
+
+  Eigen::Matrix4d companion = Eigen::Matrix4d::Zero();
+  companion.row(0) = -c.head<4>().reverse().transpose() / c(4);
+  companion.block<3, 3>(1, 0).setIdentity();
+  Eigen::EigenSolver<Eigen::Matrix4d> solver(companion, false);
+  const Eigen::Vector4cd& eigenvalues = solver.eigenvalues();
+
+  int num = 0;
+  for(int i = 0; i < 4; i++){
+    if(std::abs(eigenvalues(i).imag()) > 1e-6 * std::max(1.0, std::abs(eigenvalues(i).real()))) continue;
+
+    // polish with newton steps
+    double x = eigenvalues(i).real();
+    for(int k = 0; k < 2; k++){
+      double f = (((c(4) * x + c(3)) * x + c(2)) * x + c(1)) * x + c(0);
+      double df = ((4 * c(4) * x + 3 * c(3)) * x + 2 * c(2)) * x + c(1);
+      if(std::abs(df) < 1e-12) break;
+      x -= f / df;
+    }
+    roots[num++] = x;
+  }
+  return num;
+}
+
+// Tcw that maps the world points onto the camera points, columns are points
+bool AlignPoints(const Eigen::Matrix3d& world_points, const Eigen::Matrix3d& camera_points, Eigen::Matrix4d& Tcw){
+  Tcw = Eigen::umeyama(world_points, camera_points, false);
+  return Tcw.allFinite();
+}
+
+}  // namespace
+
+PnpSolver::PnpSolver(): _fx(1), _fy(1), _cx(0), _cy(0), _bf(0), _reprojection_thr(20.0),
+    _confidence(0.99), _max_iterations(100), _random_engine(0) {}
+
+void PnpSolver::SetCamera(const CameraPtr& camera){
+  _fx = camera->Fx();
+  _fy = camera->Fy();
+  _cx = camera->Cx();
+  _cy = camera->Cy();
+  _bf = camera->BF();
+}
+
+int PnpSolver::Solve(const FramePtr& frame, const std::vector<MappointPtr>& mappoints,
+    Eigen::Matrix4d& Twc, std::vector<int>& inliers){
+  _indexes.clear();
+  _points.clear();
+  _bearings.clear();
+  _stereo_points.clear();
+  _keypoints.clear();
+  _stereo_indexes.clear();
+  for(size_t i = 0; i < mappoints.size(); i++){
+    const MappointPtr& mpt = mappoints[i];
+    if(mpt == nullptr || !mpt->IsValid()) continue;
+    Eigen::Vector3d keypoint;
+    if(!frame->GetKeypointPosition(i, keypoint)) continue;
+
+    Eigen::Vector3d ray((keypoint(0) - _cx) / _fx, (keypoint(1) - _cy) / _fy, 1.0);
+    double disparity = keypoint(0) - keypoint(2);
+    if(keypoint(2) > 0 && disparity > 0){
+      _stereo_indexes.push_back(_indexes.size());
+      _stereo_points.push_back(ray * (_bf / disparity));
+    }else{
+      _stereo_points.push_back(Eigen::Vector3d::Zero());
+    }
+    _indexes.push_back(i);
+    _points.push_back(mpt->GetPosition());
+    _bearings.push_back(ray.normalized());
+    _keypoints.push_back(keypoint.head(2));
+  }
+
+  int n = _indexes.size();
+  if(n < 8) return 0;
+
+  _order.resize(n);
+  for(int i = 0; i < n; i++){
+    _order[i] = i;
+  }
+  std::shuffle(_order.begin(), _order.end(), _random_engine);
+
+  // the motion prior is the first hypothesis
+  Eigen::Matrix4d best_Tcw = Eigen::Matrix4d::Identity();
+  best_Tcw.block<3, 3>(0, 0) = Twc.block<3, 3>(0, 0).transpose();
+  best_Tcw.block<3, 1>(0, 3) = -best_Tcw.block<3, 3>(0, 0) * Twc.block<3, 1>(0, 3);
+  int best_num = Score(best_Tcw, 0);
+  _best_inlier.swap(_inlier);
+
+  // needed iterations for the best inlier ratio, P3P and stereo samples both have three points
+  auto needed_iterations = [&](int inlier_num){
+    double w = static_cast<double>(inlier_num) / n;
+    if(w >= 1.0) return 0;
+    double w3 = w * w * w;
+    if(w3 < 1e-9) return _max_iterations;
+    double iterations = std::log(1.0 - _confidence) / std::log(1.0 - w3);
+    return static_cast<int>(std::min(std::ceil(iterations), static_cast<double>(_max_iterations)));
+  };
+  int iterations = needed_iterations(best_num);
+
+  std::uniform_int_distribution<int> all_distribution(0, n - 1);
+  int stereo_num = _stereo_indexes.size();
+  std::uniform_int_distribution<int> stereo_distribution(0, std::max(stereo_num - 1, 0));
+  Eigen::Matrix4d solutions[4];
+  for(int iteration = 0; iteration < iterations; iteration++){
+    // alternate between stereo and P3P samples, stereo samples are cheaper and better conditioned near the camera
+    bool stereo_sample = (stereo_num >= 3) && (iteration % 2 == 0);
+    int sample[3];
+    for(int k = 0; k < 3; k++){
+      bool repeated = true;
+      while(repeated){
+        sample[k] = stereo_sample ? _stereo_indexes[stereo_distribution(_random_engine)] : all_distribution(_random_engine);
+        repeated = false;
+        for(int j = 0; j < k; j++){
+          repeated = repeated || (sample[j] == sample[k]);
+        }
+      }
+    }
+
+    int solution_num = 0;
+    if(stereo_sample){
+      solution_num = SolveStereo(sample[0], sample[1], sample[2], solutions[0]) ? 1 : 0;
+    }else{
+      solution_num = SolveP3P(sample[0], sample[1], sample[2], solutions);
+    }
+
+    for(int s = 0; s < solution_num; s++){
+      int num = Score(solutions[s], best_num);
+      if(num <= best_num) continue;
+      best_num = num;
+      best_Tcw = solutions[s];
+      _best_inlier.swap(_inlier);
+      iterations = std::min(iterations, needed_iterations(best_num));
+    }
+  }
+
+  // refine on the inliers, the refined pose is kept unless it loses inliers
+  if(best_num >= 6){
+    Eigen::Matrix4d refined_Tcw = best_Tcw;
+    Refine(refined_Tcw);
+    int num = Score(refined_Tcw, best_num - 1);
+    if(num >= best_num){
+      best_num = num;
+      best_Tcw = refined_Tcw;
+      _best_inlier.swap(_inlier);
+    }
+  }
+
+  Eigen::Matrix3d Rwc = best_Tcw.block<3, 3>(0, 0).transpose();
+  Twc.block<3, 3>(0, 0) = Rwc;
+  Twc.block<3, 1>(0, 3) = -Rwc * best_Tcw.block<3, 1>(0, 3);
+
+  inliers = std::vector<int>(mappoints.size(), -1);
+  for(int i = 0; i < n; i++){
+    if(!_best_inlier[i]) continue;
+    int point_idx = _indexes[i];
+    inliers[point_idx] = mappoints[point_idx]->GetId();
+  }
+  return best_num;
+}
+
+int PnpSolver::SolveP3P(int i0, int i1, int i2, Eigen::Matrix4d* solutions){
+  // Grunert's formulation, with depths s0, s1 = u * s0, s2 = v * s0 the law of cosines gives two
+  // quadratics in u whose difference is linear in u, substituting u back leaves a quartic in v
+  const Eigen::Vector3d& P0 = _points[i0];
+  const Eigen::Vector3d& P1 = _points[i1];
+  const Eigen::Vector3d& P2 = _points[i2];
+  const Eigen::Vector3d& f0 = _bearings[i0];
+  const Eigen::Vector3d& f1 = _bearings[i1];
+  const Eigen::Vector3d& f2 = _bearings[i2];
+
+  double a2 = (P1 - P2).squaredNorm();
+  double b2 = (P0 - P2).squaredNorm();
+  double c2 = (P0 - P1).squaredNorm();
+  double cos_alpha = f1.dot(f2);
+  double cos_beta = f0.dot(f2);
+  double cos_gamma = f0.dot(f1);
+  if(b2 < 1e-12) return 0;
+
+  // K = 1 + v^2 - 2 v cos_beta, u = N / D
+  const Eigen::Vector3d K(1.0, -2.0 * cos_beta, 1.0);
+  const Eigen::Vector3d N = b2 * Eigen::Vector3d(1.0, 0.0, -1.0) + (a2 - c2) * K;
+  const Eigen::Vector2d D(2.0 * b2 * cos_gamma, -2.0 * b2 * cos_alpha);
+
+  // b2 * u^2 - 2 * b2 * cos_gamma * u + b2 - c2 * K = 0, multiplied by D^2
+  const Eigen::Matrix<double, 3, 1> DD = PolynomialProduct<2, 2>(D, D);
+  Eigen::Matrix<double, 5, 1> quartic = b2 * PolynomialProduct<3, 3>(N, N);
+  quartic.head<4>() -= 2.0 * b2 * cos_gamma * PolynomialProduct<3, 2>(N, D);
+  quartic.head<3>() += b2 * DD;
+  quartic -= c2 * PolynomialProduct<3, 3>(K, DD);
+
+  double roots[4];
+  int root_num = SolveQuartic(quartic, roots);
+
+  Eigen::Matrix3d world_points;
+  world_points << P0, P1, P2;
+  int solution_num = 0;
+  for(int r = 0; r < root_num; r++){
+    double v = roots[r];
+    if(v <= 0) continue;
+    double d = D(0) + D(1) * v;
+    double k = K(0) + (K(1) + K(2) * v) * v;
+    if(std::abs(d) < 1e-12 || k <= 0) continue;
+    double u = (N(0) + (N(1) + N(2) * v) * v) / d;
+    if(u <= 0) continue;
+
+    double s0 = std::sqrt(b2 / k);
+    Eigen::Matrix3d camera_points;
+    camera_points << s0 * f0, (u * s0) * f1, (v * s0) * f2;
+    if(AlignPoints(world_points, camera_points, solutions[solution_num])){
+      solution_num++;
+    }
+  }
+  return solution_num;
+}
+
+bool PnpSolver::SolveStereo(int i0, int i1, int i2, Eigen::Matrix4d& solution){
+  Eigen::Matrix3d world_points, camera_points;
+  world_points << _points[i0], _points[i1], _points[i2];
+  camera_points << _stereo_points[i0], _stereo_points[i1], _stereo_points[i2];
+
+  // collinear samples do not fix the rotation around their line
+  const Eigen::Vector3d normal = (world_points.col(1) - world_points.col(0)).cross(world_points.col(2) - world_points.col(0));
+  if(normal.squaredNorm() < 1e-12) return false;
+  return AlignPoints(world_points, camera_points, solution);
+}
+
+void PnpSolver::Refine(Eigen::Matrix4d& Tcw){
+  Eigen::Matrix3d R = Tcw.block<3, 3>(0, 0);
+  Eigen::Vector3d t = Tcw.block<3, 1>(0, 3);
+  const int n = _best_inlier.size();
+  for(int iteration = 0; iteration < 5; iteration++){
+    // the update [omega, upsilon] is applied on the left, d(pc) = -[pc]x omega + upsilon
+    Eigen::Matrix<double, 6, 6> H = Eigen::Matrix<double, 6, 6>::Zero();
+    Eigen::Matrix<double, 6, 1> b = Eigen::Matrix<double, 6, 1>::Zero();
+    for(int i = 0; i < n; i++){
+      if(!_best_inlier[i]) continue;
+      const Eigen::Vector3d pc = R * _points[i] + t;
+      if(pc(2) <= 0) continue;
+      double inv_z = 1.0 / pc(2);
+      Eigen::Vector2d e(_fx * pc(0) * inv_z + _cx - _keypoints[i](0), _fy * pc(1) * inv_z + _cy - _keypoints[i](1));
+
+      Eigen::Matrix<double, 2, 3> de_dpc;
+      de_dpc << _fx * inv_z, 0, -_fx * pc(0) * inv_z * inv_z,
+                0, _fy * inv_z, -_fy * pc(1) * inv_z * inv_z;
+      Eigen::Matrix3d skew_pc;
+      skew_pc << 0, -pc(2), pc(1),
+                 pc(2), 0, -pc(0),
+                 -pc(1), pc(0), 0;
+      Eigen::Matrix<double, 2, 6> J;
+      J.leftCols<3>() = -de_dpc * skew_pc;
+      J.rightCols<3>() = de_dpc;
+      H.noalias() += J.transpose() * J;
+      b.noalias() += J.transpose() * e;
+    }
+
+    Eigen::Matrix<double, 6, 1> delta = H.ldlt().solve(-b);
+    if(!delta.allFinite()) return;
+    double angle = delta.head<3>().norm();
+    Eigen::Matrix3d dR = Eigen::Matrix3d::Identity();
+    if(angle > 1e-12) dR = Eigen::AngleAxisd(angle, delta.head<3>() / angle).toRotationMatrix();
+    R = dR * R;
+    t = dR * t + delta.tail<3>();
+    if(delta.squaredNorm() < 1e-16) break;
+  }
+
+  Tcw.block<3, 3>(0, 0) = R;
+  Tcw.block<3, 1>(0, 3) = t;
+}
+
+int PnpSolver::Score(const Eigen::Matrix4d& Tcw, int best_num){
+  const Eigen::Matrix3d R = Tcw.block<3, 3>(0, 0);
+  const Eigen::Vector3d t = Tcw.block<3, 1>(0, 3);
+  const double thr2 = _reprojection_thr * _reprojection_thr;
+  const int n = _order.size();
+  _inlier.assign(n, 0);
+
+  int num = 0;
+  for(int k = 0; k < n; k++){
+    // even if all remaining points were inliers this hypothesis would not win
+    if(num + (n - k) <= best_num) return 0;
+
+    int i = _order[k];
+    const Eigen::Vector3d pc = R * _points[i] + t;
+    if(pc(2) <= 0) continue;
+    double inv_z = 1.0 / pc(2);
+    double du = _fx * pc(0) * inv_z + _cx - _keypoints[i](0);
+    double dv = _fy * pc(1) * inv_z + _cy - _keypoints[i](1);
+    if(du * du + dv * dv < thr2){
+      _inlier[i] = 1;
+      num++;
+    }
+  }
+  return num;
+}
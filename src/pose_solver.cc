@@ -0,0 +1,350 @@
+#include "pose_solver.h"
+
+#include <math.h>
+#include <limits>
+#include <algorithm>
+#include <Eigen/Cholesky>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define POSE_SOLVER_HAS_AVX2 1
+#include <immintrin.h>
+#else
+#define POSE_SOLVER_HAS_AVX2 0
+#endif
+
+namespace {
+
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+double WeightedDotScalar(const double* w, const double* a, const double* b, size_t begin, size_t end){
+  double sum = 0;
+  for(size_t i = begin; i < end; i++){
+    sum += w[i] * a[i] * b[i];
+  }
+  return sum;
+}
+
+#if POSE_SOLVER_HAS_AVX2
+
+__attribute__((target("avx2")))
+size_t WeightedDotAVX2(const double* w, const double* a, const double* b, size_t n, double& sum){
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8){
+    const __m256d wa0 = _mm256_mul_pd(_mm256_loadu_pd(w + i), _mm256_loadu_pd(a + i));
+    const __m256d wa1 = _mm256_mul_pd(_mm256_loadu_pd(w + i + 4), _mm256_loadu_pd(a + i + 4));
+    acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(wa0, _mm256_loadu_pd(b + i)));
+    acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(wa1, _mm256_loadu_pd(b + i + 4)));
+  }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+  sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  return i;
+}
+
+#endif  // POSE_SOLVER_HAS_AVX2
+
+bool PoseSolverUseAVX2(){
+#if POSE_SOLVER_HAS_AVX2
+  static const bool use_avx2 = __builtin_cpu_supports("avx2");
+  return use_avx2;
+#else
+  return false;
+#endif
+}
+
+// sum of w[i] * a[i] * b[i]
+double WeightedDot(const double* w, const double* a, const double* b, size_t n){
+  size_t begin = 0;
+  double sum = 0;
+#if POSE_SOLVER_HAS_AVX2
+  if(PoseSolverUseAVX2()){
+    begin = WeightedDotAVX2(w, a, b, n, sum);
+  }
+#endif
+  return sum + WeightedDotScalar(w, a, b, begin, n);
+}
+
+// Tcw = exp(dx) * Tcw with dx = [omega, upsilon], the same update as g2o::VertexSE3Expmap
+void UpdatePose(const Vector6d& dx, Eigen::Quaterniond& q, Eigen::Vector3d& t){
+  const Eigen::Vector3d omega = dx.head<3>();
+  const Eigen::Vector3d upsilon = dx.tail<3>();
+  const double theta = omega.norm();
+
+  Eigen::Matrix3d Omega;
+  Omega << 0, -omega(2), omega(1),
+           omega(2), 0, -omega(0),
+           -omega(1), omega(0), 0;
+  const Eigen::Matrix3d Omega2 = Omega * Omega;
+
+  Eigen::Matrix3d R, V;
+  if(theta < 0.00001){
+    R = Eigen::Matrix3d::Identity() + Omega + Omega2;
+    V = R;
+  }else{
+    const double theta2 = theta * theta;
+    R = Eigen::Matrix3d::Identity() + std::sin(theta) / theta * Omega + (1 - std::cos(theta)) / theta2 * Omega2;
+    V = Eigen::Matrix3d::Identity() + (1 - std::cos(theta)) / theta2 * Omega
+        + (theta - std::sin(theta)) / (theta2 * theta) * Omega2;
+  }
+
+  Eigen::Quaterniond dq(R);
+  dq.normalize();
+  t = dq * t + V * upsilon;
+  q = dq * q;
+  q.normalize();
+}
+
+// Huber kernel with delta^2 = thr, returns rho(chi2) and sets the weight rho'(chi2)
+inline double Huber(double chi2, double thr, double& weight){
+  if(chi2 <= thr){
+    weight = 1.0;
+    return chi2;
+  }
+  const double e = std::sqrt(chi2);
+  const double delta = std::sqrt(thr);
+  weight = delta / e;
+  return 2 * e * delta - thr;
+}
+
+}  // namespace
+
+PoseSolver::PoseSolver(): _fx(0), _fy(0), _cx(0), _cy(0), _bf(0){
+}
+
+void PoseSolver::Clear(){
+  _x.clear();
+  _y.clear();
+  _z.clear();
+  _u.clear();
+  _v.clear();
+  _ur.clear();
+  _stereo.clear();
+  _inlier.clear();
+}
+
+void PoseSolver::SetCamera(const CameraPtr& camera){
+  _fx = camera->Fx();
+  _fy = camera->Fy();
+  _cx = camera->Cx();
+  _cy = camera->Cy();
+  _bf = camera->BF();
+}
+
+void PoseSolver::AddMonoObservation(const Eigen::Vector3d& point, const Eigen::Vector2d& keypoint){
+  _x.push_back(point(0));
+  _y.push_back(point(1));
+  _z.push_back(point(2));
+  _u.push_back(keypoint(0));
+  _v.push_back(keypoint(1));
+  _ur.push_back(0);
+  _stereo.push_back(0);
+  _inlier.push_back(1);
+}
+
+void PoseSolver::AddStereoObservation(const Eigen::Vector3d& point, const Eigen::Vector3d& keypoint){
+  _x.push_back(point(0));
+  _y.push_back(point(1));
+  _z.push_back(point(2));
+  _u.push_back(keypoint(0));
+  _v.push_back(keypoint(1));
+  _ur.push_back(keypoint(2));
+  _stereo.push_back(1);
+  _inlier.push_back(1);
+}
+
+double PoseSolver::ComputeChi2(const Eigen::Quaterniond& q, const Eigen::Vector3d& t, bool robust){
+  const Eigen::Matrix3d R = q.toRotationMatrix();
+  const size_t n = _x.size();
+  double sum = 0;
+  for(size_t i = 0; i < n; i++){
+    const double x = R(0, 0) * _x[i] + R(0, 1) * _y[i] + R(0, 2) * _z[i] + t(0);
+    const double y = R(1, 0) * _x[i] + R(1, 1) * _y[i] + R(1, 2) * _z[i] + t(1);
+    const double z = R(2, 0) * _x[i] + R(2, 1) * _y[i] + R(2, 2) * _z[i] + t(2);
+    const double invz = 1.0 / z;
+    const double eu = _u[i] - (_fx * x * invz + _cx);
+    const double ev = _v[i] - (_fy * y * invz + _cy);
+    const double er = (_ur[i] - (_fx * x * invz + _cx - _bf * invz)) * _stereo[i];
+    _chi2[i] = eu * eu + ev * ev + er * er;
+
+    if(!_inlier[i]) continue;
+    double weight;
+    sum += robust ? Huber(_chi2[i], _chi2_thr[i], weight) : _chi2[i];
+  }
+  return sum;
+}
+
+double PoseSolver::Linearize(const Eigen::Quaterniond& q, const Eigen::Vector3d& t, bool robust){
+  const Eigen::Matrix3d R = q.toRotationMatrix();
+  const size_t n = _x.size();
+  double* eu = _residual.data();
+  double* ev = eu + n;
+  double* er = ev + n;
+  double* wu = _weight.data();
+  double* wv = wu + n;
+  double* wr = wv + n;
+  double* J[6];
+  for(int k = 0; k < 6; k++) J[k] = _jacobian[k].data();
+
+  double sum = 0;
+  for(size_t i = 0; i < n; i++){
+    // outliers take no part in the system, like edges of level 1 in g2o
+    if(!_inlier[i]){
+      eu[i] = ev[i] = er[i] = 0;
+      wu[i] = wv[i] = wr[i] = 0;
+      for(int k = 0; k < 6; k++) J[k][i] = J[k][n + i] = J[k][2 * n + i] = 0;
+      continue;
+    }
+
+    const double x = R(0, 0) * _x[i] + R(0, 1) * _y[i] + R(0, 2) * _z[i] + t(0);
+    const double y = R(1, 0) * _x[i] + R(1, 1) * _y[i] + R(1, 2) * _z[i] + t(1);
+    const double z = R(2, 0) * _x[i] + R(2, 1) * _y[i] + R(2, 2) * _z[i] + t(2);
+    const double invz = 1.0 / z;
+    const double invz_2 = invz * invz;
+    const double stereo = _stereo[i];
+
+    eu[i] = _u[i] - (_fx * x * invz + _cx);
+    ev[i] = _v[i] - (_fy * y * invz + _cy);
+    er[i] = (_ur[i] - (_fx * x * invz + _cx - _bf * invz)) * stereo;
+    const double chi2 = eu[i] * eu[i] + ev[i] * ev[i] + er[i] * er[i];
+
+    double weight = 1.0;
+    sum += robust ? Huber(chi2, _chi2_thr[i], weight) : chi2;
+    wu[i] = weight;
+    wv[i] = weight;
+    wr[i] = weight * stereo;
+
+    // error = measurement - projection, perturbation [omega, upsilon] on the left of Tcw
+    J[0][i] = x * y * invz_2 * _fx;
+    J[1][i] = -(1 + x * x * invz_2) * _fx;
+    J[2][i] = y * invz * _fx;
+    J[3][i] = -invz * _fx;
+    J[4][i] = 0;
+    J[5][i] = x * invz_2 * _fx;
+
+    J[0][n + i] = (1 + y * y * invz_2) * _fy;
+    J[1][n + i] = -x * y * invz_2 * _fy;
+    J[2][n + i] = -x * invz * _fy;
+    J[3][n + i] = 0;
+    J[4][n + i] = -invz * _fy;
+    J[5][n + i] = y * invz_2 * _fy;
+
+    J[0][2 * n + i] = J[0][i] - _bf * y * invz_2;
+    J[1][2 * n + i] = J[1][i] + _bf * x * invz_2;
+    J[2][2 * n + i] = J[2][i];
+    J[3][2 * n + i] = J[3][i];
+    J[4][2 * n + i] = 0;
+    J[5][2 * n + i] = J[5][i] - _bf * invz_2;
+  }
+  return sum;
+}
+
+void PoseSolver::BuildSystem(Eigen::Matrix<double, 6, 6>& H, Eigen::Matrix<double, 6, 1>& b){
+  const size_t rows = 3 * _x.size();
+  const double* w = _weight.data();
+  for(int i = 0; i < 6; i++){
+    for(int j = i; j < 6; j++){
+      H(i, j) = WeightedDot(w, _jacobian[i].data(), _jacobian[j].data(), rows);
+      H(j, i) = H(i, j);
+    }
+    b(i) = -WeightedDot(w, _jacobian[i].data(), _residual.data(), rows);
+  }
+}
+
+void PoseSolver::Optimize(Eigen::Quaterniond& q, Eigen::Vector3d& t, int iterations, bool robust){
+  size_t inlier_num = 0;
+  for(uint8_t inlier : _inlier) inlier_num += inlier;
+  if(inlier_num == 0) return;
+
+  // levenberg-marquardt with the damping strategy of g2o::OptimizationAlgorithmLevenberg
+  Matrix6d H;
+  Vector6d b;
+  double lambda = 0;
+  double ni = 2;
+  for(int iter = 0; iter < iterations; iter++){
+    double chi2 = Linearize(q, t, robust);
+    BuildSystem(H, b);
+    if(iter == 0){
+      lambda = 1e-5 * H.diagonal().maxCoeff();
+      ni = 2;
+    }
+
+    double rho = 0;
+    int trial = 0;
+    do{
+      Matrix6d H_damped = H;
+      H_damped.diagonal().array() += lambda;
+      Eigen::LDLT<Matrix6d> ldlt(H_damped);
+      const Vector6d dx = ldlt.solve(b);
+
+      Eigen::Quaterniond new_q = q;
+      Eigen::Vector3d new_t = t;
+      UpdatePose(dx, new_q, new_t);
+      double new_chi2 = ComputeChi2(new_q, new_t, robust);
+      if(ldlt.info() != Eigen::Success || !dx.allFinite()){
+        new_chi2 = std::numeric_limits<double>::max();
+      }
+
+      const double scale = dx.dot(lambda * dx + b) + 1e-3;
+      rho = (chi2 - new_chi2) / scale;
+      if(rho > 0 && std::isfinite(new_chi2)){
+        const double alpha = std::min(1.0 - std::pow(2 * rho - 1, 3), 2.0 / 3.0);
+        lambda *= std::max(1.0 / 3.0, alpha);
+        ni = 2;
+        q = new_q;
+        t = new_t;
+      }else{
+        lambda *= ni;
+        ni *= 2;
+        if(!std::isfinite(lambda)) break;
+      }
+      trial++;
+    }while(rho < 0 && trial < 10);
+
+    if(trial == 10 || rho == 0 || !std::isfinite(lambda)) break;
+  }
+}
+
+int PoseSolver::Solve(Eigen::Matrix4d& Twc, const OptimizationConfig& cfg){
+  const size_t n = _x.size();
+  _chi2_thr.resize(n);
+  _chi2.resize(n);
+  _residual.resize(3 * n);
+  _weight.resize(3 * n);
+  for(int k = 0; k < 6; k++) _jacobian[k].resize(3 * n);
+  for(size_t i = 0; i < n; i++){
+    _chi2_thr[i] = _stereo[i] > 0 ? cfg.stereo_point : cfg.mono_point;
+  }
+
+  const Eigen::Matrix3d Rwc = Twc.block<3, 3>(0, 0);
+  const Eigen::Quaterniond q0(Rwc.transpose());
+  const Eigen::Vector3d t0 = -(Rwc.transpose() * Twc.block<3, 1>(0, 3));
+
+  // every round restarts from the initial pose, the last one without robust kernels
+  Eigen::Quaterniond q = q0;
+  Eigen::Vector3d t = t0;
+  int num_outlier = 0;
+  for(int round = 0; round < 4; round++){
+    q = q0;
+    t = t0;
+    Optimize(q, t, 10, round < 3);
+
+    ComputeChi2(q, t, false);
+    num_outlier = 0;
+    for(size_t i = 0; i < n; i++){
+      _inlier[i] = (_chi2[i] > _chi2_thr[i]) ? 0 : 1;
+      num_outlier += (1 - _inlier[i]);
+    }
+
+    if(n < 10) break;
+  }
+
+  const Eigen::Matrix3d Rcw = q.toRotationMatrix();
+  Twc.block<3, 3>(0, 0) = Rcw.transpose();
+  Twc.block<3, 1>(0, 3) = -(Rcw.transpose() * t);
+  return n - num_outlier;
+}
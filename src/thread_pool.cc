@@ -0,0 +1,74 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int thread_num): _thread_num(std::max(thread_num, 1)), _job_generation(0), _stop(false){
+  for(int i = 1; i < _thread_num; i++){
+    _workers.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _job_cond.notify_all();
+  for(auto& worker : _workers){
+    worker.join();
+  }
+}
+
+void ThreadPool::Run(size_t range_num, const std::function<void(size_t)>& task){
+  std::unique_lock<std::mutex> run_lock(_run_mutex, std::try_to_lock);
+  if(!run_lock.owns_lock() || _workers.empty()){
+    for(size_t t = 0; t < range_num; t++){
+      task(t);
+    }
+    return;
+  }
+
+  std::shared_ptr<Job> job(new Job);
+  job->task = task;
+  job->range_num = range_num;
+  job->next_range = 0;
+  job->done_num = 0;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _job = job;
+    _job_generation++;
+  }
+  _job_cond.notify_all();
+
+  Work(*job);
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done_cond.wait(lock, [&job](){ return job->done_num.load() == job->range_num; });
+  _job.reset();
+}
+
+bool ThreadPool::Work(Job& job){
+  bool finished_last = false;
+  for(size_t t = job.next_range++; t < job.range_num; t = job.next_range++){
+    job.task(t);
+    finished_last = (++job.done_num == job.range_num);
+  }
+  return finished_last;
+}
+
+void ThreadPool::WorkerLoop(){
+  size_t generation = 0;
+  while(true){
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _job_cond.wait(lock, [&](){ return _stop || (_job && _job_generation != generation); });
+      if(_stop) return;
+      generation = _job_generation;
+      job = _job;
+    }
+
+    if(Work(*job)){
+      // the caller checks the count under the mutex, so the notification can not be missed
+      std::lock_guard<std::mutex> lock(_mutex);
+      _done_cond.notify_all();
+    }
+  }
+}
@@ -15,6 +15,13 @@ double DescriptorDistance(const Eigen::Matrix<double, 256, 1>& f1, const Eigen::
   return 2 * (1.0 - f1.transpose() * f2);
 }
 
+// f1 is a mappoint descriptor in LandmarkStore, f2 a column of the frame features
+double DescriptorDistance(const float* f1, const double* f2){
+  Eigen::Map<const Eigen::Matrix<float, 256, 1>> v1(f1);
+  Eigen::Map<const Eigen::Matrix<double, 256, 1>> v2(f2);
+  return 2 * (1.0 - v1.cast<double>().dot(v2));
+}
+
 cv::Scalar GenerateColor(int id){
   id++;
   int red = (id * 23) % 255;
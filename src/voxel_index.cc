@@ -0,0 +1,144 @@
+#include "voxel_index.h"
+
+#include <math.h>
+#include <algorithm>
+
+VoxelIndex::VoxelIndex(double voxel_size): _voxel_size(voxel_size), _voxel_size_inv(1.0 / voxel_size){
+}
+
+Eigen::Vector3i VoxelIndex::VoxelCoordinate(const Eigen::Vector3d& p){
+  return Eigen::Vector3i(std::floor(p(0) * _voxel_size_inv), std::floor(p(1) * _voxel_size_inv), 
+      std::floor(p(2) * _voxel_size_inv));
+}
+
+// 21 bits per axis, enough for +-1e6 voxels
+int64_t VoxelIndex::VoxelKey(const Eigen::Vector3i& v){
+  const int64_t mask = (1 << 21) - 1;
+  return ((v(0) & mask) << 42) | ((v(1) & mask) << 21) | (v(2) & mask);
+}
+
+void VoxelIndex::Update(int id, const Eigen::Vector3d& position){
+  int64_t key = VoxelKey(VoxelCoordinate(position));
+  Entry* entry = _entries.find(id);
+  if(entry){
+    entry->position = position;
+    if(entry->key == key) return;
+    Remove(id);
+  }
+
+  Entry new_entry;
+  new_entry.key = key;
+  new_entry.position = position;
+  _entries.insert(id, new_entry);
+  _voxels[key].push_back(id);
+}
+
+void VoxelIndex::Remove(int id){
+  Entry* entry = _entries.find(id);
+  if(!entry) return;
+
+  std::unordered_map<int64_t, std::vector<int>>::iterator it = _voxels.find(entry->key);
+  if(it != _voxels.end()){
+    std::vector<int>& ids = it->second;
+    std::vector<int>::iterator id_it = std::find(ids.begin(), ids.end(), id);
+    if(id_it != ids.end()){
+      *id_it = ids.back();
+      ids.pop_back();
+    }
+    if(ids.empty()) _voxels.erase(it);
+  }
+  _entries.erase(id);
+}
+
+void VoxelIndex::Clear(){
+  _voxels.clear();
+  _entries.clear();
+}
+
+size_t VoxelIndex::Size(){
+  return _entries.size();
+}
+
+template<typename Function>
+void VoxelIndex::VisitBox(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner, Function visit){
+  Eigen::Vector3i v0 = VoxelCoordinate(min_corner);
+  Eigen::Vector3i v1 = VoxelCoordinate(max_corner);
+  double box_voxel_num = (double)(v1(0) - v0(0) + 1) * (v1(1) - v0(1) + 1) * (v1(2) - v0(2) + 1);
+
+  // large boxes are cheaper to answer by scanning the occupied voxels
+  if(box_voxel_num > _voxels.size()){
+    for(auto& kv : _voxels){
+      const Eigen::Vector3d& p = _entries.find(kv.second[0])->position;
+      Eigen::Vector3i v = VoxelCoordinate(p);
+      if((v.array() < v0.array()).any() || (v.array() > v1.array()).any()) continue;
+      visit(kv.second);
+    }
+    return;
+  }
+
+  for(int x = v0(0); x <= v1(0); x++){
+    for(int y = v0(1); y <= v1(1); y++){
+      for(int z = v0(2); z <= v1(2); z++){
+        std::unordered_map<int64_t, std::vector<int>>::iterator it = _voxels.find(VoxelKey(Eigen::Vector3i(x, y, z)));
+        if(it != _voxels.end()) visit(it->second);
+      }
+    }
+  }
+}
+
+void VoxelIndex::RadiusQuery(const Eigen::Vector3d& center, double radius, std::vector<int>& ids){
+  ids.clear();
+  const double radius_square = radius * radius;
+  Eigen::Vector3d half(radius, radius, radius);
+  VisitBox(center - half, center + half, [&](const std::vector<int>& voxel_ids){
+    for(int id : voxel_ids){
+      if((_entries.find(id)->position - center).squaredNorm() <= radius_square){
+        ids.push_back(id);
+      }
+    }
+  });
+  std::sort(ids.begin(), ids.end());
+}
+
+void VoxelIndex::FrustumQuery(const Eigen::Matrix4d& Twc, CameraPtr camera, double min_depth, double max_depth, 
+    std::vector<int>& ids){
+  ids.clear();
+  const Eigen::Matrix3d Rwc = Twc.block<3, 3>(0, 0);
+  const Eigen::Vector3d twc = Twc.block<3, 1>(0, 3);
+  const Eigen::Matrix3d Rcw = Rwc.transpose();
+  const double fx = camera->Fx();
+  const double fy = camera->Fy();
+  const double cx = camera->Cx();
+  const double cy = camera->Cy();
+  const double width = camera->ImageWidth();
+  const double height = camera->ImageHeight();
+
+  // bounding box of the frustum corners
+  Eigen::Vector3d min_corner = twc;
+  Eigen::Vector3d max_corner = twc;
+  const double us[2] = {0.0, width};
+  const double vs[2] = {0.0, height};
+  const double depths[2] = {min_depth, max_depth};
+  for(double d : depths){
+    for(double u : us){
+      for(double v : vs){
+        Eigen::Vector3d pc((u - cx) / fx * d, (v - cy) / fy * d, d);
+        Eigen::Vector3d pw = Rwc * pc + twc;
+        min_corner = min_corner.cwiseMin(pw);
+        max_corner = max_corner.cwiseMax(pw);
+      }
+    }
+  }
+
+  VisitBox(min_corner, max_corner, [&](const std::vector<int>& voxel_ids){
+    for(int id : voxel_ids){
+      Eigen::Vector3d pc = Rcw * (_entries.find(id)->position - twc);
+      if(pc(2) <= 0 || pc(2) < min_depth || pc(2) > max_depth) continue;
+      double u = fx * pc(0) / pc(2) + cx;
+      double v = fy * pc(1) / pc(2) + cy;
+      if(u < 0 || u >= width || v < 0 || v >= height) continue;
+      ids.push_back(id);
+    }
+  });
+  std::sort(ids.begin(), ids.end());
+}
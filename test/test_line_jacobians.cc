@@ -0,0 +1,165 @@
+#include <cmath>
+#include <random>
+#include <gtest/gtest.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <g2o/core/jacobian_workspace.h>
+#include <g2o/types/sba/vertex_se3_expmap.h>
+#include <g2o/types/slam3d_addons/line3d.h>
+
+#include "g2o_optimization/vertex_line3d.h"
+#include "g2o_optimization/edge_project_line.h"
+#include "g2o_optimization/edge_project_stereo_line.h"
+
+// compares the analytic jacobians of the line edges with the numeric ones of g2o::BaseBinaryEdge at
+// random poses and lines, the observations are noisy so that the residuals are not zero
+
+namespace {
+
+const double fx = 435.2;
+const double fy = 437.1;
+const double cx = 367.2;
+const double cy = 252.2;
+const double bf = 47.9;
+const int TrialNum = 200;
+
+class LineJacobianTest : public ::testing::Test{
+protected:
+  LineJacobianTest(): _rng(7), _uniform(-1.0, 1.0) {
+    _kv << -fy * cx, -fx * cy, fx * fy;
+  }
+
+  double Uniform(double min, double max){
+    return min + 0.5 * (_uniform(_rng) + 1.0) * (max - min);
+  }
+
+  g2o::SE3Quat RandomPose(){
+    Eigen::Vector3d axis(_uniform(_rng), _uniform(_rng), _uniform(_rng));
+    Eigen::Quaterniond q(Eigen::AngleAxisd(Uniform(0, M_PI), axis.normalized()));
+    Eigen::Vector3d t(Uniform(-5, 5), Uniform(-5, 5), Uniform(-5, 5));
+    return g2o::SE3Quat(q, t);
+  }
+
+  // endpoints in front of the camera, returns false for lines close to the world origin whose
+  // orthonormal representation degenerates
+  bool RandomLine(const g2o::SE3Quat& Tcw, Eigen::Vector3d& pc0, Eigen::Vector3d& pc1, g2o::Line3D& line){
+    pc0 << Uniform(-2, 2), Uniform(-1.5, 1.5), Uniform(2, 8);
+    pc1 << Uniform(-2, 2), Uniform(-1.5, 1.5), Uniform(2, 8);
+    if((pc1 - pc0).norm() < 0.5) return false;
+
+    g2o::SE3Quat Twc = Tcw.inverse();
+    Eigen::Vector3d pw0 = Twc.map(pc0);
+    Eigen::Vector3d pw1 = Twc.map(pc1);
+    Vector6d plucker;
+    plucker.head<3>() = pw0.cross(pw1);
+    plucker.tail<3>() = pw1 - pw0;
+    if(plucker.head<3>().norm() < 0.1 * plucker.tail<3>().norm()) return false;
+    line = g2o::Line3D(plucker);
+    line.normalize();
+    return true;
+  }
+
+  Eigen::Vector2d Project(const Eigen::Vector3d& pc){
+    Eigen::Vector2d uv(fx * pc(0) / pc(2) + cx, fy * pc(1) / pc(2) + cy);
+    return uv + 2.0 * Eigen::Vector2d(_uniform(_rng), _uniform(_rng));
+  }
+
+  // runs the analytic linearizeOplus of edge, then the numeric one of BaseEdge. the jacobians are maps
+  // into the workspace, so they are copied in between
+  template<typename BaseEdge, typename Edge>
+  void ExpectJacobiansMatch(Edge& edge){
+    g2o::JacobianWorkspace workspace;
+    workspace.updateSize(&edge);
+    workspace.allocate();
+    edge.computeError();
+    edge.linearizeOplus(workspace);
+    Eigen::MatrixXd line_jacobian = edge.jacobianOplusXi();
+    Eigen::MatrixXd pose_jacobian = edge.jacobianOplusXj();
+
+    edge.BaseEdge::linearizeOplus();
+    Eigen::MatrixXd numeric_line_jacobian = edge.jacobianOplusXi();
+    Eigen::MatrixXd numeric_pose_jacobian = edge.jacobianOplusXj();
+
+    EXPECT_LT((line_jacobian - numeric_line_jacobian).norm(), 1e-4 * numeric_line_jacobian.norm() + 1e-6)
+        << "analytic:\n" << line_jacobian << "\nnumeric:\n" << numeric_line_jacobian;
+    EXPECT_LT((pose_jacobian - numeric_pose_jacobian).norm(), 1e-4 * numeric_pose_jacobian.norm() + 1e-6)
+        << "analytic:\n" << pose_jacobian << "\nnumeric:\n" << numeric_pose_jacobian;
+  }
+
+protected:
+  Eigen::Vector3d _kv;
+  std::mt19937 _rng;
+  std::uniform_real_distribution<double> _uniform;
+};
+
+TEST_F(LineJacobianTest, MonoLineEdge){
+  int tested_num = 0;
+  while(tested_num < TrialNum){
+    g2o::SE3Quat Tcw = RandomPose();
+    Eigen::Vector3d pc0, pc1;
+    g2o::Line3D line;
+    if(!RandomLine(Tcw, pc0, pc1, line)) continue;
+
+    VertexLine3D line_vertex;
+    line_vertex.setId(0);
+    line_vertex.setEstimate(line);
+    g2o::VertexSE3Expmap pose_vertex;
+    pose_vertex.setId(1);
+    pose_vertex.setEstimate(Tcw);
+
+    EdgeSE3ProjectLine edge;
+    edge.setVertex(0, &line_vertex);
+    edge.setVertex(1, &pose_vertex);
+    edge.fx = fx;
+    edge.fy = fy;
+    edge.Kv = _kv;
+    Eigen::Vector4d obs;
+    obs << Project(pc0), Project(pc1);
+    edge.setMeasurement(obs);
+    edge.setInformation(Eigen::Matrix2d::Identity());
+
+    ExpectJacobiansMatch<g2o::BaseBinaryEdge<2, Eigen::Vector4d, VertexLine3D, g2o::VertexSE3Expmap>>(edge);
+    tested_num++;
+  }
+}
+
+TEST_F(LineJacobianTest, StereoLineEdge){
+  const double b = bf / fx;
+  const Eigen::Vector3d right_offset(b, 0, 0);
+  int tested_num = 0;
+  while(tested_num < TrialNum){
+    g2o::SE3Quat Tcw = RandomPose();
+    Eigen::Vector3d pc0, pc1;
+    g2o::Line3D line;
+    if(!RandomLine(Tcw, pc0, pc1, line)) continue;
+
+    VertexLine3D line_vertex;
+    line_vertex.setId(0);
+    line_vertex.setEstimate(line);
+    g2o::VertexSE3Expmap pose_vertex;
+    pose_vertex.setId(1);
+    pose_vertex.setEstimate(Tcw);
+
+    EdgeStereoSE3ProjectLine edge;
+    edge.setVertex(0, &line_vertex);
+    edge.setVertex(1, &pose_vertex);
+    edge.fx = fx;
+    edge.fy = fy;
+    edge.b = b;
+    edge.Kv = _kv;
+    Vector8d obs;
+    obs << Project(pc0), Project(pc1), Project(pc0 - right_offset), Project(pc1 - right_offset);
+    edge.setMeasurement(obs);
+    edge.setInformation(Eigen::Matrix4d::Identity());
+
+    ExpectJacobiansMatch<g2o::BaseBinaryEdge<4, Vector8d, VertexLine3D, g2o::VertexSE3Expmap>>(edge);
+    tested_num++;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv){
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,236 @@
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <g2o/core/block_solver.h>
+#include <g2o/core/optimization_algorithm_levenberg.h>
+#include <g2o/core/robust_kernel_impl.h>
+#include <g2o/solvers/eigen/linear_solver_eigen.h>
+#include <g2o/types/sba/types_six_dof_expmap.h>
+
+#include "camera.h"
+#include "read_configs.h"
+#include "pose_solver.h"
+
+// compares PoseSolver with the g2o frame optimization it replaces, on synthetic frames of mono and
+// stereo observations of which some are gross outliers. both start from the same perturbed pose and
+// should end at the same pose with the same inliers
+
+namespace {
+
+const int FrameNum = 50;
+const int ObservationNum = 120;
+const double StereoRate = 0.6;
+const double OutlierRate = 0.2;
+
+struct Observation{
+  Eigen::Vector3d point;
+  Eigen::Vector3d keypoint;
+  bool stereo;
+  bool outlier;
+};
+
+// the scheme of the former FrameOptimization: BlockSolver_6_3 with levenberg, four rounds of 10
+// iterations from the initial pose, huber kernels in the first three rounds, chi2 rejection after each
+int G2oFrameOptimization(const CameraPtr& camera, const std::vector<Observation>& observations,
+    const OptimizationConfig& cfg, Eigen::Matrix4d& Twc, std::vector<bool>& inliers){
+  g2o::SparseOptimizer optimizer;
+  optimizer.setVerbose(false);
+  std::unique_ptr<g2o::BlockSolver_6_3::LinearSolverType> linear_solver;
+  linear_solver = g2o::make_unique<g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>>();
+  g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(
+      g2o::make_unique<g2o::BlockSolver_6_3>(std::move(linear_solver)));
+  optimizer.setAlgorithm(solver);
+
+  const Eigen::Matrix3d Rwc = Twc.block<3, 3>(0, 0);
+  const g2o::SE3Quat Twc_init(Eigen::Quaterniond(Rwc), Twc.block<3, 1>(0, 3));
+  g2o::VertexSE3Expmap* frame_vertex = new g2o::VertexSE3Expmap();
+  frame_vertex->setEstimate(Twc_init.inverse());
+  frame_vertex->setId(0);
+  frame_vertex->setFixed(false);
+  optimizer.addVertex(frame_vertex);
+
+  std::vector<g2o::OptimizableGraph::Edge*> edges;
+  std::vector<double> chi2_thr;
+  for(const Observation& observation : observations){
+    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+    if(observation.stereo){
+      g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+      e->setVertex(0, frame_vertex);
+      e->setMeasurement(observation.keypoint);
+      e->setInformation(Eigen::Matrix3d::Identity());
+      e->setRobustKernel(rk);
+      rk->setDelta(std::sqrt(cfg.stereo_point));
+      e->fx = camera->Fx();
+      e->fy = camera->Fy();
+      e->cx = camera->Cx();
+      e->cy = camera->Cy();
+      e->bf = camera->BF();
+      e->Xw = observation.point;
+      optimizer.addEdge(e);
+      edges.push_back(e);
+      chi2_thr.push_back(cfg.stereo_point);
+    }else{
+      g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
+      e->setVertex(0, frame_vertex);
+      e->setMeasurement(observation.keypoint.head<2>());
+      e->setInformation(Eigen::Matrix2d::Identity());
+      e->setRobustKernel(rk);
+      rk->setDelta(std::sqrt(cfg.mono_point));
+      e->fx = camera->Fx();
+      e->fy = camera->Fy();
+      e->cx = camera->Cx();
+      e->cy = camera->Cy();
+      e->Xw = observation.point;
+      optimizer.addEdge(e);
+      edges.push_back(e);
+      chi2_thr.push_back(cfg.mono_point);
+    }
+  }
+
+  inliers.assign(edges.size(), true);
+  int num_outlier = 0;
+  for(size_t iter = 0; iter < 4; iter++){
+    frame_vertex->setEstimate(Twc_init.inverse());
+    optimizer.initializeOptimization(0);
+    optimizer.optimize(10);
+
+    num_outlier = 0;
+    for(size_t i = 0; i < edges.size(); i++){
+      g2o::OptimizableGraph::Edge* e = edges[i];
+      if(!inliers[i]){
+        e->computeError();
+      }
+
+      if(e->chi2() > chi2_thr[i]){
+        inliers[i] = false;
+        e->setLevel(1);
+        num_outlier++;
+      }else{
+        inliers[i] = true;
+        e->setLevel(0);
+      }
+
+      if(iter == 2) e->setRobustKernel(0);
+    }
+
+    if(optimizer.edges().size() < 10) break;
+  }
+
+  Twc = frame_vertex->estimate().inverse().to_homogeneous_matrix();
+  return edges.size() - num_outlier;
+}
+
+class PoseSolverTest : public ::testing::Test{
+protected:
+  PoseSolverTest(): _rng(7), _uniform(-1.0, 1.0) {
+    _camera = std::make_shared<Camera>(AIRVO_TEST_CAMERA_FILE);
+
+    // thresholds of configs/configs_euroc.yaml
+    _cfg.mono_point = 50;
+    _cfg.stereo_point = 75;
+    _cfg.mono_line = 50;
+    _cfg.stereo_line = 75;
+    _cfg.rate = 0.5;
+  }
+
+  double Uniform(double min, double max){
+    return min + 0.5 * (_uniform(_rng) + 1.0) * (max - min);
+  }
+
+  Eigen::Matrix4d RandomPose(double angle, double distance){
+    Eigen::Vector3d axis(_uniform(_rng), _uniform(_rng), _uniform(_rng));
+    Eigen::Vector3d direction(_uniform(_rng), _uniform(_rng), _uniform(_rng));
+    Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+    T.block<3, 3>(0, 0) = Eigen::AngleAxisd(angle, axis.normalized()).toRotationMatrix();
+    T.block<3, 1>(0, 3) = distance * direction.normalized();
+    return T;
+  }
+
+  // points in front of the camera with 1 pixel of noise, outliers are shifted by 30 to 60 pixels
+  void RandomFrame(const Eigen::Matrix4d& Twc, std::vector<Observation>& observations){
+    const double fx = _camera->Fx();
+    const double fy = _camera->Fy();
+    const double cx = _camera->Cx();
+    const double cy = _camera->Cy();
+    const double bf = _camera->BF();
+
+    observations.resize(ObservationNum);
+    for(Observation& observation : observations){
+      Eigen::Vector3d pc(Uniform(-3, 3), Uniform(-2, 2), Uniform(2, 10));
+      observation.point = Twc.block<3, 3>(0, 0) * pc + Twc.block<3, 1>(0, 3);
+      observation.stereo = Uniform(0, 1) < StereoRate;
+      observation.outlier = Uniform(0, 1) < OutlierRate;
+
+      const double u = fx * pc(0) / pc(2) + cx;
+      const double v = fy * pc(1) / pc(2) + cy;
+      observation.keypoint << u + _uniform(_rng), v + _uniform(_rng), u - bf / pc(2) + _uniform(_rng);
+      if(observation.outlier){
+        Eigen::Vector2d shift(_uniform(_rng), _uniform(_rng));
+        shift = Uniform(30, 60) * shift.normalized();
+        observation.keypoint(0) += shift(0);
+        observation.keypoint(1) += shift(1);
+        observation.keypoint(2) += shift(0);
+      }
+    }
+  }
+
+protected:
+  CameraPtr _camera;
+  OptimizationConfig _cfg;
+  std::mt19937 _rng;
+  std::uniform_real_distribution<double> _uniform;
+};
+
+TEST_F(PoseSolverTest, MatchesG2oFrameOptimization){
+  PoseSolver pose_solver;
+  pose_solver.SetCamera(_camera);
+  for(int frame = 0; frame < FrameNum; frame++){
+    const Eigen::Matrix4d Twc = RandomPose(Uniform(0, M_PI), Uniform(0, 5));
+    std::vector<Observation> observations;
+    RandomFrame(Twc, observations);
+    const Eigen::Matrix4d Twc_init = Twc * RandomPose(0.02, 0.1);
+
+    pose_solver.Clear();
+    for(const Observation& observation : observations){
+      if(observation.stereo){
+        pose_solver.AddStereoObservation(observation.point, observation.keypoint);
+      }else{
+        pose_solver.AddMonoObservation(observation.point, observation.keypoint.head<2>());
+      }
+    }
+    Eigen::Matrix4d Twc_solver = Twc_init;
+    const int solver_inlier_num = pose_solver.Solve(Twc_solver, _cfg);
+
+    Eigen::Matrix4d Twc_g2o = Twc_init;
+    std::vector<bool> g2o_inliers;
+    const int g2o_inlier_num = G2oFrameOptimization(_camera, observations, _cfg, Twc_g2o, g2o_inliers);
+
+    EXPECT_EQ(solver_inlier_num, g2o_inlier_num) << "frame " << frame;
+    ASSERT_EQ(pose_solver.Size(), observations.size());
+    for(size_t i = 0; i < observations.size(); i++){
+      EXPECT_EQ(pose_solver.IsInlier(i), g2o_inliers[i]) << "frame " << frame << ", observation " << i;
+      EXPECT_EQ(pose_solver.IsInlier(i), !observations[i].outlier) << "frame " << frame << ", observation " << i;
+    }
+
+    const Eigen::Matrix4d dT = Twc_g2o.inverse() * Twc_solver;
+    const double angle = Eigen::AngleAxisd(Eigen::Matrix3d(dT.block<3, 3>(0, 0))).angle();
+    const double distance = dT.topRightCorner<3, 1>().norm();
+    EXPECT_LT(angle, 1e-5) << "frame " << frame;
+    EXPECT_LT(distance, 1e-4) << "frame " << frame;
+
+    const Eigen::Matrix4d dT_truth = Twc.inverse() * Twc_solver;
+    const double error = dT_truth.topRightCorner<3, 1>().norm();
+    EXPECT_LT(error, 0.05) << "frame " << frame;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv){
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}